@@ -18,7 +18,13 @@
 */
 
 #include <algorithm>
+#include <condition_variable>
+#include <map>
+#include <mutex>
 #include <sstream>
+#include <thread>
+#include <utility>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -38,7 +44,9 @@
 #include <adplug/players.h>
 
 #include <libaudcore/audstrings.h>
+#include <libaudcore/hook.h>
 #include <libaudcore/i18n.h>
+#include <libaudcore/playlist.h>
 #include <libaudcore/plugin.h>
 #include <libaudcore/runtime.h>
 #include <libaudcore/preferences.h>
@@ -108,6 +116,9 @@ const char * const AdPlugXMMS::exts[] = {
 // Default AdPlug user's configuration subdirectory
 #define ADPLUG_CONFDIR		".adplug"
 
+// File name of the song length cache in Audacious' user directory
+#define LENGTHCACHE_FILE	"adplug-lengths"
+
 /***** Global variables *****/
 
 // Player variables
@@ -143,6 +154,176 @@ dbg_printf (const char *fmt, ...)
 
 #endif
 
+/***** Song length cache *****/
+
+// Getting the length of a song means emulating all of it, so the results
+// are kept across sessions, keyed by a hash of the file contents and the
+// subsong.  Lengths of files not in the cache can optionally be computed
+// by a background thread, so that adding large collections does not block.
+
+typedef std::pair<uint64_t, unsigned> LengthKey;
+
+static struct {
+  std::mutex mutex;
+  std::map<LengthKey, int> lengths;
+  String path;
+
+  std::thread worker;
+  std::condition_variable cond;
+  std::map<LengthKey, String> queue;  // key -> filename
+  bool quit = false;
+} lengthcache;
+
+// 64-bit FNV-1a hash
+static uint64_t
+lengthcache_hash (const Index<char> & data)
+{
+  uint64_t hash = 0xcbf29ce484222325;
+
+  for (char c : data)
+  {
+    hash ^= (unsigned char) c;
+    hash *= 0x100000001b3;
+  }
+
+  return hash;
+}
+
+static void
+lengthcache_load ()
+{
+  lengthcache.path = String (str_concat ({aud_get_path (AudPath::UserDir),
+   "/" LENGTHCACHE_FILE}));
+
+  FILE * f = fopen (lengthcache.path, "r");
+  if (! f)
+    return;
+
+  unsigned long long hash;
+  unsigned subsong;
+  int length;
+
+  while (fscanf (f, "%llx %u %d\n", & hash, & subsong, & length) == 3)
+    lengthcache.lengths[LengthKey (hash, subsong)] = length;
+
+  fclose (f);
+  dbg_printf (" (%d cached lengths)", (int) lengthcache.lengths.size ());
+}
+
+static bool
+lengthcache_lookup (const LengthKey & key, int & length)
+{
+  std::lock_guard<std::mutex> lock (lengthcache.mutex);
+
+  auto it = lengthcache.lengths.find (key);
+  if (it == lengthcache.lengths.end ())
+    return false;
+
+  length = it->second;
+  return true;
+}
+
+// new entries are appended, the file is never rewritten
+static void
+lengthcache_store (const LengthKey & key, int length)
+{
+  std::lock_guard<std::mutex> lock (lengthcache.mutex);
+
+  if (! lengthcache.lengths.emplace (key, length).second)
+    return;
+
+  FILE * f = fopen (lengthcache.path, "a");
+  if (! f)
+    return;
+
+  fprintf (f, "%llx %u %d\n", (unsigned long long) key.first, key.second, length);
+  fclose (f);
+}
+
+static void
+lengthcache_run ()
+{
+  std::unique_lock<std::mutex> lock (lengthcache.mutex);
+
+  while (! lengthcache.quit)
+  {
+    if (lengthcache.queue.empty ())
+    {
+      lengthcache.cond.wait (lock);
+      continue;
+    }
+
+    LengthKey key = lengthcache.queue.begin ()->first;
+    String filename = lengthcache.queue.begin ()->second;
+    lengthcache.queue.erase (lengthcache.queue.begin ());
+
+    lock.unlock ();
+
+    VFSFile file (filename, "r");
+    if (file)
+    {
+      CSilentopl tmpopl;
+      CFileVFSProvider fp (file);
+      CPlayer *p = CAdPlug::factory (filename, &tmpopl, CAdPlug::players, fp);
+
+      if (p)
+      {
+        lengthcache_store (key, p->songlength (key.second));
+        delete p;
+
+        // let read_tag() pick up the length (in the main thread)
+        event_queue ("adplug length found", new String (filename),
+         aud::delete_obj<String>);
+      }
+    }
+
+    lock.lock ();
+  }
+}
+
+static void
+lengthcache_found (void * filename, void *)
+{
+  Playlist::rescan_file (* (const String *) filename);
+}
+
+static void
+lengthcache_queue (const LengthKey & key, const char * filename)
+{
+  std::lock_guard<std::mutex> lock (lengthcache.mutex);
+
+  if (! lengthcache.worker.joinable ())
+  {
+    hook_associate ("adplug length found", lengthcache_found, nullptr);
+    lengthcache.quit = false;
+    lengthcache.worker = std::thread (lengthcache_run);
+  }
+
+  lengthcache.queue.emplace (key, String (filename));
+  lengthcache.cond.notify_one ();
+}
+
+static void
+lengthcache_cleanup ()
+{
+  {
+    std::lock_guard<std::mutex> lock (lengthcache.mutex);
+    lengthcache.quit = true;
+    lengthcache.queue.clear ();
+    lengthcache.cond.notify_one ();
+  }
+
+  if (lengthcache.worker.joinable ())
+  {
+    lengthcache.worker.join ();
+    event_queue_cancel ("adplug length found");
+    hook_dissociate ("adplug length found", lengthcache_found);
+  }
+
+  lengthcache.lengths.clear ();
+  lengthcache.path = String ();
+}
+
 /***** Main player (!! threaded !!) *****/
 
 bool AdPlugXMMS::read_tag (const char * filename, VFSFile & file, Tuple & tuple,
@@ -150,12 +331,28 @@ bool AdPlugXMMS::read_tag (const char * filename, VFSFile & file, Tuple & tuple,
 {
   CSilentopl tmpopl;
 
+  LengthKey key (lengthcache_hash (file.read_all ()), plr.subsong);
+  if (file.fseek (0, VFS_SEEK_SET))
+    return false;
+
   CFileVFSProvider fp (file);
   CPlayer *p = CAdPlug::factory (filename, &tmpopl, CAdPlug::players, fp);
 
   if (! p)
     return false;
 
+  int length = -1;
+  if (! lengthcache_lookup (key, length))
+  {
+    if (aud_get_bool (CFG_ID, "BackgroundLength"))
+      lengthcache_queue (key, filename);
+    else
+    {
+      length = p->songlength (plr.subsong);
+      lengthcache_store (key, length);
+    }
+  }
+
   if (! p->getauthor().empty())
     tuple.set_str (Tuple::Artist, p->getauthor().c_str());
 
@@ -166,7 +363,8 @@ bool AdPlugXMMS::read_tag (const char * filename, VFSFile & file, Tuple & tuple,
 
   tuple.set_str (Tuple::Codec, p->gettype().c_str());
   tuple.set_str (Tuple::Quality, _("sequenced"));
-  tuple.set_int (Tuple::Length, p->songlength (plr.subsong));
+  if (length >= 0)
+    tuple.set_int (Tuple::Length, length);
   tuple.set_int (Tuple::Channels, 2);
   delete p;
 
@@ -329,6 +527,7 @@ const char * const AdPlugXMMS::defaults[] = {
  "Frequency", "44100",
  "Endless", "FALSE",
  "Emulator", "0",
+ "BackgroundLength", "FALSE",
  nullptr};
 
 /***** Configuration UI *****/
@@ -355,7 +554,9 @@ const PreferencesWidget AdPlugXMMS::widgets[] = {
     WidgetInt (CFG_ID, "Frequency"), {8000, 192000, 50, N_("Hz")}),
   WidgetLabel (N_("<b>Miscellaneous</b>")),
   WidgetCheck (N_("Repeat song in endless loop"),
-    WidgetBool (CFG_ID, "Endless"))
+    WidgetBool (CFG_ID, "Endless")),
+  WidgetCheck (N_("Compute song lengths in the background"),
+    WidgetBool (CFG_ID, "BackgroundLength"))
 };
 
 const PluginPreferences AdPlugXMMS::prefs = {{widgets}};
@@ -383,6 +584,8 @@ bool AdPlugXMMS::init ()
       }
     }
   }
+  dbg_printf (", length cache");
+  lengthcache_load ();
   dbg_printf (".\n");
 
   return true;
@@ -390,6 +593,9 @@ bool AdPlugXMMS::init ()
 
 void AdPlugXMMS::cleanup ()
 {
+  // the length thread may still be using the database
+  lengthcache_cleanup ();
+
   // Close database
   dbg_printf ("db, ");
   plr.db.clear ();
@@ -65,12 +65,17 @@ protected:
     bool m_backend_initialized = false;
 
     static bool audio_init ();
+    static void audio_queue (midievent_t * event);
+    static void audio_render (int64_t frame);
     static void audio_generate (double seconds);
+    static void audio_finish ();
+    static void audio_flush ();
+    static void audio_discard ();
     static void audio_cleanup ();
 
     static void generate_ticks (midifile_t & midifile, int num_ticks);
     static void play_loop (midifile_t & midifile);
-    static int skip_to (midifile_t & midifile, int seektime);
+    static int skip_to (midifile_t & midifile, int seektime, int & index);
 };
 
 EXPORT AMIDIPlug aud_plugin_instance;
@@ -98,6 +103,9 @@ bool AMIDIPlug::init ()
         "fsyn_synth_polyphony", "-1",
         "fsyn_synth_reverb", "-1",
         "fsyn_synth_chorus", "-1",
+        "fsyn_synth_float", "TRUE",
+        "fsyn_synth_cpu_cores", "1",
+        "fsyn_render_block", "2048",
         "skip_leading", "FALSE",
         "skip_trailing", "FALSE",
         nullptr
@@ -162,44 +170,174 @@ bool AMIDIPlug::read_tag (const char * filename, VFSFile & file, Tuple & tuple,
 }
 
 
+/* the synth is always run in steps of this many frames (FluidSynth's own
+   block size), however close together the events are; an event takes
+   effect at the start of the first step at or after its time */
+#define RENDER_STEP 64
+
+struct QueuedEvent {
+    int64_t frame;
+    midievent_t * event;
+};
+
 static int s_samplerate, s_channels;
-static int s_bufsize;
-static int16_t * s_buf;
+static int s_framesize;
+static int s_bufsize, s_buffilled;
+static double s_time; /* frames of song time passed so far */
+static int64_t s_rendered; /* frames rendered so far */
+static Index<QueuedEvent> s_queue;
+static int s_queue_head;
+static char * s_buf;
 
 bool AMIDIPlug::audio_init ()
 {
     int bitdepth;
+    int format;
 
     backend_audio_info (& s_channels, & bitdepth, & s_samplerate);
 
-    if (bitdepth != 16)
+    /* the backend renders either 16-bit integer or 32-bit float samples */
+    if (bitdepth == 16)
+        format = FMT_S16_NE;
+    else if (bitdepth == 32)
+        format = FMT_FLOAT;
+    else
         return false;
 
-    open_audio (FMT_S16_NE, s_samplerate, s_channels);
+    open_audio (format, s_samplerate, s_channels);
+
+    /* audio is passed on in blocks of fixed size, made of whole steps */
+    int block = aud::clamp (aud_get_int ("amidiplug", "fsyn_render_block"), 64, 65536);
+    block = (block + RENDER_STEP - 1) / RENDER_STEP * RENDER_STEP;
 
-    s_bufsize = 2 * s_channels * (s_samplerate / 4);
-    s_buf = new int16_t[s_bufsize / 2];
+    s_framesize = s_channels * (bitdepth / 8);
+    s_bufsize = s_framesize * block;
+    s_buf = new char[s_bufsize];
+
+    audio_discard ();
 
     return true;
 }
 
-void AMIDIPlug::audio_generate (double seconds)
+static void send_event (midievent_t * event)
 {
-    int total = 2 * s_channels * (int) round (seconds * s_samplerate);
+    switch (event->type)
+    {
+    case SND_SEQ_EVENT_NOTEON:
+        seq_event_noteon (event);
+        break;
+
+    case SND_SEQ_EVENT_NOTEOFF:
+        seq_event_noteoff (event);
+        break;
+
+    case SND_SEQ_EVENT_KEYPRESS:
+        seq_event_keypress (event);
+        break;
+
+    case SND_SEQ_EVENT_CONTROLLER:
+        seq_event_controller (event);
+        break;
+
+    case SND_SEQ_EVENT_PGMCHANGE:
+        seq_event_pgmchange (event);
+        break;
+
+    case SND_SEQ_EVENT_CHANPRESS:
+        seq_event_chanpress (event);
+        break;
+
+    case SND_SEQ_EVENT_PITCHBEND:
+        seq_event_pitchbend (event);
+        break;
+
+    case SND_SEQ_EVENT_SYSEX:
+        seq_event_sysex (event);
+        break;
+
+    case SND_SEQ_EVENT_TEMPO:
+        seq_event_tempo (event);
+        break;
+
+    case SND_SEQ_EVENT_META_TEXT:
+        /* do nothing */
+        break;
 
-    while (total)
+    case SND_SEQ_EVENT_META_LYRIC:
+        /* do nothing */
+        break;
+
+    default:
+        AUDDBG ("PLAY thread, encountered invalid event type %i\n", event->type);
+        break;
+    }
+}
+
+/* queues an event to take effect at the current song time */
+void AMIDIPlug::audio_queue (midievent_t * event)
+{
+    s_queue.append (QueuedEvent {(int64_t) s_time, event});
+}
+
+/* renders whole steps until the given frame is reached, applying the
+   queued events that are due before each step */
+void AMIDIPlug::audio_render (int64_t frame)
+{
+    while (s_rendered < frame)
     {
-        int chunk = (total < s_bufsize) ? total : s_bufsize;
+        while (s_queue_head < s_queue.len () && s_queue[s_queue_head].frame <= s_rendered)
+            send_event (s_queue[s_queue_head ++].event);
 
-        backend_generate_audio (s_buf, chunk);
-        write_audio (s_buf, chunk);
+        if (s_queue_head == s_queue.len ())
+        {
+            s_queue.clear ();
+            s_queue_head = 0;
+        }
 
-        total -= chunk;
+        backend_generate_audio (s_buf + s_buffilled, RENDER_STEP * s_framesize);
+        s_buffilled += RENDER_STEP * s_framesize;
+        s_rendered += RENDER_STEP;
+
+        if (s_buffilled == s_bufsize)
+            audio_flush ();
     }
 }
 
+void AMIDIPlug::audio_generate (double seconds)
+{
+    s_time += seconds * s_samplerate;
+
+    /* only steps which are over completely; the rest is rendered once
+       the events falling into it are known */
+    audio_render ((int64_t) s_time / RENDER_STEP * RENDER_STEP);
+}
+
+void AMIDIPlug::audio_finish ()
+{
+    audio_render ((int64_t) s_time);
+    audio_flush ();
+}
+
+void AMIDIPlug::audio_flush ()
+{
+    if (s_buffilled)
+        write_audio (s_buf, s_buffilled);
+
+    s_buffilled = 0;
+}
+
+void AMIDIPlug::audio_discard ()
+{
+    s_buffilled = 0;
+    s_time = 0;
+    s_rendered = 0;
+    s_queue.clear ();
+    s_queue_head = 0;
+}
+
 void AMIDIPlug::audio_cleanup ()
 {
+    s_queue.clear ();
     delete[] s_buf;
 }
 
@@ -248,40 +386,24 @@ void AMIDIPlug::generate_ticks (midifile_t & midifile, int num_ticks)
 void AMIDIPlug::play_loop (midifile_t & midifile)
 {
     int tick = midifile.start_tick;
+    int index = 0;
     bool stopped = false;
 
-    /* initialize current position in each track */
-    for (midifile_track_t & track : midifile.tracks)
-        track.current_event = track.events.head ();
+    midifile.build_snapshots ();
 
     while (! (stopped = check_stop ()))
     {
         int seektime = check_seek ();
         if (seektime >= 0)
-            tick = skip_to (midifile, seektime);
-
-        midievent_t * event = nullptr;
-        midifile_track_t * event_track = nullptr;
-        int min_tick = midifile.max_tick + 1;
-
-        /* search next event */
-        for (midifile_track_t & track : midifile.tracks)
         {
-            midievent_t * e2 = track.current_event;
-
-            if ((e2) && (e2->tick < min_tick))
-            {
-                min_tick = e2->tick;
-                event = e2;
-                event_track = & track;
-            }
+            audio_discard ();
+            tick = skip_to (midifile, seektime, index);
         }
 
-        if (!event)
+        if (index >= midifile.events.len () || midifile.events[index].tick > midifile.max_tick)
             break; /* end of song reached */
 
-        /* advance pointer to next event */
-        event_track->current_event = event_track->events.next (event);
+        midievent_t * event = & midifile.events[index ++];
 
         if (event->tick > tick)
         {
@@ -289,118 +411,129 @@ void AMIDIPlug::play_loop (midifile_t & midifile)
             tick = event->tick;
         }
 
-        switch (event->type)
+        /* the tempo changes the song time of the following events at once,
+           everything else reaches the synth through the queue */
+        if (event->type == SND_SEQ_EVENT_TEMPO)
         {
-        case SND_SEQ_EVENT_NOTEON:
-            seq_event_noteon (event);
-            break;
-
-        case SND_SEQ_EVENT_NOTEOFF:
-            seq_event_noteoff (event);
-            break;
-
-        case SND_SEQ_EVENT_KEYPRESS:
-            seq_event_keypress (event);
-            break;
-
-        case SND_SEQ_EVENT_CONTROLLER:
-            seq_event_controller (event);
-            break;
-
-        case SND_SEQ_EVENT_PGMCHANGE:
-            seq_event_pgmchange (event);
-            break;
-
-        case SND_SEQ_EVENT_CHANPRESS:
-            seq_event_chanpress (event);
-            break;
-
-        case SND_SEQ_EVENT_PITCHBEND:
-            seq_event_pitchbend (event);
-            break;
-
-        case SND_SEQ_EVENT_SYSEX:
-            seq_event_sysex (event);
-            break;
-
-        case SND_SEQ_EVENT_TEMPO:
-            seq_event_tempo (event);
             AUDDBG ("PLAY thread, processing tempo event with value %i on tick %i\n",
                       event->tempo, event->tick);
             midifile.current_tempo = event->tempo;
-            break;
-
-        case SND_SEQ_EVENT_META_TEXT:
-            /* do nothing */
-            break;
-
-        case SND_SEQ_EVENT_META_LYRIC:
-            /* do nothing */
-            break;
-
-        default:
-            AUDDBG ("PLAY thread, encountered invalid event type %i\n", event->type);
-            break;
         }
+
+        audio_queue (event);
     }
 
     if (! stopped)
+    {
         generate_ticks (midifile, midifile.max_tick - tick);
+        audio_finish ();
+    }
 
     backend_reset ();
 }
 
 
-/* amidigplug_skipto: re-do all events that influence the playing of our
-   midi file; re-do them using a time-tick of 0, so they are processed
-   istantaneously and proceed this way until the playing_tick is reached */
-int AMIDIPlug::skip_to (midifile_t & midifile, int seektime)
+/* sends the channel state recorded in a snapshot to the backend */
+static void restore_snapshot (const midifile_snapshot_t & snapshot)
 {
-    backend_reset ();
-
-    int tick = midifile.start_tick;
-    if (midifile.avg_microsec_per_tick > 0)
-        tick += (int64_t) seektime * 1000 / midifile.avg_microsec_per_tick;
+    midievent_t event;
 
-    /* initialize current position in each track */
-    for (midifile_track_t & track : midifile.tracks)
-        track.current_event = track.events.head ();
+    auto send_cc = [& event] (int cc, int value)
+    {
+        event.d[1] = cc;
+        event.d[2] = value;
+        seq_event_controller (& event);
+    };
 
-    for (;;)
+    for (int channel = 0; channel < 16; channel ++)
     {
-        midievent_t * event = nullptr;
-        midifile_track_t * event_track = nullptr;
-        int min_tick = midifile.max_tick + 1;
+        const midifile_channel_state_t & state = snapshot.channels[channel];
+
+        event.d[0] = channel;
 
-        /* search next event */
-        for (midifile_track_t & track : midifile.tracks)
+        /* bank select must come before the program change */
+        if (state.controller[0] >= 0)
+            send_cc (0, state.controller[0]);
+        if (state.controller[32] >= 0)
+            send_cc (32, state.controller[32]);
+
+        if (state.program >= 0)
         {
-            midievent_t * e2 = track.current_event;
+            event.d[1] = state.program;
+            seq_event_pgmchange (& event);
+        }
 
-            if ((e2) && (e2->tick < min_tick))
-            {
-                min_tick = e2->tick;
-                event = e2;
-                event_track = & track;
-            }
+        for (int cc = 1; cc < 120; cc ++)
+        {
+            /* parameter numbers and data entry are handled below */
+            if (cc == 6 || cc == 32 || cc == 38 || (cc >= 98 && cc <= 101))
+                continue;
+
+            if (state.controller[cc] >= 0)
+                send_cc (cc, state.controller[cc]);
         }
 
-        /* unlikely here... unless very strange MIDI files are played :) */
-        if (!event)
+        if (state.bend_range[0] >= 0 || state.bend_range[1] >= 0)
         {
-            AUDDBG ("SKIPTO request, reached the last event but not the requested tick (!)\n");
-            break; /* end of song reached */
+            send_cc (101, 0);
+            send_cc (100, 0);
+
+            if (state.bend_range[0] >= 0)
+                send_cc (6, state.bend_range[0]);
+            if (state.bend_range[1] >= 0)
+                send_cc (38, state.bend_range[1]);
         }
 
-        /* reached the requested tick, job done */
-        if (event->tick >= tick)
+        /* leave the last selected parameter numbers active */
+        for (int cc : {99, 98, 101, 100})
         {
-            AUDDBG ("SKIPTO request, reached the requested tick, exiting from skipto loop\n");
-            break;
+            if (state.controller[cc] >= 0)
+                send_cc (cc, state.controller[cc]);
         }
 
-        /* advance pointer to next event */
-        event_track->current_event = event_track->events.next (event);
+        if (state.chanpress >= 0)
+        {
+            event.d[1] = state.chanpress;
+            seq_event_chanpress (& event);
+        }
+
+        if (state.pitchbend >= 0)
+        {
+            event.d[1] = state.pitchbend & 0x7f;
+            event.d[2] = state.pitchbend >> 7;
+            seq_event_pitchbend (& event);
+        }
+    }
+}
+
+
+/* amidigplug_skipto: restore the channel state from the nearest snapshot
+   before the requested position, then re-do the events following it that
+   influence the playing of our midi file; re-do them using a time-tick of 0,
+   so they are processed istantaneously and proceed this way until the
+   requested tick is reached */
+int AMIDIPlug::skip_to (midifile_t & midifile, int seektime, int & index)
+{
+    backend_reset ();
+
+    int tick = midifile.microsec_to_tick ((int64_t) seektime * 1000);
+    int target = midifile.find_event (tick);
+
+    index = 0;
+
+    if (midifile.snapshots.len () > 0)
+    {
+        int snap = aud::min (target / MIDIFILE_SNAPSHOT_INTERVAL, midifile.snapshots.len () - 1);
+
+        restore_snapshot (midifile.snapshots[snap]);
+        index = midifile.snapshots[snap].event_index;
+    }
+
+    AUDDBG ("SKIPTO request, replaying events %i to %i\n", index, target);
+
+    for (; index < target; index ++)
+    {
+        midievent_t * event = & midifile.events[index];
 
         switch (event->type)
         {
@@ -433,11 +566,12 @@ int AMIDIPlug::skip_to (midifile_t & midifile, int seektime)
 
         case SND_SEQ_EVENT_TEMPO:
             seq_event_tempo (event);
-            midifile.current_tempo = event->tempo;
             break;
         }
     }
 
+    midifile.current_tempo = midifile.tempo_at_tick (tick);
+
     return tick;
 }
 
@@ -36,6 +36,7 @@ typedef struct
 {
     fluid_settings_t * settings;
     fluid_synth_t * synth;
+    bool use_float;
 
     Index<int> soundfont_ids;
 }
@@ -58,6 +59,7 @@ void backend_init ()
     int polyphony = aud_get_int ("amidiplug", "fsyn_synth_polyphony");
     int reverb = aud_get_int ("amidiplug", "fsyn_synth_reverb");
     int chorus = aud_get_int ("amidiplug", "fsyn_synth_chorus");
+    int cpu_cores = aud_get_int ("amidiplug", "fsyn_synth_cpu_cores");
 
     if (gain != -1)
         fluid_settings_setnum (sc.settings, "synth.gain", gain / 10.0);
@@ -71,6 +73,11 @@ void backend_init ()
     if (chorus != -1)
         fluid_settings_setint (sc.settings, "synth.chorus.active", chorus);
 
+    /* render voices in parallel on several threads */
+    if (cpu_cores > 1)
+        fluid_settings_setint (sc.settings, "synth.cpu-cores", cpu_cores);
+
+    sc.use_float = aud_get_bool ("amidiplug", "fsyn_synth_float");
     sc.synth = new_fluid_synth (sc.settings);
 
     /* load soundfonts */
@@ -184,14 +191,19 @@ void seq_event_allnoteoff (int unused)
 
 void backend_generate_audio (void * buf, int bufsize)
 {
-    fluid_synth_write_s16 (sc.synth, bufsize / 4, buf, 0, 2, buf, 1, 2);
+    if (sc.use_float)
+        fluid_synth_write_float (sc.synth, bufsize / (2 * sizeof (float)), buf, 0, 2, buf, 1, 2);
+    else
+        fluid_synth_write_s16 (sc.synth, bufsize / 4, buf, 0, 2, buf, 1, 2);
 }
 
 
 void backend_audio_info (int * channels, int * bitdepth, int * samplerate)
 {
     *channels = 2;
-    *bitdepth = 16; /* always 16 bit, we use fluid_synth_write_s16() */
+    /* 32 bit means float samples from fluid_synth_write_float(),
+       16 bit means integer samples from fluid_synth_write_s16() */
+    *bitdepth = sc.use_float ? 32 : 16;
     *samplerate = aud_get_int ("amidiplug", "fsyn_synth_samplerate");
 }
 
@@ -152,7 +152,15 @@ static const PreferencesWidget amidiplug_widgets[] = {
     WidgetBox ({{chorus_widgets}, true}),
     WidgetSpin (N_("Sample rate:"),
         WidgetInt ("amidiplug", "fsyn_synth_samplerate", backend_change),
-        {22050, 96000, 1, N_("Hz")})
+        {22050, 96000, 1, N_("Hz")}),
+    WidgetCheck (N_("Render floating point samples"),
+        WidgetBool ("amidiplug", "fsyn_synth_float", backend_change)),
+    WidgetSpin (N_("CPU cores:"),
+        WidgetInt ("amidiplug", "fsyn_synth_cpu_cores", backend_change),
+        {1, 64, 1}),
+    WidgetSpin (N_("Render block size:"),
+        WidgetInt ("amidiplug", "fsyn_render_block"),
+        {64, 65536, 64, N_("samples")})
 };
 
 const PluginPreferences amidiplug_prefs = {
@@ -22,7 +22,6 @@
 
 #ifdef USE_GTK
 
-#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <gtk/gtk.h>
@@ -67,46 +66,19 @@ void i_fileinfo_grid_add_entry (const char * field_text, const char * value_text
 }
 
 
-/* COMMENT: this will also reset current position in each track! */
 void i_fileinfo_text_fill (midifile_t * mf, GtkTextBuffer * text_tb, GtkTextBuffer * lyrics_tb)
 {
-    /* initialize current position in each track */
-    for (midifile_track_t & track : mf->tracks)
-        track.current_event = track.events.head ();
-
-    for (;;)
+    /* meta-events may go past max_tick, show them all */
+    for (const midievent_t & event : mf->events)
     {
-        midievent_t * event = nullptr;
-        midifile_track_t * event_track = nullptr;
-        int min_tick = INT_MAX;  /* meta-events may go past max_tick */
-
-        /* search next event */
-        for (midifile_track_t & track : mf->tracks)
-        {
-            midievent_t * e2 = track.current_event;
-
-            if (e2 && e2->tick < min_tick)
-            {
-                min_tick = e2->tick;
-                event = e2;
-                event_track = & track;
-            }
-        }
-
-        if (!event)
-            break; /* end of song reached */
-
-        /* advance pointer to next event */
-        event_track->current_event = event_track->events.next (event);
-
-        switch (event->type)
+        switch (event.type)
         {
         case SND_SEQ_EVENT_META_TEXT:
-            gtk_text_buffer_insert_at_cursor (text_tb, event->metat, -1);
+            gtk_text_buffer_insert_at_cursor (text_tb, event.metat, -1);
             break;
 
         case SND_SEQ_EVENT_META_LYRIC:
-            gtk_text_buffer_insert_at_cursor (lyrics_tb, event->metat, -1);
+            gtk_text_buffer_insert_at_cursor (lyrics_tb, event.metat, -1);
             break;
         }
     }
@@ -23,6 +23,9 @@
 
 #include "i_midi.h"
 
+#include <algorithm>
+#include <string.h>
+
 #include <libaudcore/audstrings.h>
 #include <libaudcore/runtime.h>
 #include <libaudcore/vfs.h>
@@ -484,11 +487,48 @@ bool midifile_t::parse_smf (int port_count)
     if (start_tick < 0)
         start_tick = 0;
 
+    merge_tracks ();
+
     /* ok, success */
     return true;
 }
 
 
+/* merge the events of all tracks into a single array ordered by tick;
+   events sharing the same tick keep the order of their tracks */
+void midifile_t::merge_tracks ()
+{
+    Index<midievent_t *> order;
+
+    for (midifile_track_t & track : tracks)
+    {
+        for (midievent_t * event = track.events.head (); event; event = track.events.next (event))
+            order.append (event);
+    }
+
+    std::stable_sort (order.begin (), order.end (),
+     [] (const midievent_t * a, const midievent_t * b) { return a->tick < b->tick; });
+
+    events.insert (0, order.len ());
+
+    for (int i = 0; i < order.len (); i ++)
+    {
+        midievent_t & event = events[i];
+
+        event.type = order[i]->type;
+        event.port = order[i]->port;
+        event.tick = order[i]->tick;
+        memcpy (event.d, order[i]->d, sizeof event.d);
+        event.tempo = order[i]->tempo;
+        event.metat = std::move (order[i]->metat);
+    }
+
+    /* the per-track lists are not needed anymore */
+    for (midifile_track_t & track : tracks)
+        track.events.clear ();
+}
+
+
 /* read a MIDI file enclosed in RIFF format */
 /* return values: 0 = error, 1 = ok */
 bool midifile_t::parse_riff ()
@@ -582,152 +622,216 @@ bool midifile_t::setget_tempo ()
 }
 
 
-/* this will set the midi length in microseconds
-   COMMENT: this will also reset current position in each track! */
+/* this will build the tempo map and set the midi length in microseconds */
 void midifile_t::setget_length ()
 {
-    int64_t length_microsec = 0;
-    int last_tick = start_tick;
-    /* get the first microsec_per_tick ratio */
-    int microsec_per_tick = (int) (current_tempo / ppq);
+    tempo_map.clear ();
+    tempo_map.append (midifile_tempo_t {start_tick, current_tempo, 0});
 
-    /* initialize current position in each track */
-    for (midifile_track_t & track : tracks)
-        track.current_event = track.events.head ();
-
-    /* search for tempo events in each track; in fact, since the program
-       currently supports type 0 and type 1 MIDI files, we should find
-       tempo events only in one track */
     AUDDBG ("LENGTH calc: starting calc loop\n");
 
-    for (;;)
+    for (const midievent_t & event : events)
     {
-        midievent_t * event = nullptr;
-        midifile_track_t * event_track = nullptr;
-        int min_tick = max_tick + 1;
+        /* events past max_tick are never played */
+        if (event.tick > max_tick)
+            break;
 
-        /* search next event */
-        for (midifile_track_t & track : tracks)
-        {
-            midievent_t * e2 = track.current_event;
+        if (event.type != SND_SEQ_EVENT_TEMPO)
+            continue;
 
-            if (e2 && e2->tick < min_tick)
-            {
-                min_tick = e2->tick;
-                event = e2;
-                event_track = & track;
-            }
-        }
+        int tick = aud::max (event.tick, start_tick);
+        AUDDBG ("LENGTH calc: tempo event (%i) on tick %i\n", event.tempo, tick);
+
+        midifile_tempo_t & last = tempo_map[tempo_map.len () - 1];
 
-        if (!event)
+        if (tick == last.tick)
+            last.tempo = event.tempo;
+        else
         {
-            /* calculate the remaining length */
-            length_microsec += (microsec_per_tick * (max_tick - last_tick));
-            break; /* end of song reached */
+            int64_t microsec = last.microsec + (int64_t) last.tempo * (tick - last.tick) / ppq;
+            tempo_map.append (midifile_tempo_t {tick, event.tempo, microsec});
         }
+    }
 
-        /* advance pointer to next event */
-        event_track->current_event = event_track->events.next (event);
+    length = tick_to_microsec (max_tick);
+}
 
-        /* check if this is a tempo event */
-        if (event->type == SND_SEQ_EVENT_TEMPO)
-        {
-            int tick = aud::max (event->tick, start_tick);
-            AUDDBG ("LENGTH calc: tempo event (%i) on tick %i\n", event->tempo, tick);
-
-            /* increment length_microsec with the amount of microsec before tempo change */
-            length_microsec += (microsec_per_tick * (tick - last_tick));
-            /* now update last_tick and the microsec_per_tick ratio */
-            last_tick = tick;
-            microsec_per_tick = (int) (event->tempo / ppq);
-        }
+
+/* returns the tempo map entry in effect at the given tick */
+const midifile_tempo_t & midifile_t::tempo_entry (int tick) const
+{
+    int low = 0, high = tempo_map.len () - 1;
+
+    /* find the last entry starting at or before tick */
+    while (low < high)
+    {
+        int mid = (low + high + 1) / 2;
+
+        if (tempo_map[mid].tick <= tick)
+            low = mid;
+        else
+            high = mid - 1;
     }
 
-    /* IMPORTANT
-       this couple of important values is set by midifile_t::set_length */
-    length = length_microsec;
+    return tempo_map[low];
+}
 
-    if (max_tick > start_tick)
-        avg_microsec_per_tick = (int) (length_microsec / (max_tick - start_tick));
-    else
-        avg_microsec_per_tick = 0;
 
-    return;
+int midifile_t::tempo_at_tick (int tick) const
+{
+    return tempo_entry (tick).tempo;
 }
 
 
-/* this will get the weighted average bpm of the midi file;
-   if the file has a variable bpm, 'bpm' is set to -1;
-   COMMENT: this will also reset current position in each track! */
-void midifile_t::get_bpm (int * bpm, int * wavg_bpm)
+/* time elapsed from start_tick to the given tick */
+int64_t midifile_t::tick_to_microsec (int tick) const
 {
-    int last_tick = start_tick;
-    unsigned weighted_avg_tempo = 0;
-    bool is_monotempo = true;
-    int last_tempo = current_tempo;
+    const midifile_tempo_t & entry = tempo_entry (tick);
 
-    /* initialize current position in each track */
-    for (midifile_track_t & track : tracks)
-        track.current_event = track.events.head ();
+    if (tick <= entry.tick)
+        return entry.microsec;
 
-    /* search for tempo events in each track; in fact, since the program
-       currently supports type 0 and type 1 MIDI files, we should find
-       tempo events only in one track */
-    AUDDBG ("BPM calc: starting calc loop\n");
+    return entry.microsec + (int64_t) entry.tempo * (tick - entry.tick) / ppq;
+}
 
-    for (;;)
+
+/* tick reached after the given time has elapsed from start_tick */
+int midifile_t::microsec_to_tick (int64_t microsec) const
+{
+    int low = 0, high = tempo_map.len () - 1;
+
+    /* find the last entry starting at or before microsec */
+    while (low < high)
     {
-        midievent_t * event = nullptr;
-        midifile_track_t * event_track = nullptr;
-        int min_tick = max_tick + 1;
+        int mid = (low + high + 1) / 2;
 
-        /* search next event */
-        for (midifile_track_t & track : tracks)
+        if (tempo_map[mid].microsec <= microsec)
+            low = mid;
+        else
+            high = mid - 1;
+    }
+
+    const midifile_tempo_t & entry = tempo_map[low];
+    int64_t tick = entry.tick;
+
+    if (entry.tempo > 0 && microsec > entry.microsec)
+        tick += (microsec - entry.microsec) * ppq / entry.tempo;
+
+    return (int) aud::min (tick, (int64_t) max_tick);
+}
+
+
+/* index of the first event at or after the given tick */
+int midifile_t::find_event (int tick) const
+{
+    int low = 0, high = events.len ();
+
+    while (low < high)
+    {
+        int mid = (low + high) / 2;
+
+        if (events[mid].tick < tick)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low;
+}
+
+
+/* records the state of every channel at regular intervals of the
+   timeline, so that seeking only has to replay the events following
+   the nearest snapshot */
+void midifile_t::build_snapshots ()
+{
+    midifile_snapshot_t state;
+    memset (state.channels, -1, sizeof state.channels);
+
+    snapshots.clear ();
+
+    for (int i = 0; i < events.len (); i ++)
+    {
+        if (i % MIDIFILE_SNAPSHOT_INTERVAL == 0)
         {
-            midievent_t * e2 = track.current_event;
+            state.event_index = i;
+            snapshots.append (state);
+        }
+
+        const midievent_t & event = events[i];
 
-            if (e2 && e2->tick < min_tick)
+        if (event.type < SND_SEQ_EVENT_CONTROLLER || event.type > SND_SEQ_EVENT_PITCHBEND)
+            continue;
+
+        midifile_channel_state_t & channel = state.channels[event.d[0] & 0x0f];
+
+        switch (event.type)
+        {
+        case SND_SEQ_EVENT_CONTROLLER:
+        {
+            int cc = event.d[1];
+
+            if (cc == 121) /* reset all controllers */
             {
-                min_tick = e2->tick;
-                event = e2;
-                event_track = & track;
+                channel.controller[1] = -1;
+                channel.controller[11] = -1;
+                memset (channel.controller + 64, -1, 4);
+                channel.chanpress = -1;
+                channel.pitchbend = -1;
             }
-        }
+            else if (cc < 120) /* ignore channel mode messages */
+            {
+                channel.controller[cc] = event.d[2];
 
-        if (!event)
-        {
-            /* calculate the remaining length */
-            if (max_tick > start_tick)
-                weighted_avg_tempo += (unsigned) (last_tempo *
-                 ((float) (max_tick - last_tick) / (float) (max_tick - start_tick)));
+                /* data entry for RPN 0 sets the pitch bend sensitivity */
+                if ((cc == 6 || cc == 38) && channel.controller[101] == 0 &&
+                 channel.controller[100] == 0)
+                    channel.bend_range[cc == 38] = event.d[2];
+            }
 
-            break; /* end of song reached */
+            break;
         }
 
-        /* advance pointer to next event */
-        event_track->current_event = event_track->events.next (event);
+        case SND_SEQ_EVENT_PGMCHANGE:
+            channel.program = event.d[1];
+            break;
 
-        /* check if this is a tempo event */
-        if (event->type == SND_SEQ_EVENT_TEMPO)
-        {
-            int tick = aud::max (event->tick, start_tick);
-            AUDDBG ("BPM calc: tempo event (%i) on tick %i\n", event->tempo, tick);
-
-            /* check if this is a tempo change (real change, tempo should be
-               different) in the midi file (and it shouldn't be at tick 0); */
-            if (is_monotempo && tick > start_tick && event->tempo != last_tempo)
-                is_monotempo = false;
-
-            /* add the previous tempo change multiplied for its weight (the tick interval for the tempo )  */
-            if (max_tick > start_tick)
-                weighted_avg_tempo += (unsigned) (last_tempo *
-                 ((float) (tick - last_tick) / (float) (max_tick - start_tick)));
-
-            /* now update last_tick and the microsec_per_tick ratio */
-            last_tick = tick;
-            last_tempo = event->tempo;
+        case SND_SEQ_EVENT_CHANPRESS:
+            channel.chanpress = event.d[1];
+            break;
+
+        case SND_SEQ_EVENT_PITCHBEND:
+            channel.pitchbend = ((event.d[2] & 0x7f) << 7) | (event.d[1] & 0x7f);
+            break;
         }
     }
+}
+
+
+/* this will get the weighted average bpm of the midi file;
+   if the file has a variable bpm, 'bpm' is set to -1 */
+void midifile_t::get_bpm (int * bpm, int * wavg_bpm)
+{
+    unsigned weighted_avg_tempo = 0;
+    bool is_monotempo = true;
+
+    AUDDBG ("BPM calc: starting calc loop\n");
+
+    for (int i = 0; i < tempo_map.len (); i ++)
+    {
+        const midifile_tempo_t & entry = tempo_map[i];
+        int end_tick = (i + 1 < tempo_map.len ()) ? tempo_map[i + 1].tick : max_tick;
+
+        /* check if this is a tempo change (real change, tempo should be
+           different) in the midi file (the first entry is at start_tick) */
+        if (i > 0 && entry.tempo != tempo_map[i - 1].tempo)
+            is_monotempo = false;
+
+        /* add the tempo multiplied for its weight (the tick interval for the tempo) */
+        if (max_tick > start_tick)
+            weighted_avg_tempo += (unsigned) (entry.tempo *
+             ((float) (end_tick - entry.tick) / (float) (max_tick - start_tick)));
+    }
 
     AUDDBG ("BPM calc: weighted average tempo: %i\n", weighted_avg_tempo);
 
@@ -227,12 +227,15 @@ enum snd_seq_event_type
 };
 
 
+/* number of events between two channel state snapshots */
+#define MIDIFILE_SNAPSHOT_INTERVAL 4096
+
+
 struct midifile_track_t
 {
-    List<midievent_t> events;           /* list of all events in this track */
+    List<midievent_t> events;           /* events of this track, only used while loading */
     int start_tick;                     /* start of this track */
     int end_tick;			/* length of this track */
-    midievent_t * current_event;	/* used while loading and playing */
 
     midievent_t * add_event ()
     {
@@ -246,9 +249,40 @@ struct midifile_track_t
 };
 
 
+/* a tempo change, along with the time elapsed from start_tick up to it */
+struct midifile_tempo_t
+{
+    int tick;
+    int tempo;                          /* microseconds per quarter note */
+    int64_t microsec;
+};
+
+
+/* controller and program state of a single MIDI channel; -1 means "never set" */
+struct midifile_channel_state_t
+{
+    signed char controller[128];
+    signed char program;
+    signed char chanpress;
+    signed char bend_range[2];          /* RPN 0 (pitch bend sensitivity), MSB and LSB */
+    short pitchbend;
+};
+
+
+/* channel state right before a given event of the timeline */
+struct midifile_snapshot_t
+{
+    int event_index;
+    midifile_channel_state_t channels[16];
+};
+
+
 struct midifile_t
 {
     Index<midifile_track_t> tracks;
+    Index<midievent_t> events;          /* events of all tracks, ordered by tick */
+    Index<midifile_tempo_t> tempo_map;
+    Index<midifile_snapshot_t> snapshots;
 
     unsigned short format = 0;
     int start_tick = 0;
@@ -259,12 +293,18 @@ struct midifile_t
     int ppq = 0;
     int current_tempo = 0;
 
-    int avg_microsec_per_tick = 0;
     int64_t length = 0;
 
     void get_bpm (int *, int *);
     bool parse_from_file (const char *, VFSFile & file);
 
+    int64_t tick_to_microsec (int tick) const;
+    int microsec_to_tick (int64_t microsec) const;
+    int tempo_at_tick (int tick) const;
+    int find_event (int tick) const;
+
+    void build_snapshots ();
+
 private:
     String file_name;
     Index<char> file_data;
@@ -280,8 +320,10 @@ private:
     bool read_track (midifile_track_t &, int, int);
     bool parse_smf (int);
     bool parse_riff ();
+    void merge_tracks ();
     bool setget_tempo ();
     void setget_length ();
+    const midifile_tempo_t & tempo_entry (int tick) const;
 };
 
 #endif /* !_I_MIDI_H */
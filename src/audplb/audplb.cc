@@ -0,0 +1,408 @@
+/*
+ * Audacious binary playlist format plugin
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Based on the audpl plugin (audpl.cc), Copyright 2011-2016 John Lindgren
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/*
+ * File layout (all numbers are little-endian 32-bit words):
+ *
+ *   header     magic "APLB", version, number of strings, number of
+ *              columns, number of entries, title (string index)
+ *   columns    per column: field name (string index), value type
+ *   strings    per string: offset into the string data; then the size
+ *              of the string data (in words)
+ *   string data, NUL-terminated UTF-8, padded to a multiple of 4 bytes
+ *   entries    per entry: uri (string index), state, presence mask
+ *              (one bit per column), one value per column
+ *
+ * Each distinct string (artist, album, genre, ...) is stored only once.
+ * Entries have a fixed size, so any entry can be located directly from
+ * its index.  Fields are stored by name, so the format does not depend
+ * on the numbering of Tuple fields.
+ *
+ * This is an import/export format only: the playlists kept between
+ * sessions are loaded and saved by libaudacious itself, as audpl.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/i18n.h>
+#include <libaudcore/multihash.h>
+#include <libaudcore/plugin.h>
+#include <libaudcore/runtime.h>
+
+#define APLB_MAGIC "APLB"
+#define APLB_VERSION 1
+#define APLB_HEADER_WORDS 6
+#define APLB_NONE 0xffffffff
+
+enum {
+    APLB_STATE_INITIAL,
+    APLB_STATE_VALID,
+    APLB_STATE_FAILED
+};
+
+static const char * const audplb_exts[] = {"audplb"};
+
+class AudPlaylistBinLoader : public PlaylistPlugin
+{
+public:
+    static constexpr PluginInfo info = {N_("Audacious Playlists (binary)"), PACKAGE};
+
+    constexpr AudPlaylistBinLoader () : PlaylistPlugin (info, audplb_exts, true) {}
+
+    bool load (const char * filename, VFSFile & file, String & title,
+     Index<PlaylistAddItem> & items);
+    bool save (const char * filename, VFSFile & file, const char * title,
+     const Index<PlaylistAddItem> & items);
+};
+
+EXPORT AudPlaylistBinLoader aud_plugin_instance;
+
+static uint32_t get_word (const char * data, int64_t word)
+{
+    auto p = (const unsigned char *) data + 4 * word;
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void put_word (Index<char> & buf, uint32_t value)
+{
+    char bytes[4] = {(char) value, (char) (value >> 8), (char) (value >> 16),
+     (char) (value >> 24)};
+    buf.insert (bytes, -1, 4);
+}
+
+class BinPlaylistReader
+{
+public:
+    BinPlaylistReader (const Index<char> & data) :
+        m_data (data.begin ()),
+        m_words (data.len () / 4) {}
+
+    bool read (String & title, Index<PlaylistAddItem> & items);
+
+private:
+    struct Column {
+        Tuple::Field field;
+        Tuple::ValueType type;
+    };
+
+    const char * m_data;
+    int64_t m_words;
+
+    uint32_t m_n_strings = 0;
+    int64_t m_offsets = 0;          // word index of the string offsets
+    int64_t m_text = 0;             // byte index of the string data
+    int64_t m_text_size = 0;
+    Index<String> m_strings;        // decoded on first use
+
+    const String * get_string (uint32_t index);
+};
+
+/* Strings are only turned into String objects when first used; later
+ * uses (the same artist on the next track, for example) share it. */
+const String * BinPlaylistReader::get_string (uint32_t index)
+{
+    if (index >= m_n_strings)
+        return nullptr;
+
+    if (! m_strings[index])
+    {
+        uint32_t offset = get_word (m_data, m_offsets + index);
+        if (offset >= m_text_size)
+            return nullptr;
+
+        const char * str = m_data + m_text + offset;
+        if (! memchr (str, 0, m_text_size - offset))
+            return nullptr;
+
+        m_strings[index] = String (str);
+    }
+
+    return & m_strings[index];
+}
+
+bool BinPlaylistReader::read (String & title, Index<PlaylistAddItem> & items)
+{
+    if (m_words < APLB_HEADER_WORDS || memcmp (m_data, APLB_MAGIC, 4))
+        return false;
+
+    uint32_t version = get_word (m_data, 1);
+    if (version != APLB_VERSION)
+    {
+        AUDERR ("Unsupported binary playlist version %u\n", (unsigned) version);
+        return false;
+    }
+
+    m_n_strings = get_word (m_data, 2);
+    uint32_t n_columns = get_word (m_data, 3);
+    uint32_t n_entries = get_word (m_data, 4);
+    uint32_t title_index = get_word (m_data, 5);
+
+    int64_t columns = APLB_HEADER_WORDS;
+    m_offsets = columns + 2 * (int64_t) n_columns;
+
+    int64_t text_words = m_offsets + m_n_strings;
+    if (n_columns > 256 || text_words >= m_words)
+        return false;
+
+    /* the size of the string data is stored just before it */
+    m_text_size = 4 * (int64_t) get_word (m_data, text_words);
+    m_text = 4 * (text_words + 1);
+
+    int mask_words = (n_columns + 31) / 32;
+    int64_t stride = 2 + mask_words + n_columns;
+    int64_t entries = text_words + 1 + m_text_size / 4;
+
+    if (entries + stride * n_entries > m_words)
+        return false;
+
+    m_strings.insert (0, m_n_strings);
+
+    Index<Column> cols;
+    for (uint32_t c = 0; c < n_columns; c ++)
+    {
+        const String * name = get_string (get_word (m_data, columns + 2 * c));
+        auto field = name ? Tuple::field_by_name (* name) : Tuple::Invalid;
+        auto type = (Tuple::ValueType) get_word (m_data, columns + 2 * c + 1);
+
+        /* fields unknown to (or changed in) this version are skipped */
+        if (field != Tuple::Invalid && Tuple::field_get_type (field) != type)
+            field = Tuple::Invalid;
+
+        cols.append (Column {field, type});
+    }
+
+    if (title_index != APLB_NONE && ! title)
+    {
+        const String * str = get_string (title_index);
+        if (str)
+            title = * str;
+    }
+
+    int first = items.len ();
+    items.insert (-1, n_entries);
+
+    for (uint32_t e = 0; e < n_entries; e ++)
+    {
+        int64_t pos = entries + stride * e;
+        int64_t values = pos + 2 + mask_words;
+
+        const String * uri = get_string (get_word (m_data, pos));
+        if (! uri)
+        {
+            items.remove (first, -1);
+            return false;
+        }
+
+        PlaylistAddItem & item = items[first + e];
+        item.filename = * uri;
+
+        switch (get_word (m_data, pos + 1))
+        {
+        case APLB_STATE_VALID:
+            for (uint32_t c = 0; c < n_columns; c ++)
+            {
+                if (! (get_word (m_data, pos + 2 + c / 32) & (1u << (c % 32))) ||
+                 cols[c].field == Tuple::Invalid)
+                    continue;
+
+                uint32_t value = get_word (m_data, values + c);
+
+                if (cols[c].type == Tuple::String)
+                {
+                    const String * str = get_string (value);
+                    if (str)
+                        item.tuple.set_str (cols[c].field, * str);
+                }
+                else
+                    item.tuple.set_int (cols[c].field, (int32_t) value);
+            }
+
+            item.tuple.set_state (Tuple::Valid);
+            item.tuple.set_filename (* uri);
+            break;
+
+        case APLB_STATE_FAILED:
+            item.tuple.set_state (Tuple::Failed);
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool AudPlaylistBinLoader::load (const char * path, VFSFile & file, String & title,
+ Index<PlaylistAddItem> & items)
+{
+    Index<char> data = file.read_all ();
+
+    if (! BinPlaylistReader (data).read (title, items))
+    {
+        AUDERR ("Invalid binary playlist: %s\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+class BinPlaylistWriter
+{
+public:
+    uint32_t add_string (const char * str);
+    uint32_t n_strings () const
+        { return m_offsets.len () / 4; }
+
+    bool write_strings (VFSFile & file);
+
+private:
+    SimpleHash<String, uint32_t> m_table;
+    Index<char> m_text;
+    Index<char> m_offsets;
+};
+
+uint32_t BinPlaylistWriter::add_string (const char * str)
+{
+    String key (str);
+    uint32_t * index = m_table.lookup (key);
+    if (index)
+        return * index;
+
+    uint32_t added = n_strings ();
+    put_word (m_offsets, m_text.len ());
+    m_text.insert (str, -1, strlen (str) + 1);
+    m_table.add (key, std::move (added));
+
+    return added;
+}
+
+bool BinPlaylistWriter::write_strings (VFSFile & file)
+{
+    while (m_text.len () % 4)
+        m_text.append (0);
+
+    put_word (m_offsets, m_text.len () / 4);
+
+    return file.fwrite (m_offsets.begin (), 1, m_offsets.len ()) == m_offsets.len () &&
+     file.fwrite (m_text.begin (), 1, m_text.len ()) == m_text.len ();
+}
+
+static bool is_saved_field (Tuple::Field field)
+{
+    /* derived from the filename or from other fields */
+    return field != Tuple::Path && field != Tuple::Basename &&
+     field != Tuple::Suffix && field != Tuple::FormattedTitle;
+}
+
+bool AudPlaylistBinLoader::save (const char * path, VFSFile & file,
+ const char * title, const Index<PlaylistAddItem> & items)
+{
+    BinPlaylistWriter writer;
+
+    /* only fields which occur in the playlist get a column */
+    Index<Tuple::Field> fields;
+    for (auto f : Tuple::all_fields ())
+    {
+        if (! is_saved_field (f))
+            continue;
+
+        for (auto & item : items)
+        {
+            if (item.tuple.state () == Tuple::Valid &&
+             item.tuple.get_value_type (f) != Tuple::Empty)
+            {
+                fields.append (f);
+                break;
+            }
+        }
+    }
+
+    int n_columns = fields.len ();
+    int mask_words = (n_columns + 31) / 32;
+
+    Index<char> columns;
+    for (auto f : fields)
+    {
+        put_word (columns, writer.add_string (Tuple::field_get_name (f)));
+        put_word (columns, Tuple::field_get_type (f));
+    }
+
+    uint32_t title_index = title ? writer.add_string (title) : APLB_NONE;
+
+    Index<char> entries;
+    Index<uint32_t> record;
+    record.insert (0, 2 + mask_words + n_columns);
+
+    for (auto & item : items)
+    {
+        for (uint32_t & word : record)
+            word = 0;
+
+        record[0] = writer.add_string (item.filename);
+
+        switch (item.tuple.state ())
+        {
+        case Tuple::Initial:
+            record[1] = APLB_STATE_INITIAL;
+            break;
+
+        case Tuple::Valid:
+            record[1] = APLB_STATE_VALID;
+
+            for (int c = 0; c < n_columns; c ++)
+            {
+                auto type = item.tuple.get_value_type (fields[c]);
+
+                if (type == Tuple::String)
+                    record[2 + mask_words + c] = writer.add_string (item.tuple.get_str (fields[c]));
+                else if (type == Tuple::Int)
+                    record[2 + mask_words + c] = (uint32_t) item.tuple.get_int (fields[c]);
+                else
+                    continue;
+
+                record[2 + c / 32] |= 1u << (c % 32);
+            }
+
+            break;
+
+        case Tuple::Failed:
+            record[1] = APLB_STATE_FAILED;
+            break;
+        }
+
+        for (uint32_t word : record)
+            put_word (entries, word);
+    }
+
+    /* the number of strings is known only now */
+    Index<char> header;
+    header.insert (APLB_MAGIC, 0, 4);
+    put_word (header, APLB_VERSION);
+    put_word (header, writer.n_strings ());
+    put_word (header, n_columns);
+    put_word (header, items.len ());
+    put_word (header, title_index);
+
+    return file.fwrite (header.begin (), 1, header.len ()) == header.len () &&
+     file.fwrite (columns.begin (), 1, columns.len ()) == columns.len () &&
+     writer.write_strings (file) &&
+     file.fwrite (entries.begin (), 1, entries.len ()) == entries.len ();
+}
@@ -28,6 +28,8 @@
 #include <libaudgui/gtk-compat.h>
 #include <libaudgui/libaudgui-gtk.h>
 
+#include "../vis-common/spectrum.h"
+
 #define MAX_BANDS   (256)
 #define VIS_DELAY 2 /* delay before falloff in frames */
 #define VIS_FALLOFF 2 /* falloff in pixels per frame */
@@ -54,33 +56,23 @@ public:
 EXPORT CairoSpectrum aud_plugin_instance;
 
 static GtkWidget * spect_widget = nullptr;
-static float xscale[MAX_BANDS + 1];
+static LogBands log_bands;
 static int width, height, bands;
-static int bars[MAX_BANDS + 1];
-static int delay[MAX_BANDS + 1];
+static FalloffBars bars (VIS_FALLOFF, VIS_DELAY);
 
 void CairoSpectrum::render_freq (const float * freq)
 {
     if (! bands)
         return;
 
-    for (int i = 0; i < bands; i ++)
-    {
-        /* 40 dB range */
-        int x = 40 + compute_freq_band (freq, xscale, i, bands);
-        x = aud::clamp (x, 0, 40);
-
-        bars[i] -= aud::max (0, VIS_FALLOFF - delay[i]);
+    float levels[MAX_BANDS];
+    log_bands.compute (freq, levels);
 
-        if (delay[i])
-            delay[i] --;
+    /* 40 dB range */
+    for (int i = 0; i < bands; i ++)
+        levels[i] = aud::clamp ((int) (40 + levels[i]), 0, 40);
 
-        if (x > bars[i])
-        {
-            bars[i] = x;
-            delay[i] = VIS_DELAY;
-        }
-    }
+    bars.update (levels);
 
     if (spect_widget)
         gtk_widget_queue_draw (spect_widget);
@@ -88,8 +80,7 @@ void CairoSpectrum::render_freq (const float * freq)
 
 void CairoSpectrum::clear ()
 {
-    memset (bars, 0, sizeof bars);
-    memset (delay, 0, sizeof delay);
+    bars.clear ();
 
     if (spect_widget)
         gtk_widget_queue_draw (spect_widget);
@@ -117,8 +108,8 @@ G_GNUC_END_IGNORE_DEPRECATIONS
 
         audgui_vis_bar_color (c, i, bands, r, g, b);
         cairo_set_source_rgb (cr, r, g, b);
-        cairo_rectangle (cr, x + 1, height - (bars[i] * height / 40),
-         (width / bands) - 1, (bars[i] * height / 40));
+        cairo_rectangle (cr, x + 1, height - ((int) bars[i] * height / 40),
+         (width / bands) - 1, ((int) bars[i] * height / 40));
         cairo_fill (cr);
     }
 }
@@ -131,7 +122,8 @@ static gboolean configure_event (GtkWidget * widget, GdkEventConfigure * event)
 
     bands = width / 10;
     bands = aud::clamp (bands, 12, MAX_BANDS);
-    Visualizer::compute_log_xscale (xscale, bands);
+    log_bands.set_bands (bands);
+    bars.resize (bands);
 
     return true;
 }
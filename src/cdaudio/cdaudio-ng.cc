@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 /* prevent libcdio from redefining PACKAGE, VERSION, etc. */
 #define EXTERNAL_LIBCDIO_CONFIG_H
@@ -36,8 +37,10 @@
 
 #if LIBCDIO_VERSION_NUM >= 90
 #include <cdio/paranoia/cdda.h>
+#include <cdio/paranoia/paranoia.h>
 #else
 #include <cdio/cdda.h>
+#include <cdio/paranoia.h>
 #endif
 
 #ifdef HAVE_LIBCDDB
@@ -60,6 +63,11 @@
 #define MAX_RETRIES 10
 #define MAX_SKIPS 10
 
+#define SECTOR_SIZE CDIO_CD_FRAMESIZE_RAW
+#define READ_AHEAD_SECONDS 10
+
+#define CDDB_CACHE_DIR "cddb"
+
 static const char * const cdaudio_schemes[] = {"cdda", nullptr};
 
 class CDAudio : public InputPlugin
@@ -108,6 +116,7 @@ static int firsttrackno = -1;
 static int lasttrackno = -1;
 static int n_audio_tracks;
 static cdrom_drive_t *pcdrom_drive = nullptr;
+static bool disc_is_image;
 static Index<trackinfo_t> trackinfo;
 static QueuedFunc purge_func;
 
@@ -127,6 +136,7 @@ const char CDAudio::about[] =
 const char * const CDAudio::defaults[] = {
  "disc_speed", "2",
  "use_cdtext", "TRUE",
+ "use_paranoia", "FALSE",
 #ifdef HAVE_LIBCDDB
  "use_cddb", "TRUE",
  "cddbhttp", "FALSE",
@@ -141,8 +151,10 @@ const PreferencesWidget CDAudio::widgets[] = {
     WidgetSpin (N_("Read speed:"),
         WidgetInt ("CDDA", "disc_speed"),
         {MIN_DISC_SPEED, MAX_DISC_SPEED, 1}),
-    WidgetEntry (N_("Override device:"),
+    WidgetEntry (N_("Override device or disc image:"),
         WidgetString ("CDDA", "device")),
+    WidgetCheck (N_("Verify reads (slower, but repairs scratches)"),
+        WidgetBool ("CDDA", "use_paranoia")),
     WidgetLabel (N_("<b>Metadata</b>")),
     WidgetCheck (N_("Use CD-Text"),
         WidgetBool ("CDDA", "use_cdtext")),
@@ -242,6 +254,169 @@ bool CDAudio::is_our_file (const char * filename, VFSFile & file)
     return !strncmp (filename, "cdda://", 7);
 }
 
+/* Audio is read ahead of playback by a separate thread into a ring of
+ * sectors, so that retries and spin-ups of the drive do not interrupt the
+ * output.  The play thread is the only consumer; it also handles seeking,
+ * after which data that was being read for the old position is discarded. */
+struct ReadAhead
+{
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+
+    Index<unsigned char> ring;
+    int ring_sectors = 0;
+    int head = 0, filled = 0;   /* in sectors */
+
+    int endlsn = 0;
+    int nextlsn = 0;            /* next sector to be read */
+    int generation = 0;         /* incremented when seeking */
+    int chunk_sectors = 0;
+    bool use_paranoia = false;
+
+    bool stop = false;
+    bool finished = false;      /* end of track reached or read failed */
+    bool failed = false;
+};
+
+/* returns the number of sectors read (sectors are read one by one, so a
+ * failure may leave some of them valid) */
+static int read_paranoia (cdrom_paranoia_t * paranoia, int & position,
+ unsigned char * dest, int lsn, int sectors)
+{
+    if (position != lsn)
+    {
+        paranoia_seek (paranoia, lsn, SEEK_SET);
+        position = lsn;
+    }
+
+    for (int i = 0; i < sectors; i ++)
+    {
+        int16_t * data = paranoia_read_limited (paranoia, nullptr, MAX_RETRIES);
+
+        if (! data)
+        {
+            position = -1;  /* force a seek next time */
+            return i;
+        }
+
+        memcpy (dest + SECTOR_SIZE * i, data, SECTOR_SIZE);
+        position ++;
+    }
+
+    return sectors;
+}
+
+/* reader thread; the drive handle stays open as long as playing is set */
+static void * read_ahead_thread (void * data)
+{
+    ReadAhead & ra = * (ReadAhead *) data;
+
+    cdrom_paranoia_t * paranoia = nullptr;
+    int paranoia_position = -1;
+
+    if (ra.use_paranoia)
+    {
+        paranoia = paranoia_init (pcdrom_drive);
+        paranoia_modeset (paranoia, PARANOIA_MODE_FULL ^ PARANOIA_MODE_NEVERSKIP);
+    }
+
+    int sectors = ra.chunk_sectors;
+    int retry_count = 0, skip_count = 0;
+    int generation = ra.generation;
+
+    pthread_mutex_lock (& ra.mutex);
+
+    while (! ra.stop)
+    {
+        if (ra.generation != generation)
+        {
+            generation = ra.generation;
+            sectors = ra.chunk_sectors;
+            retry_count = 0;
+            skip_count = 0;
+        }
+
+        int tail = (ra.head + ra.filled) % ra.ring_sectors;
+        int count = aud::min (sectors, ra.ring_sectors - ra.filled);
+        count = aud::min (count, ra.ring_sectors - tail);
+        count = aud::min (count, ra.endlsn + 1 - ra.nextlsn);
+
+        if (ra.nextlsn > ra.endlsn)
+            ra.finished = true;
+
+        if (ra.finished || count < 1)
+        {
+            pthread_cond_broadcast (& ra.cond);
+            pthread_cond_wait (& ra.cond, & ra.mutex);
+            continue;
+        }
+
+        int lsn = ra.nextlsn;
+        unsigned char * dest = & ra.ring[SECTOR_SIZE * tail];
+
+        /* the consumer never touches the unfilled part of the ring */
+        pthread_mutex_unlock (& ra.mutex);
+
+        int done;
+        if (paranoia)
+            done = read_paranoia (paranoia, paranoia_position, dest, lsn, count);
+        else if (cdio_read_audio_sectors (pcdrom_drive->p_cdio, dest, lsn,
+         count) == DRIVER_OP_SUCCESS)
+            done = count;
+        else
+            done = 0;
+
+        pthread_mutex_lock (& ra.mutex);
+
+        /* seeked in the meantime; the data is not wanted any more */
+        if (ra.generation != generation)
+            continue;
+
+        if (done > 0)
+        {
+            ra.filled += done;
+            ra.nextlsn += done;
+            pthread_cond_broadcast (& ra.cond);
+        }
+
+        if (done == count)
+        {
+            retry_count = 0;
+            skip_count = 0;
+        }
+        else if (sectors > 16)
+        {
+            /* maybe a smaller read size will help */
+            sectors /= 2;
+        }
+        else if (retry_count < MAX_RETRIES)
+        {
+            /* still failed; retry a few times */
+            retry_count ++;
+        }
+        else if (skip_count < MAX_SKIPS)
+        {
+            /* maybe the disk is scratched; try skipping ahead */
+            ra.nextlsn = aud::min (ra.nextlsn + 75, ra.endlsn + 1);
+            paranoia_position = -1;
+            skip_count ++;
+        }
+        else
+        {
+            /* still failed; give it up */
+            ra.finished = true;
+            ra.failed = true;
+        }
+    }
+
+    pthread_mutex_unlock (& ra.mutex);
+
+    if (paranoia)
+        paranoia_free (paranoia);
+
+    return nullptr;
+}
+
 /* play thread only */
 bool CDAudio::play (const char * name, VFSFile & file)
 {
@@ -271,79 +446,97 @@ bool CDAudio::play (const char * name, VFSFile & file)
         return false;
     }
 
+    ReadAhead ra;
+    ra.use_paranoia = aud_get_bool ("CDDA", "use_paranoia");
+
     set_stream_bitrate (1411200);
-    open_audio (FMT_S16_LE, 44100, 2);
+    /* paranoia converts to host byte order */
+    open_audio (ra.use_paranoia ? FMT_S16_NE : FMT_S16_LE, 44100, 2);
 
     int startlsn = trackinfo[trackno].startlsn;
-    int endlsn = trackinfo[trackno].endlsn;
-
-    playing = true;
+    ra.endlsn = trackinfo[trackno].endlsn;
+    ra.nextlsn = startlsn;
 
     int buffer_size = aud_get_int ("output_buffer_size");
     int speed = aud_get_int ("CDDA", "disc_speed");
     speed = aud::clamp (speed, MIN_DISC_SPEED, MAX_DISC_SPEED);
-    int sectors = aud::clamp (buffer_size / 2, 50, 250) * speed * 75 / 1000;
-    int currlsn = startlsn;
-    int retry_count = 0, skip_count = 0;
+    ra.chunk_sectors = aud::clamp (buffer_size / 2, 50, 250) * speed * 75 / 1000;
+
+    ra.ring_sectors = aud::max (READ_AHEAD_SECONDS * 75, 2 * ra.chunk_sectors);
+    ra.ring.insert (0, SECTOR_SIZE * ra.ring_sectors);
+
+    playing = true;
+
+    /* other threads must be careful not to close the drive handle */
+    pthread_mutex_unlock (& mutex);
 
-    Index<unsigned char> buffer;
-    buffer.insert (0, 2352 * sectors);
+    pthread_t reader;
+    pthread_create (& reader, nullptr, read_ahead_thread, & ra);
+
+    pthread_mutex_lock (& ra.mutex);
 
     while (! check_stop ())
     {
         int seek_time = check_seek ();
         if (seek_time >= 0)
-            currlsn = startlsn + (seek_time * 75 / 1000);
-
-        sectors = aud::min (sectors, endlsn + 1 - currlsn);
-        if (sectors < 1)
-            break;
+        {
+            ra.nextlsn = aud::min (startlsn + (seek_time * 75 / 1000), ra.endlsn + 1);
+            ra.head = 0;
+            ra.filled = 0;
+            ra.generation ++;
+            ra.finished = false;
+            ra.failed = false;
+            pthread_cond_broadcast (& ra.cond);
+        }
 
-        /* unlock mutex here to avoid blocking
-         * other threads must be careful not to close drive handle */
-        pthread_mutex_unlock (& mutex);
+        if (! ra.filled)
+        {
+            if (ra.finished)
+                break;
+
+            /* wake up regularly to check for stop and seek */
+            timespec until;
+            clock_gettime (CLOCK_REALTIME, & until);
+            until.tv_nsec += 50000000;
+            if (until.tv_nsec >= 1000000000)
+            {
+                until.tv_sec ++;
+                until.tv_nsec -= 1000000000;
+            }
 
-        int ret = cdio_read_audio_sectors (pcdrom_drive->p_cdio,
-         buffer.begin (), currlsn, sectors);
+            pthread_cond_timedwait (& ra.cond, & ra.mutex, & until);
+            continue;
+        }
 
-        if (ret == DRIVER_OP_SUCCESS)
-            write_audio (buffer.begin (), 2352 * sectors);
+        int count = aud::min (ra.filled, ra.ring_sectors - ra.head);
+        count = aud::min (count, ra.chunk_sectors);
+        const unsigned char * src = & ra.ring[SECTOR_SIZE * ra.head];
 
-        pthread_mutex_lock (& mutex);
+        /* the reader never touches the filled part of the ring */
+        pthread_mutex_unlock (& ra.mutex);
+        write_audio (src, SECTOR_SIZE * count);
+        pthread_mutex_lock (& ra.mutex);
 
-        if (ret == DRIVER_OP_SUCCESS)
-        {
-            currlsn += sectors;
-            retry_count = 0;
-            skip_count = 0;
-        }
-        else if (sectors > 16)
-        {
-            /* maybe a smaller read size will help */
-            sectors /= 2;
-        }
-        else if (retry_count < MAX_RETRIES)
-        {
-            /* still failed; retry a few times */
-            retry_count ++;
-        }
-        else if (skip_count < MAX_SKIPS)
-        {
-            /* maybe the disk is scratched; try skipping ahead */
-            currlsn = aud::min (currlsn + 75, endlsn + 1);
-            skip_count ++;
-        }
-        else
-        {
-            /* still failed; give it up */
-            cdaudio_error (_("Error reading audio CD."));
-            break;
-        }
+        ra.head = (ra.head + count) % ra.ring_sectors;
+        ra.filled -= count;
+        pthread_cond_broadcast (& ra.cond);
     }
 
-    playing = false;
+    /* report a read error only once everything before it has been played */
+    bool failed = ra.failed && ! ra.filled;
+    ra.stop = true;
+    pthread_cond_broadcast (& ra.cond);
+    pthread_mutex_unlock (& ra.mutex);
+
+    pthread_join (reader, nullptr);
 
+    if (failed)
+        cdaudio_error (_("Error reading audio CD."));
+
+    pthread_mutex_lock (& mutex);
+    playing = false;
     pthread_mutex_unlock (& mutex);
+
     return true;
 }
 
@@ -431,6 +624,19 @@ bool CDAudio::read_tag (const char * filename, VFSFile & file, Tuple & tuple,
     return valid;
 }
 
+/* thread safe (mutex may be locked) */
+static driver_id_t image_driver (const char * path)
+{
+    if (str_has_suffix_nocase (path, ".cue") || str_has_suffix_nocase (path, ".bin"))
+        return DRIVER_BINCUE;
+    if (str_has_suffix_nocase (path, ".nrg"))
+        return DRIVER_NRG;
+    if (str_has_suffix_nocase (path, ".toc"))
+        return DRIVER_CDRDAO;
+
+    return DRIVER_UNKNOWN;
+}
+
 /* mutex must be locked */
 static bool open_cd ()
 {
@@ -439,8 +645,25 @@ static bool open_cd ()
 
     AUDDBG ("Opening CD drive.\n");
     String device = aud_get_str ("CDDA", "device");
+    driver_id_t driver;
 
-    if (device[0])
+    disc_is_image = false;
+
+    if (device[0] && (driver = image_driver (device)) != DRIVER_UNKNOWN)
+    {
+        CdIo_t * cdio = cdio_open (device, driver);
+
+        if (cdio && (pcdrom_drive = cdda_identify_cdio (cdio, 1, nullptr)))
+            disc_is_image = true;
+        else
+        {
+            if (cdio)
+                cdio_destroy (cdio);
+
+            cdaudio_error (_("Failed to open disc image %s."), (const char *) device);
+        }
+    }
+    else if (device[0])
     {
         if (! (pcdrom_drive = cdda_identify (device, 1, nullptr)))
             cdaudio_error (_("Failed to open CD device %s."), (const char *) device);
@@ -497,8 +720,8 @@ static bool scan_cd ()
 
     /* general track initialization */
 
-    /* skip endianness detection (because it only affects cdda_read, and we use
-     * cdio_read_audio_sectors instead) */
+    /* skip endianness detection (audio CDs are little-endian, and the setting
+     * only affects cdda_read, which is used by paranoia) */
     pcdrom_drive->bigendianp = 0;
 
     /* finish initialization of drive/disc (performs disc TOC sanitization) */
@@ -510,7 +733,7 @@ static bool scan_cd ()
 
     int speed = aud_get_int ("CDDA", "disc_speed");
     speed = aud::clamp (speed, MIN_DISC_SPEED, MAX_DISC_SPEED);
-    if (cdda_speed_set (pcdrom_drive, speed) != DRIVER_OP_SUCCESS)
+    if (! disc_is_image && cdda_speed_set (pcdrom_drive, speed) != DRIVER_OP_SUCCESS)
         AUDERR ("Cannot set drive speed.\n");
 
     firsttrackno = cdio_get_first_track_num (pcdrom_drive->p_cdio);
@@ -626,8 +849,10 @@ static bool scan_cd ()
             {
                 AUDDBG ("getting CDDB info\n");
 
+                /* cddb_query() and cddb_read() look in the cache first */
                 cddb_cache_enable (pcddb_conn);
-                // cddb_cache_set_dir(pcddb_conn, "~/.cddbslave");
+                cddb_cache_set_dir (pcddb_conn, filename_build
+                 ({aud_get_path (AudPath::UserDir), CDDB_CACHE_DIR}));
 
                 String server = aud_get_str ("CDDA", "cddbserver");
                 String path = aud_get_str ("CDDA", "cddbpath");
@@ -760,7 +985,9 @@ static bool refresh_trackinfo (bool warning)
     if (! open_cd () || ! check_disc_mode (warning))
         goto fail;
 
-    if (! trackinfo.len () || cdio_get_media_changed (pcdrom_drive->p_cdio))
+    /* images cannot change (and do not support the check) */
+    if (! trackinfo.len () || (! disc_is_image &&
+     cdio_get_media_changed (pcdrom_drive->p_cdio)))
     {
         if (! scan_cd ())
             goto fail;
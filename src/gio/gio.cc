@@ -22,14 +22,23 @@
 #include <string.h>
 #include <sys/stat.h>
 
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 #include <gio/gio.h>
 
 #include <libaudcore/audstrings.h>
 #include <libaudcore/i18n.h>
 #include <libaudcore/interface.h>
 #include <libaudcore/plugin.h>
+#include <libaudcore/preferences.h>
+#include <libaudcore/ringbuf.h>
 #include <libaudcore/runtime.h>
 
+/* largest single read from the underlying stream */
+#define GIO_BLOCK_SIZE 65536
+
 static const char gio_about[] =
  N_("GIO Plugin for Audacious\n"
     "Copyright 2009-2012 John Lindgren");
@@ -39,10 +48,21 @@ static const char * const gio_schemes[] = {"ftp", "sftp", "smb", "mtp"};
 class GIOTransport : public TransportPlugin
 {
 public:
-    static constexpr PluginInfo info = {N_("GIO Plugin"), PACKAGE, gio_about};
+    static const char * const defaults[];
+    static const PreferencesWidget widgets[];
+    static const PluginPreferences prefs;
+
+    static constexpr PluginInfo info = {
+        N_("GIO Plugin"),
+        PACKAGE,
+        gio_about,
+        & prefs
+    };
 
     constexpr GIOTransport () : TransportPlugin (info, gio_schemes) {}
 
+    bool init ();
+
     VFSImpl * fopen (const char * path, const char * mode, String & error);
     VFSFileTest test_file (const char * filename, VFSFileTest test, String & error);
     Index<String> read_folder (const char * filename, String & error);
@@ -50,6 +70,33 @@ public:
 
 EXPORT GIOTransport aud_plugin_instance;
 
+const char * const GIOTransport::defaults[] = {
+    "readahead_kb", "256",
+    "prefetch", "TRUE",
+    "tail_kb", "64",
+    nullptr
+};
+
+const PreferencesWidget GIOTransport::widgets[] = {
+    WidgetLabel (N_("<b>Reading</b>")),
+    WidgetSpin (N_("Read-ahead buffer:"),
+        WidgetInt ("gio", "readahead_kb"),
+        {0, 16384, 64, N_("KiB (0 = off)")}),
+    WidgetCheck (N_("Read ahead in the background"),
+        WidgetBool ("gio", "prefetch")),
+    WidgetSpin (N_("End of file cache:"),
+        WidgetInt ("gio", "tail_kb"),
+        {0, 1024, 16, N_("KiB")})
+};
+
+const PluginPreferences GIOTransport::prefs = {{widgets}};
+
+bool GIOTransport::init ()
+{
+    aud_config_set_defaults ("gio", defaults);
+    return true;
+}
+
 class GIOFile : public VFSImpl
 {
 public:
@@ -82,6 +129,41 @@ private:
     GOutputStream * m_ostream = nullptr;
     GSeekable * m_seekable = nullptr;
     bool m_eof = false;
+
+    /* Files opened read-only are read through a buffer. The position the
+     * player sees (m_pos) is decoupled from that of the stream, which is
+     * only moved when the data is not in the buffer already. */
+    bool m_buffered = false;
+    bool m_prefetch = false;        // fill the buffer from a separate thread
+    int64_t m_pos = 0;
+    int64_t m_size = -1;            // cached file size, -1 until known
+
+    RingBuf<char> m_rb;
+    int64_t m_buf_pos = 0;          // file position of the first byte in m_rb
+    bool m_stream_eof = false;
+    bool m_stream_error = false;
+    Index<char> m_block;            // scratch buffer for synchronous reads
+
+    Index<char> m_tail;             // copy of the end of the file
+    int64_t m_tail_pos = -1;        // file position of m_tail, -1 if not loaded
+    int m_tail_size = 0;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::thread m_thread;
+    bool m_busy = false;            // a read is in progress without the lock held
+    bool m_hold = false;            // keep the prefetch thread from reading
+    bool m_quit = false;
+
+    void read_block (std::unique_lock<std::mutex> & lock, Index<char> & block);
+    void hold_stream (std::unique_lock<std::mutex> & lock);
+    void release_stream ();
+    bool seek_stream (std::unique_lock<std::mutex> & lock, int64_t pos);
+    void load_tail (std::unique_lock<std::mutex> & lock, int64_t size);
+    int64_t buffered_read (char * buf, int64_t len);
+    int buffered_seek (int64_t offset, VFSSeekType whence);
+    int64_t query_size ();
+    void prefetch_worker ();
 };
 
 #define CHECK_ERROR(op, name) do { \
@@ -125,6 +207,16 @@ GIOFile::GIOFile (const char * filename, const char * mode) :
             m_istream = (GInputStream *) g_file_read (m_file, 0, & error);
             CHECK_AND_SAVE_ERROR ("open", filename);
             m_seekable = (GSeekable *) m_istream;
+
+            int readahead = aud::clamp (aud_get_int ("gio", "readahead_kb"), 0, 16384);
+
+            if (readahead > 0)
+            {
+                m_buffered = true;
+                m_prefetch = aud_get_bool ("gio", "prefetch");
+                m_rb.alloc (1024 * readahead);
+                m_tail_size = 1024 * aud::clamp (aud_get_int ("gio", "tail_kb"), 0, 1024);
+            }
         }
         break;
     case 'w':
@@ -177,6 +269,16 @@ GIOFile::~GIOFile ()
 {
     GError * error = nullptr;
 
+    if (m_thread.joinable ())
+    {
+        m_mutex.lock ();
+        m_quit = true;
+        m_cond.notify_all ();
+        m_mutex.unlock ();
+
+        m_thread.join ();
+    }
+
     if (m_iostream)
     {
         g_io_stream_close (m_iostream, 0, & error);
@@ -212,6 +314,200 @@ VFSImpl * GIOTransport::fopen (const char * filename, const char * mode, String
     }
 }
 
+/* Reads the next block from the stream into the buffer. Called with the
+ * lock held; the lock is released during the actual read. */
+void GIOFile::read_block (std::unique_lock<std::mutex> & lock, Index<char> & block)
+{
+    GError * error = nullptr;
+    int to_read = aud::min (m_rb.space (), GIO_BLOCK_SIZE);
+
+    block.resize (to_read);
+    m_busy = true;
+    lock.unlock ();
+
+    int64_t part = g_input_stream_read (m_istream, block.begin (), to_read, 0, & error);
+
+    lock.lock ();
+    m_busy = false;
+
+    if (error)
+    {
+        AUDERR ("Cannot read from %s: %s.\n", (const char *) m_filename, error->message);
+        g_error_free (error);
+        m_stream_error = true;
+    }
+    else if (part <= 0)
+        m_stream_eof = true;
+    else
+        m_rb.copy_in (block.begin (), part);
+
+    m_cond.notify_all ();
+}
+
+void GIOFile::prefetch_worker ()
+{
+    Index<char> block;
+    std::unique_lock<std::mutex> lock (m_mutex);
+
+    while (! m_quit)
+    {
+        /* avoid lots of small reads by waiting until a fair amount of
+         * the buffer is free again */
+        if (m_hold || m_stream_eof || m_stream_error ||
+         m_rb.space () < aud::min (m_rb.size () / 4, GIO_BLOCK_SIZE))
+            m_cond.wait (lock);
+        else
+            read_block (lock, block);
+    }
+}
+
+/* Waits for a read in progress to finish and keeps the prefetch thread
+ * from starting another one, so that the stream can be used directly. */
+void GIOFile::hold_stream (std::unique_lock<std::mutex> & lock)
+{
+    m_hold = true;
+
+    while (m_busy)
+        m_cond.wait (lock);
+}
+
+void GIOFile::release_stream ()
+{
+    m_hold = false;
+    m_cond.notify_all ();
+}
+
+/* Moves the stream to pos, dropping the buffered data. */
+bool GIOFile::seek_stream (std::unique_lock<std::mutex> & lock, int64_t pos)
+{
+    GError * error = nullptr;
+
+    hold_stream (lock);
+
+    g_seekable_seek (m_seekable, pos, G_SEEK_SET, nullptr, & error);
+
+    m_rb.discard ();
+    m_buf_pos = pos;
+    m_stream_eof = false;
+    m_stream_error = false;
+
+    if (error)
+    {
+        AUDERR ("Cannot seek within %s: %s.\n", (const char *) m_filename, error->message);
+        g_error_free (error);
+        m_stream_error = true;
+    }
+
+    release_stream ();
+    return ! m_stream_error;
+}
+
+/* Tag readers typically look at the last few KiB of a file several times
+ * before going back to the start; keep a copy of that part so that only
+ * the first of those reads goes over the network. */
+void GIOFile::load_tail (std::unique_lock<std::mutex> & lock, int64_t size)
+{
+    int64_t start = size - m_tail_size;
+
+    if (! seek_stream (lock, start))
+        return;
+
+    hold_stream (lock);
+
+    GError * error = nullptr;
+    gsize got = 0;
+
+    m_tail.resize (m_tail_size);
+    g_input_stream_read_all (m_istream, m_tail.begin (), m_tail_size, & got, nullptr, & error);
+
+    if (error)
+    {
+        AUDERR ("Cannot read from %s: %s.\n", (const char *) m_filename, error->message);
+        g_error_free (error);
+        m_tail.clear ();
+        m_stream_error = true;
+    }
+    else
+    {
+        m_tail.resize (got);
+        m_tail_pos = start;
+        m_buf_pos = start + got;
+        m_stream_eof = true;
+    }
+
+    release_stream ();
+}
+
+int64_t GIOFile::buffered_read (char * buf, int64_t len)
+{
+    std::unique_lock<std::mutex> lock (m_mutex);
+    int64_t total = 0;
+
+    m_eof = false;
+
+    while (total < len)
+    {
+        if (m_tail_pos >= 0 && m_pos >= m_tail_pos && m_pos < m_tail_pos + m_tail.len ())
+        {
+            int64_t part = aud::min (m_tail_pos + m_tail.len () - m_pos, len - total);
+            memcpy (buf + total, & m_tail[m_pos - m_tail_pos], part);
+            m_pos += part;
+            total += part;
+            continue;
+        }
+
+        /* Move the stream only if the data is neither in the buffer nor
+         * coming up shortly; short skips forward are read and dropped. */
+        int64_t buf_end = m_buf_pos + m_rb.len ();
+
+        if (m_pos < m_buf_pos || m_pos > buf_end + GIO_BLOCK_SIZE ||
+         (m_pos > buf_end && (m_stream_eof || m_stream_error)))
+        {
+            if (! seek_stream (lock, m_pos))
+                break;
+        }
+
+        if (m_pos > m_buf_pos)
+        {
+            int skip = aud::min ((int64_t) m_rb.len (), m_pos - m_buf_pos);
+            m_rb.discard (skip);
+            m_buf_pos += skip;
+        }
+
+        if (m_pos == m_buf_pos && m_rb.len ())
+        {
+            int part = aud::min ((int64_t) m_rb.len (), len - total);
+            m_rb.move_out (buf + total, part);
+            m_buf_pos += part;
+            m_pos += part;
+            total += part;
+
+            /* there is room for the prefetch thread again */
+            m_cond.notify_all ();
+            continue;
+        }
+
+        if (m_stream_eof || m_stream_error)
+        {
+            m_eof = m_stream_eof;
+            break;
+        }
+
+        if (m_prefetch)
+        {
+            if (! m_thread.joinable ())
+                m_thread = std::thread (& GIOFile::prefetch_worker, this);
+
+            m_cond.notify_all ();
+            m_cond.wait (lock);
+        }
+        else
+            read_block (lock, m_block);
+    }
+
+    return total;
+}
+
 int64_t GIOFile::fread (void * buf, int64_t size, int64_t nitems)
 {
     GError * error = nullptr;
@@ -222,6 +518,9 @@ int64_t GIOFile::fread (void * buf, int64_t size, int64_t nitems)
         return 0;
     }
 
+    if (m_buffered)
+        return (size > 0) ? buffered_read ((char *) buf, size * nitems) / size : 0;
+
     int64_t total = 0;
     int64_t remain = size * nitems;
 
@@ -274,11 +573,64 @@ FAILED:
     return (size > 0) ? total / size : 0;
 }
 
+/* Seeks only update the position; the stream is moved (if at all) on the
+ * next read, so consecutive seeks cost nothing. */
+int GIOFile::buffered_seek (int64_t offset, VFSSeekType whence)
+{
+    int64_t size = -1;
+    int64_t pos;
+
+    switch (whence)
+    {
+    case VFS_SEEK_SET:
+        pos = offset;
+        break;
+    case VFS_SEEK_CUR:
+        pos = m_pos + offset;
+        break;
+    case VFS_SEEK_END:
+        if ((size = fsize ()) < 0)
+            return -1;
+        pos = size + offset;
+        break;
+    default:
+        AUDERR ("Cannot seek within %s: invalid whence.\n", (const char *) m_filename);
+        return -1;
+    }
+
+    if (pos < 0)
+    {
+        AUDERR ("Cannot seek within %s: invalid position.\n", (const char *) m_filename);
+        return -1;
+    }
+
+    if (pos != m_pos && ! g_seekable_can_seek (m_seekable))
+    {
+        AUDERR ("Cannot seek within %s: not seekable.\n", (const char *) m_filename);
+        return -1;
+    }
+
+    if (m_tail_size > 0 && m_tail_pos < 0 && (size >= 0 || (size = fsize ()) >= 0) &&
+     size > 2 * (int64_t) m_tail_size && pos >= size - m_tail_size)
+    {
+        std::unique_lock<std::mutex> lock (m_mutex);
+        load_tail (lock, size);
+    }
+
+    m_pos = pos;
+    m_eof = (whence == VFS_SEEK_END && offset == 0);
+
+    return 0;
+}
+
 int GIOFile::fseek (int64_t offset, VFSSeekType whence)
 {
     GError * error = nullptr;
     GSeekType gwhence;
 
+    if (m_buffered)
+        return buffered_seek (offset, whence);
+
     switch (whence)
     {
     case VFS_SEEK_SET:
@@ -308,6 +660,9 @@ FAILED:
 
 int64_t GIOFile::ftell ()
 {
+    if (m_buffered)
+        return m_pos;
+
     return g_seekable_tell (m_seekable);
 }
 
@@ -331,8 +686,55 @@ FAILED:
     return -1;
 }
 
+/* The size of a file opened read-only is looked up once, without
+ * disturbing the stream, which the prefetch thread may be reading. */
+int64_t GIOFile::query_size ()
+{
+    std::unique_lock<std::mutex> lock (m_mutex);
+    hold_stream (lock);
+
+    GError * error = nullptr;
+    GFileInfo * info = g_file_input_stream_query_info ((GFileInputStream *) m_istream,
+     G_FILE_ATTRIBUTE_STANDARD_SIZE, nullptr, & error);
+
+    if (info)
+    {
+        if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_SIZE))
+            m_size = g_file_info_get_size (info);
+
+        g_object_unref (info);
+    }
+    else
+        g_error_free (error);
+
+    if (m_size < 0 && g_seekable_can_seek (m_seekable))
+    {
+        /* fall back to seeking to the end and back */
+        int64_t saved_pos = m_buf_pos + m_rb.len ();
+
+        error = nullptr;
+        g_seekable_seek (m_seekable, 0, G_SEEK_END, nullptr, & error);
+        CHECK_ERROR ("seek within", m_filename);
+
+        m_size = g_seekable_tell (m_seekable);
+
+        g_seekable_seek (m_seekable, saved_pos, G_SEEK_SET, nullptr, & error);
+        if (error)
+            m_stream_error = true;
+
+        CHECK_ERROR ("seek within", m_filename);
+    }
+
+FAILED:
+    release_stream ();
+    return m_size;
+}
+
 int64_t GIOFile::fsize ()
 {
+    if (m_buffered)
+        return (m_size >= 0) ? m_size : query_size ();
+
     if (! g_seekable_can_seek (m_seekable))
         return -1;
 
@@ -42,6 +42,8 @@
 #include <gdk/gdkwin32.h>
 #endif
 
+#include "../vis-common/spectrum.h"
+
 #define NUM_BANDS 32
 #define DB_RANGE 40
 
@@ -79,7 +81,7 @@ public:
 
 EXPORT GLSpectrum aud_plugin_instance;
 
-static float logscale[NUM_BANDS + 1];
+static LogBands log_bands;
 static float colors[NUM_BANDS][NUM_BANDS][3];
 
 #ifdef GDK_WINDOWING_X11
@@ -102,8 +104,7 @@ static float s_bars[NUM_BANDS][NUM_BANDS];
 
 bool GLSpectrum::init ()
 {
-    for (int i = 0; i <= NUM_BANDS; i ++)
-        logscale[i] = powf (256, (float) i / NUM_BANDS) - 0.5f;
+    log_bands.set_bands (NUM_BANDS);
 
     for (int y = 0; y < NUM_BANDS; y ++)
     {
@@ -122,47 +123,9 @@ bool GLSpectrum::init ()
     return true;
 }
 
-/* stolen from the skins plugin */
-/* convert linear frequency graph to logarithmic one */
-static void make_log_graph (const float * freq, float * graph)
-{
-    for (int i = 0; i < NUM_BANDS; i ++)
-    {
-        /* sum up values in freq array between logscale[i] and logscale[i + 1],
-           including fractional parts */
-        int a = ceilf (logscale[i]);
-        int b = floorf (logscale[i + 1]);
-        float sum = 0;
-
-        if (b < a)
-            sum += freq[b] * (logscale[i + 1] - logscale[i]);
-        else
-        {
-            if (a > 0)
-                sum += freq[a - 1] * (a - logscale[i]);
-            for (; a < b; a ++)
-                sum += freq[a];
-            if (b < 256)
-                sum += freq[b] * (logscale[i + 1] - b);
-        }
-
-        /* fudge factor to make the graph have the same overall height as a
-           12-band one no matter how many bands there are */
-        sum *= (float) NUM_BANDS / 12;
-
-        /* convert to dB */
-        float val = 20 * log10f (sum);
-
-        /* scale (-DB_RANGE, 0.0) to (0.0, 1.0) */
-        val = 1 + val / DB_RANGE;
-
-        graph[i] = aud::clamp (val, 0.0f, 1.0f);
-    }
-}
-
 void GLSpectrum::render_freq (const float * freq)
 {
-    make_log_graph (freq, s_bars[s_pos]);
+    log_bands.compute_scaled (freq, DB_RANGE, s_bars[s_pos]);
     s_pos = (s_pos + 1) % NUM_BANDS;
 
     s_angle += s_anglespeed;
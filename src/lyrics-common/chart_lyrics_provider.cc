@@ -22,9 +22,7 @@
 
 void ChartLyricsProvider::reset_lyric_metadata ()
 {
-    m_lyric_id = -1;
-    m_lyric_checksum = String ();
-    m_lyric_url = String ();
+    m_match = Match ();
     m_lyrics = String ();
 }
 
@@ -39,7 +37,7 @@ String ChartLyricsProvider::match_uri (LyricsState state)
     return String (str_concat ({m_base_url, "/SearchLyric?artist=", artist, "&song=", title}));
 }
 
-bool ChartLyricsProvider::has_match (LyricsState state, xmlNodePtr node)
+bool ChartLyricsProvider::has_match (LyricsState state, xmlNodePtr node, Match & match)
 {
     String lyric_id, checksum, url, artist, title;
 
@@ -72,9 +70,9 @@ bool ChartLyricsProvider::has_match (LyricsState state, xmlNodePtr node)
             ! strcmp_nocase (artist, state.artist) &&
             ! strcmp_nocase (title, state.title))
         {
-            m_lyric_id = id;
-            m_lyric_checksum = checksum;
-            m_lyric_url = url;
+            match.id = id;
+            match.checksum = checksum;
+            match.url = url;
 
             return true;
         }
@@ -83,6 +81,54 @@ bool ChartLyricsProvider::has_match (LyricsState state, xmlNodePtr node)
     return false;
 }
 
+// Returns false if the search result cannot be parsed; <match> is left
+// unchanged if no matching song is found.
+bool ChartLyricsProvider::parse_match (LyricsState state, const Index<char> & buf, Match & match)
+{
+    xmlDocPtr doc = xmlReadMemory (buf.begin (), buf.len (), nullptr, nullptr, 0);
+    if (! doc)
+        return false;
+
+    xmlNodePtr root = xmlDocGetRootElement (doc);
+
+    for (xmlNodePtr cur_node = root->xmlChildrenNode; cur_node; cur_node = cur_node->next)
+    {
+        if (cur_node->type != XML_ELEMENT_NODE)
+            continue;
+
+        if (has_match (state, cur_node, match))
+            break;
+    }
+
+    xmlFreeDoc (doc);
+    return true;
+}
+
+// Returns false if the lyric cannot be parsed.
+bool ChartLyricsProvider::parse_lyrics (const Index<char> & buf, String & lyrics)
+{
+    xmlDocPtr doc = xmlReadMemory (buf.begin (), buf.len (), nullptr, nullptr, 0);
+    if (! doc)
+        return false;
+
+    xmlNodePtr root = xmlDocGetRootElement (doc);
+
+    for (xmlNodePtr cur_node = root->xmlChildrenNode; cur_node; cur_node = cur_node->next)
+    {
+        if (cur_node->type == XML_ELEMENT_NODE &&
+            xmlStrEqual (cur_node->name, (xmlChar *) "Lyric"))
+        {
+            xmlChar * content = xmlNodeGetContent (cur_node);
+            lyrics = String ((const char *) content);
+            xmlFree (content);
+            break;
+        }
+    }
+
+    xmlFreeDoc (doc);
+    return true;
+}
+
 bool ChartLyricsProvider::match (LyricsState state)
 {
     reset_lyric_metadata ();
@@ -94,26 +140,12 @@ bool ChartLyricsProvider::match (LyricsState state)
             return;
         }
 
-        xmlDocPtr doc = xmlReadMemory (buf.begin (), buf.len (), nullptr, nullptr, 0);
-        if (! doc)
+        if (! parse_match (state, buf, m_match))
         {
             update_lyrics_window_error (str_printf (_("Unable to parse %s"), uri));
             return;
         }
 
-        xmlNodePtr root = xmlDocGetRootElement (doc);
-
-        for (xmlNodePtr cur_node = root->xmlChildrenNode; cur_node; cur_node = cur_node->next)
-        {
-            if (cur_node->type != XML_ELEMENT_NODE)
-                continue;
-
-            if (has_match (state, cur_node))
-                break;
-        }
-
-        xmlFreeDoc (doc);
-
         fetch (state);
     };
 
@@ -123,13 +155,13 @@ bool ChartLyricsProvider::match (LyricsState state)
     return true;
 }
 
-String ChartLyricsProvider::fetch_uri (LyricsState state)
+String ChartLyricsProvider::fetch_uri (const Match & match)
 {
-    if (m_lyric_id <= 0 || ! m_lyric_checksum)
+    if (match.id <= 0 || ! match.checksum)
         return String ();
 
-    auto id = int_to_str (m_lyric_id);
-    auto checksum = str_copy (m_lyric_checksum);
+    auto id = int_to_str (match.id);
+    auto checksum = str_copy (match.checksum);
     checksum = str_encode_percent (checksum, -1);
 
     return String (str_concat ({m_base_url, "/GetLyric?lyricId=", id, "&lyricCheckSum=", checksum}));
@@ -137,7 +169,7 @@ String ChartLyricsProvider::fetch_uri (LyricsState state)
 
 void ChartLyricsProvider::fetch (LyricsState state)
 {
-    String _fetch_uri = fetch_uri (state);
+    String _fetch_uri = fetch_uri (m_match);
     if (! _fetch_uri)
     {
         update_lyrics_window_notfound (state);
@@ -151,29 +183,12 @@ void ChartLyricsProvider::fetch (LyricsState state)
             return;
         }
 
-        xmlDocPtr doc = xmlReadMemory (buf.begin (), buf.len (), nullptr, nullptr, 0);
-        if (! doc)
+        if (! parse_lyrics (buf, m_lyrics))
         {
             update_lyrics_window_error (str_printf (_("Unable to parse %s"), uri));
             return;
         }
 
-        xmlNodePtr root = xmlDocGetRootElement (doc);
-
-        for (xmlNodePtr cur_node = root->xmlChildrenNode; cur_node; cur_node = cur_node->next)
-        {
-            if (cur_node->type == XML_ELEMENT_NODE &&
-                xmlStrEqual (cur_node->name, (xmlChar *) "Lyric"))
-            {
-                xmlChar * content = xmlNodeGetContent (cur_node);
-                m_lyrics = String ((const char *) content);
-                xmlFree (content);
-                break;
-            }
-        }
-
-        xmlFreeDoc (doc);
-
         LyricsState new_state = g_state;
         new_state.lyrics = String ();
 
@@ -193,3 +208,30 @@ void ChartLyricsProvider::fetch (LyricsState state)
     vfs_async_file_get_contents (_fetch_uri, handle_result_cb);
     update_lyrics_window_message (state, _("Looking for lyrics ..."));
 }
+
+// Same two steps as match () and fetch (), but the result of the search is
+// kept apart from that of the playing song.
+void ChartLyricsProvider::prefetch (LyricsState state, PrefetchCallback callback)
+{
+    auto handle_lyrics_cb = [=] (const char * uri, const Index<char> & buf) {
+        String lyrics;
+        if (buf.len ())
+            parse_lyrics (buf, lyrics);
+
+        callback (lyrics);
+    };
+
+    auto handle_match_cb = [=] (const char * uri, const Index<char> & buf) {
+        Match match;
+        if (buf.len ())
+            parse_match (state, buf, match);
+
+        String uri_lyrics = fetch_uri (match);
+        if (uri_lyrics)
+            vfs_async_file_get_contents (uri_lyrics, handle_lyrics_cb);
+        else
+            callback (String ());
+    };
+
+    vfs_async_file_get_contents (match_uri (state), handle_match_cb);
+}
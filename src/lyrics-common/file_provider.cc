@@ -144,6 +144,17 @@ bool FileProvider::match (LyricsState state)
     return exists;
 }
 
+// Checks for lyrics without loading them.
+bool FileProvider::has_lyrics (LyricsState state)
+{
+    String path = local_uri_for_entry (state);
+    if (path && VFSFile::test_file (path, VFS_IS_REGULAR))
+        return true;
+
+    path = cache_uri_for_entry (state);
+    return path && VFSFile::test_file (path, VFS_IS_REGULAR);
+}
+
 void FileProvider::save (LyricsState state)
 {
     if (! state.lyrics)
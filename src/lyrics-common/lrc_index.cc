@@ -0,0 +1,183 @@
+/*
+ * Time index of synced (LRC) lyrics
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <algorithm>
+
+#include "lyrics.h"
+
+// Parses a timestamp tag such as "[01:23.45]" (the fraction may also be
+// separated by a colon, or be missing), starting at the '['.
+// Returns the end of the tag, or nullptr if it is no timestamp.
+static const char * parse_timestamp (const char * tag, int & time)
+{
+    char * end;
+    long min = strtol (tag + 1, & end, 10);
+    if (end == tag + 1 || * end != ':' || min < 0)
+        return nullptr;
+
+    const char * sec_start = end + 1;
+    long sec = strtol (sec_start, & end, 10);
+    if (end == sec_start || sec < 0 || sec > 59)
+        return nullptr;
+
+    int ms = 0;
+    if (* end == '.' || * end == ':')
+    {
+        // the fraction has any number of digits; only three are used
+        int scale = 100;
+        for (end ++; * end >= '0' && * end <= '9'; end ++)
+        {
+            ms += (* end - '0') * scale;
+            scale /= 10;
+        }
+    }
+
+    if (* end != ']')
+        return nullptr;
+
+    time = (min * 60 + sec) * 1000 + ms;
+    return end + 1;
+}
+
+// Returns a copy of <text> without word timing tags such as "<01:23.45>".
+static StringBuf strip_word_tags (const char * text, int len)
+{
+    StringBuf buf (0);
+    const char * end = text + len;
+
+    while (text < end)
+    {
+        const char * tag = (const char *) memchr (text, '<', end - text);
+        const char * tag_end = tag ? (const char *) memchr (tag, '>', end - tag) : nullptr;
+
+        if (! tag_end || ! memchr (tag, ':', tag_end - tag))
+        {
+            buf.insert (-1, text, end - text);
+            break;
+        }
+
+        buf.insert (-1, text, tag - text);
+        text = tag_end + 1;
+    }
+
+    return buf;
+}
+
+void LrcIndex::clear ()
+{
+    m_lines.clear ();
+    m_text = String ();
+}
+
+bool LrcIndex::parse (const char * lyrics)
+{
+    clear ();
+
+    if (! lyrics)
+        return false;
+
+    int offset = 0;
+    Index<int> times;
+
+    for (const char * line = lyrics; * line; )
+    {
+        const char * next = strchr (line, '\n');
+        int len = next ? next - line : strlen (line);
+
+        const char * text = line;
+        const char * end = line + len;
+        times.clear ();
+
+        // a line may start with several timestamps for repeated text
+        while (text < end && * text == '[')
+        {
+            int time;
+            const char * after = parse_timestamp (text, time);
+
+            if (after)
+            {
+                times.append (time);
+                text = after;
+            }
+            else
+            {
+                if (! strncmp (text, "[offset:", 8))
+                    offset = atoi (text + 8);
+
+                break;
+            }
+        }
+
+        if (times.len ())
+        {
+            while (end > text && (end[-1] == '\r' || end[-1] == ' '))
+                end --;
+
+            String str (strip_word_tags (text, end - text));
+            for (int time : times)
+                m_lines.append (Line {time, str});
+        }
+
+        line = next ? next + 1 : line + len;
+    }
+
+    if (! m_lines.len ())
+        return false;
+
+    // a positive offset makes the lyrics appear sooner
+    for (Line & l : m_lines)
+        l.time -= offset;
+
+    // lines with repeated text are listed out of order
+    std::stable_sort (m_lines.begin (), m_lines.end (),
+     [] (const Line & a, const Line & b) { return a.time < b.time; });
+
+    // one line of text per entry, so that line numbers match
+    StringBuf text (0);
+    for (int i = 0; i < m_lines.len (); i ++)
+    {
+        if (i)
+            text.insert (-1, "\n");
+        text.insert (-1, m_lines[i].text);
+    }
+
+    m_text = String (text);
+    return true;
+}
+
+int LrcIndex::line_at (int time) const
+{
+    // find the last line starting at or before <time>
+    int low = 0, high = m_lines.len ();
+
+    while (low < high)
+    {
+        int mid = (low + high) / 2;
+
+        if (m_lines[mid].time <= time)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low - 1;
+}
@@ -26,6 +26,30 @@ bool LrcLibProvider::match (LyricsState state)
     return true;
 }
 
+String LrcLibProvider::fetch_uri (LyricsState state)
+{
+    auto artist = str_copy (state.artist);
+    artist = str_encode_percent (state.artist, -1);
+
+    auto title = str_copy (state.title);
+    title = str_encode_percent (state.title, -1);
+
+    return String (str_concat (
+        {m_base_url, "/api/get?artist_name=", artist, "&track_name=", title}));
+}
+
+// Synced lyrics are preferred, so that they can follow playback.
+bool LrcLibProvider::parse_lyrics (const Index<char> & buf, String & lyrics)
+{
+    if (! try_parse_json (buf, "syncedLyrics", lyrics))
+        return false;
+
+    if (! lyrics || ! lyrics[0])
+        return try_parse_json (buf, "plainLyrics", lyrics);
+
+    return true;
+}
+
 void LrcLibProvider::fetch (LyricsState state)
 {
     auto handle_result_cb = [=] (const char * uri, const Index<char> & buf) {
@@ -36,7 +60,7 @@ void LrcLibProvider::fetch (LyricsState state)
         }
 
         String lyrics;
-        if (! try_parse_json (buf, "plainLyrics", lyrics))
+        if (! parse_lyrics (buf, lyrics))
         {
             update_lyrics_window_error (str_printf (_("Unable to parse %s"), uri));
             return;
@@ -57,15 +81,19 @@ void LrcLibProvider::fetch (LyricsState state)
         persist_state (new_state);
     };
 
-    auto artist = str_copy (state.artist);
-    artist = str_encode_percent (state.artist, -1);
+    vfs_async_file_get_contents (fetch_uri (state), handle_result_cb);
+    update_lyrics_window_message (state, _("Looking for lyrics ..."));
+}
 
-    auto title = str_copy (state.title);
-    title = str_encode_percent (state.title, -1);
+void LrcLibProvider::prefetch (LyricsState state, PrefetchCallback callback)
+{
+    auto handle_result_cb = [=] (const char * uri, const Index<char> & buf) {
+        String lyrics;
+        if (buf.len ())
+            parse_lyrics (buf, lyrics);
 
-    auto fetch_uri = str_concat(
-        {m_base_url, "/api/get?artist_name=", artist, "&track_name=", title});
+        callback (lyrics);
+    };
 
-    vfs_async_file_get_contents (fetch_uri, handle_result_cb);
-    update_lyrics_window_message (state, _("Looking for lyrics ..."));
+    vfs_async_file_get_contents (fetch_uri (state), handle_result_cb);
 }
@@ -23,12 +23,14 @@
 #define AUDACIOUS_LYRICS_H
 
 #include <string.h>
+#include <functional>
 #include <libxml/parser.h>
 
 #define AUD_GLIB_INTEGRATION
 #include <libaudcore/audstrings.h>
 #include <libaudcore/drct.h>
 #include <libaudcore/i18n.h>
+#include <libaudcore/index.h>
 #include <libaudcore/runtime.h>
 #include <libaudcore/vfs.h>
 #include <libaudcore/vfs_async.h>
@@ -51,6 +53,37 @@ struct LyricsState {
 };
 
 
+// LrcIndex holds the lines of synced (LRC) lyrics ordered by time, so that
+// the line belonging to the current playback time can be found quickly.
+class LrcIndex
+{
+public:
+    // Returns false if the lyrics carry no timestamps.
+    bool parse (const char * lyrics);
+    void clear ();
+
+    int n_lines () const { return m_lines.len (); }
+    const String & text () const { return m_text; }
+
+    // Index of the line being sung at <time> (in milliseconds),
+    // or -1 if that is before the first line.
+    int line_at (int time) const;
+
+private:
+    struct Line {
+        int time;
+        String text;
+    };
+
+    Index<Line> m_lines;
+    String m_text; // the lines without tags, separated by newlines
+};
+
+
+// Receives the lyrics found by LyricProvider::prefetch (),
+// which are empty if none could be found.
+typedef std::function<void (String lyrics)> PrefetchCallback;
+
 // LyricProvider encapsulates an entire strategy for fetching lyrics,
 // for example from chartlyrics.com, lyrics.ovh or local storage.
 class LyricProvider
@@ -59,6 +92,11 @@ public:
     virtual bool match (LyricsState state) = 0;
     virtual void fetch (LyricsState state) = 0;
     virtual String edit_uri (LyricsState state) = 0;
+
+    // Looks up lyrics for a song that is not playing yet,
+    // without touching the lyrics window.
+    virtual void prefetch (LyricsState state, PrefetchCallback callback)
+        { callback (String ()); }
 };
 
 
@@ -76,6 +114,7 @@ public:
     void save (LyricsState state);
     void cache (LyricsState state);
     void cache_fetch (LyricsState state);
+    bool has_lyrics (LyricsState state);
 
 private:
     String local_uri_for_entry (LyricsState state);
@@ -94,17 +133,25 @@ public:
 
     bool match (LyricsState state) override;
     void fetch (LyricsState state) override;
-    String edit_uri (LyricsState state) override { return m_lyric_url; }
+    void prefetch (LyricsState state, PrefetchCallback callback) override;
+    String edit_uri (LyricsState state) override { return m_match.url; }
 
 private:
+    struct Match {
+        int id = -1;
+        String checksum, url;
+    };
+
     String match_uri (LyricsState state);
-    String fetch_uri (LyricsState state);
+    String fetch_uri (const Match & match);
 
     void reset_lyric_metadata ();
-    bool has_match (LyricsState state, xmlNodePtr node);
+    static bool has_match (LyricsState state, xmlNodePtr node, Match & match);
+    static bool parse_match (LyricsState state, const Index<char> & buf, Match & match);
+    static bool parse_lyrics (const Index<char> & buf, String & lyrics);
 
-    int m_lyric_id = -1;
-    String m_lyric_checksum, m_lyric_url, m_lyrics;
+    Match m_match;
+    String m_lyrics;
 
     const char * m_base_url = "http://api.chartlyrics.com/apiv1.asmx";
 };
@@ -118,9 +165,13 @@ public:
 
     bool match (LyricsState state) override;
     void fetch (LyricsState state) override;
+    void prefetch (LyricsState state, PrefetchCallback callback) override;
     String edit_uri (LyricsState state) override { return String (); }
 
 private:
+    String fetch_uri (LyricsState state);
+    static bool parse_lyrics (const Index<char> & buf, String & lyrics);
+
     const char * m_base_url = "https://lrclib.net";
 };
 
@@ -134,9 +185,12 @@ public:
 
     bool match (LyricsState state) override;
     void fetch (LyricsState state) override;
+    void prefetch (LyricsState state, PrefetchCallback callback) override;
     String edit_uri (LyricsState state) override { return String (); }
 
 private:
+    String fetch_uri (LyricsState state);
+
     const char * m_base_url = "https://api.lyrics.ovh";
 };
 
@@ -157,6 +211,11 @@ void update_lyrics_window_notfound (LyricsState state);
 
 bool try_parse_json (const Index<char> & buf, const char * key, String & output);
 
+void split_title_and_truncate (LyricsState & state);
 void lyrics_playback_began ();
 
+// Fetches lyrics of the songs coming up next into the local cache.
+void lyrics_prefetch_upcoming ();
+void lyrics_prefetch_cancel ();
+
 #endif // AUDACIOUS_LYRICS_H
@@ -27,6 +27,17 @@ bool LyricsOVHProvider::match (LyricsState state)
     return true;
 }
 
+String LyricsOVHProvider::fetch_uri (LyricsState state)
+{
+    auto artist = str_copy (state.artist);
+    artist = str_encode_percent (state.artist, -1);
+
+    auto title = str_copy (state.title);
+    title = str_encode_percent (state.title, -1);
+
+    return String (str_concat ({m_base_url, "/v1/", artist, "/", title}));
+}
+
 void LyricsOVHProvider::fetch (LyricsState state)
 {
     auto handle_result_cb = [=] (const char * uri, const Index<char> & buf) {
@@ -58,14 +69,19 @@ void LyricsOVHProvider::fetch (LyricsState state)
         persist_state (new_state);
     };
 
-    auto artist = str_copy (state.artist);
-    artist = str_encode_percent (state.artist, -1);
+    vfs_async_file_get_contents (fetch_uri (state), handle_result_cb);
+    update_lyrics_window_message (state, _("Looking for lyrics ..."));
+}
 
-    auto title = str_copy (state.title);
-    title = str_encode_percent (state.title, -1);
+void LyricsOVHProvider::prefetch (LyricsState state, PrefetchCallback callback)
+{
+    auto handle_result_cb = [=] (const char * uri, const Index<char> & buf) {
+        String lyrics;
+        if (buf.len ())
+            try_parse_json (buf, "lyrics", lyrics);
 
-    auto fetch_uri = str_concat ({m_base_url, "/v1/", artist, "/", title});
+        callback (lyrics);
+    };
 
-    vfs_async_file_get_contents (fetch_uri, handle_result_cb);
-    update_lyrics_window_message (state, _("Looking for lyrics ..."));
+    vfs_async_file_get_contents (fetch_uri (state), handle_result_cb);
 }
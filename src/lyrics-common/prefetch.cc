@@ -0,0 +1,167 @@
+/*
+ * Lookahead fetching of lyrics for upcoming songs
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <libaudcore/multihash.h>
+#include <libaudcore/playlist.h>
+
+#include "lyrics.h"
+#include "preferences.h"
+
+// Lyrics of the songs coming up next are fetched in the background and
+// stored in the local cache, where FileProvider finds them as soon as the
+// song starts.  Only a few requests run at the same time; each song is
+// looked up once per session, whether lyrics are found or not.
+
+static constexpr int MAX_REQUESTS = 2;
+
+static Index<LyricsState> pending;
+static SimpleHash<String, bool> seen;
+static int running;
+static int generation; // requests of an older generation were cancelled
+
+static String song_key (const LyricsState & state)
+{
+    return String (str_concat ({state.artist, "\n", state.title}));
+}
+
+static void start_requests ();
+
+static void request_done (LyricsState state, String lyrics, int request_generation)
+{
+    if (request_generation != generation)
+        return;
+
+    running --;
+
+    if (lyrics && lyrics[0])
+    {
+        AUDINFO ("Prefetched lyrics: %s - %s\n", (const char *) state.artist,
+         (const char *) state.title);
+
+        state.lyrics = lyrics;
+        file_provider.cache (state);
+    }
+
+    start_requests ();
+}
+
+static void start_requests ()
+{
+    LyricProvider * remote_provider = remote_source ();
+
+    while (remote_provider && running < MAX_REQUESTS && pending.len ())
+    {
+        LyricsState state = std::move (pending[0]);
+        pending.remove (0, 1);
+
+        int request_generation = generation;
+        running ++;
+
+        remote_provider->prefetch (state, [state, request_generation] (String lyrics) {
+            request_done (state, lyrics, request_generation);
+        });
+    }
+}
+
+// Returns the songs to be played next: queued songs first, then the ones
+// following in the playlist (their order is unknown in shuffle mode).
+static Index<int> upcoming_entries (Playlist playlist, int count)
+{
+    Index<int> entries;
+
+    int n_queued = playlist.n_queued ();
+    for (int i = 0; i < n_queued && entries.len () < count; i ++)
+        entries.append (playlist.queue_get_entry (i));
+
+    if (! aud_get_bool ("shuffle"))
+    {
+        int n_entries = playlist.n_entries ();
+        for (int e = playlist.get_position () + 1; e < n_entries && entries.len () < count; e ++)
+            entries.append (e);
+    }
+
+    return entries;
+}
+
+void lyrics_prefetch_upcoming ()
+{
+    int count = aud_get_int (CFG_SECTION, "prefetch-count");
+
+    // prefetched lyrics are only found through the cache
+    if (count <= 0 || ! aud_get_bool (CFG_SECTION, "enable-cache") ||
+        ! aud_get_bool (CFG_SECTION, "enable-file-provider") || ! remote_source ())
+        return;
+
+    // songs which are no longer coming up next are dropped
+    for (const LyricsState & state : pending)
+        seen.remove (song_key (state));
+
+    pending.clear ();
+
+    Playlist playlist = Playlist::playing_playlist ();
+    if (! playlist.exists ())
+        return;
+
+    for (int entry : upcoming_entries (playlist, count))
+    {
+        // metadata which is not known yet would need a file scan
+        Tuple tuple = playlist.entry_tuple (entry, Playlist::NoWait);
+        if (tuple.state () != Tuple::Valid)
+            continue;
+
+        if (aud_get_bool (CFG_SECTION, "use-embedded"))
+        {
+            String embedded_lyrics = tuple.get_str (Tuple::Lyrics);
+            if (embedded_lyrics && embedded_lyrics[0])
+                continue;
+        }
+
+        LyricsState state;
+        state.filename = playlist.entry_filename (entry);
+        state.title = tuple.get_str (Tuple::Title);
+        state.artist = tuple.get_str (Tuple::Artist);
+
+        if (aud_get_bool (CFG_SECTION, "split-title-on-chars"))
+            split_title_and_truncate (state);
+
+        if (! state.artist || ! state.title)
+            continue;
+
+        String key = song_key (state);
+        if (seen.lookup (key))
+            continue;
+
+        seen.add (key, true);
+
+        if (! file_provider.has_lyrics (state))
+            pending.append (std::move (state));
+    }
+
+    start_requests ();
+}
+
+void lyrics_prefetch_cancel ()
+{
+    pending.clear ();
+    seen.clear ();
+    running = 0;
+    generation ++;
+}
@@ -72,7 +72,7 @@ static char * truncate_by_pattern (const char * input, const char * pattern)
     return result;
 }
 
-static void split_title_and_truncate ()
+void split_title_and_truncate (LyricsState & state)
 {
     StringBuf split_pattern = str_concat ({
         "^(.*)\\s+[", aud_get_str (CFG_SECTION, "split-on-chars"), "]\\s+(.*)$"
@@ -81,7 +81,7 @@ static void split_title_and_truncate ()
     GMatchInfo * match_info;
     GRegex * split_regex = g_regex_new (split_pattern, G_REGEX_CASELESS, (GRegexMatchFlags) 0, nullptr);
 
-    if (g_regex_match (split_regex, g_state.title, (GRegexMatchFlags) 0, & match_info))
+    if (g_regex_match (split_regex, state.title, (GRegexMatchFlags) 0, & match_info))
     {
         CharPtr artist (g_match_info_fetch (match_info, 1));
         CharPtr title (g_match_info_fetch (match_info, 2));
@@ -100,10 +100,10 @@ static void split_title_and_truncate ()
             title = CharPtr (truncate_by_pattern (title, title_pattern));
         }
 
-        g_state.artist = String ();
-        g_state.title = String ();
-        g_state.artist = String (artist);
-        g_state.title = String (title);
+        state.artist = String ();
+        state.title = String ();
+        state.artist = String (artist);
+        state.title = String (title);
     }
 
     g_match_info_free (match_info);
@@ -121,6 +121,8 @@ void lyrics_playback_began ()
     g_state.artist = tuple.get_str (Tuple::Artist);
     g_state.lyrics = String ();
 
+    lyrics_prefetch_upcoming ();
+
     if (aud_get_bool (CFG_SECTION, "use-embedded"))
     {
         String embedded_lyrics = tuple.get_str (Tuple::Lyrics);
@@ -136,7 +138,7 @@ void lyrics_playback_began ()
     }
 
     if (aud_get_bool (CFG_SECTION, "split-title-on-chars"))
-        split_title_and_truncate ();
+        split_title_and_truncate (g_state);
 
     if (! aud_get_bool (CFG_SECTION, "enable-file-provider") || ! file_provider.match (g_state))
     {
@@ -22,6 +22,7 @@
 #include <json-glib/json-glib.h>
 
 #include <libaudcore/hook.h>
+#include <libaudcore/mainloop.h>
 #include <libaudcore/plugin.h>
 #include <libaudcore/plugins.h>
 #include <libaudgui/gtk-compat.h>
@@ -61,12 +62,40 @@ LyricsState g_state;
 static GtkTextView * textview;
 static GtkTextBuffer * textbuffer;
 
+// synced lyrics: the line being sung is highlighted
+static LrcIndex lrc_index;
+static int lrc_first_line, lrc_current_line;
+
 bool LyricsGtk::init ()
 {
     aud_config_set_defaults (CFG_SECTION, defaults);
     return true;
 }
 
+static void lrc_update_cb (void *)
+{
+    int line = lrc_index.line_at (aud_drct_get_time ());
+    if (! textbuffer || line == lrc_current_line)
+        return;
+
+    GtkTextIter start, end;
+    gtk_text_buffer_get_bounds (textbuffer, & start, & end);
+    gtk_text_buffer_remove_tag_by_name (textbuffer, "lrc_current", & start, & end);
+
+    lrc_current_line = line;
+    if (line < 0)
+        return;
+
+    gtk_text_buffer_get_iter_at_line (textbuffer, & start, lrc_first_line + line);
+    end = start;
+    gtk_text_iter_forward_to_line_end (& end);
+
+    gtk_text_buffer_apply_tag_by_name (textbuffer, "lrc_current", & start, & end);
+    gtk_text_buffer_move_mark_by_name (textbuffer, "lrc_current", & start);
+    gtk_text_view_scroll_to_mark (textview, gtk_text_buffer_get_mark (textbuffer,
+     "lrc_current"), 0, true, 0, 0.5);
+}
+
 void update_lyrics_window (const char * title, const char * artist, const char * lyrics)
 {
     GtkTextIter iter;
@@ -87,10 +116,20 @@ void update_lyrics_window (const char * title, const char * artist, const char *
     }
 
     gtk_text_buffer_insert (textbuffer, & iter, "\n\n", -1);
-    gtk_text_buffer_insert (textbuffer, & iter, lyrics, -1);
+
+    bool synced = lrc_index.parse (lyrics);
+    lrc_first_line = gtk_text_iter_get_line (& iter);
+    lrc_current_line = -1;
+
+    gtk_text_buffer_insert (textbuffer, & iter, synced ? (const char *) lrc_index.text () : lyrics, -1);
 
     gtk_text_buffer_get_start_iter (textbuffer, & iter);
     gtk_text_view_scroll_to_iter (textview, & iter, 0, true, 0, 0);
+
+    if (synced)
+        timer_add (TimerRate::Hz10, lrc_update_cb);
+    else
+        timer_remove (TimerRate::Hz10, lrc_update_cb);
 }
 
 bool try_parse_json (const Index<char> & buf, const char * key, String & output)
@@ -126,6 +165,10 @@ static void destroy_cb ()
     hook_dissociate ("tuple change", (HookFunction) lyrics_playback_began);
     hook_dissociate ("playback ready", (HookFunction) lyrics_playback_began);
 
+    timer_remove (TimerRate::Hz10, lrc_update_cb);
+    lrc_index.clear ();
+    lyrics_prefetch_cancel ();
+
     textview = nullptr;
     textbuffer = nullptr;
 }
@@ -229,6 +272,11 @@ static GtkWidget * build_widget ()
     gtk_text_buffer_create_tag (textbuffer, "weight_bold", "weight", PANGO_WEIGHT_BOLD, nullptr);
     gtk_text_buffer_create_tag (textbuffer, "scale_large", "scale", PANGO_SCALE_LARGE, nullptr);
     gtk_text_buffer_create_tag (textbuffer, "style_italic", "style", PANGO_STYLE_ITALIC, nullptr);
+    gtk_text_buffer_create_tag (textbuffer, "lrc_current", "weight", PANGO_WEIGHT_BOLD, nullptr);
+
+    GtkTextIter iter;
+    gtk_text_buffer_get_start_iter (textbuffer, & iter);
+    gtk_text_buffer_create_mark (textbuffer, "lrc_current", & iter, true);
 
     GtkWidget * hbox = audgui_hbox_new (6);
     gtk_box_pack_start ((GtkBox *) vbox, hbox, false, false, 0);
@@ -24,9 +24,11 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QMenu>
+#include <QTextBlock>
 #include <QTextEdit>
 
 #include <libaudcore/hook.h>
+#include <libaudcore/mainloop.h>
 #include <libaudcore/plugin.h>
 #include <libaudcore/plugins.h>
 
@@ -73,12 +75,44 @@ LyricsState g_state;
 
 static QTextEdit * textedit;
 
+// synced lyrics: the line being sung is highlighted
+static LrcIndex lrc_index;
+static int lrc_first_block, lrc_current_line;
+
 bool LyricsQt::init ()
 {
     aud_config_set_defaults (CFG_SECTION, defaults);
     return true;
 }
 
+static void lrc_update_cb (void *)
+{
+    int line = lrc_index.line_at (aud_drct_get_time ());
+    if (! textedit || line == lrc_current_line)
+        return;
+
+    lrc_current_line = line;
+
+    QList<QTextEdit::ExtraSelection> selections;
+
+    if (line >= 0)
+    {
+        QTextBlock block = textedit->document ()->findBlockByNumber (lrc_first_block + line);
+
+        QTextEdit::ExtraSelection selection;
+        selection.cursor = QTextCursor (block);
+        selection.format.setProperty (QTextFormat::FullWidthSelection, true);
+        selection.format.setBackground (textedit->palette ().highlight ());
+        selection.format.setForeground (textedit->palette ().highlightedText ());
+        selections.append (selection);
+
+        textedit->setTextCursor (selection.cursor);
+        textedit->ensureCursorVisible ();
+    }
+
+    textedit->setExtraSelections (selections);
+}
+
 void update_lyrics_window (const char * title, const char * artist, const char * lyrics)
 {
     if (! textedit)
@@ -93,7 +127,19 @@ void update_lyrics_window (const char * title, const char * artist, const char *
         cursor.insertHtml (QString ("<br><i>") + QString (artist) + QString ("</i>"));
 
     cursor.insertHtml ("<br><br>");
-    cursor.insertText (lyrics);
+
+    bool synced = lrc_index.parse (lyrics);
+    lrc_first_block = cursor.blockNumber ();
+    lrc_current_line = -1;
+
+    cursor.insertText (synced ? (const char *) lrc_index.text () : lyrics);
+
+    textedit->setExtraSelections ({});
+
+    if (synced)
+        timer_add (TimerRate::Hz10, lrc_update_cb);
+    else
+        timer_remove (TimerRate::Hz10, lrc_update_cb);
 }
 
 bool try_parse_json (const Index<char> & buf, const char * key, String & output)
@@ -128,6 +174,10 @@ static void lyrics_cleanup (QObject * object = nullptr)
     hook_dissociate ("tuple change", (HookFunction) lyrics_playback_began);
     hook_dissociate ("playback ready", (HookFunction) lyrics_playback_began);
 
+    timer_remove (TimerRate::Hz10, lrc_update_cb);
+    lrc_index.clear ();
+    lyrics_prefetch_cancel ();
+
     textedit = nullptr;
 }
 
@@ -24,6 +24,7 @@
 #include <libaudcore/i18n.h>
 #include <libaudcore/plugin.h>
 #include <libaudcore/runtime.h>
+#include <libaudcore/tuple.h>
 
 static const char * const m3u_exts[] = {"m3u", "m3u8"};
 
@@ -56,6 +57,122 @@ static char * split_line (char * line)
     return feed + 1;
 }
 
+/* Parses the part of an #EXTINF line following the colon:
+ * <seconds> [<key>="<value>" ...],[<artist> - ]<title>
+ * The tuple is marked valid, so that the entry is not opened until it is
+ * played; the player reads the file's own tags then. */
+static void parse_extinf (const char * info, Tuple & tuple)
+{
+    const char * comma = nullptr;
+    bool quoted = false;
+
+    for (const char * c = info; * c; c ++)
+    {
+        if (* c == '"')
+            quoted = ! quoted;
+        else if (* c == ',' && ! quoted)
+        {
+            comma = c;
+            break;
+        }
+    }
+
+    if (! comma)
+        return;
+
+    /* -1 (or 0) means the length is unknown */
+    double length = str_to_double (info);
+    if (length > 0)
+        tuple.set_int (Tuple::Length, (int) (length * 1000));
+
+    tuple.set_state (Tuple::Valid);
+
+    const char * display = comma + 1;
+    while (* display == ' ' || * display == '\t')
+        display ++;
+
+    StringBuf utf8 = str_to_utf8 (display, -1);
+    if (! utf8 || ! utf8[0])
+        return;
+
+    const char * dash = strstr (utf8, " - ");
+    if (dash && dash > utf8 && dash[3])
+    {
+        tuple.set_str (Tuple::Artist, str_copy (utf8, dash - utf8));
+        tuple.set_str (Tuple::Title, dash + 3);
+    }
+    else
+        tuple.set_str (Tuple::Title, utf8);
+}
+
+/* #EXTALB, #EXTART and #EXTGENRE lines add to the #EXTINF information */
+static const struct {
+    const char * directive;
+    Tuple::Field field;
+} extra_fields[] = {
+    {"#EXTALB:", Tuple::Album},
+    {"#EXTART:", Tuple::AlbumArtist},
+    {"#EXTGENRE:", Tuple::Genre}
+};
+
+static bool parse_extra_field (const char * line, Tuple & tuple)
+{
+    for (auto & extra : extra_fields)
+    {
+        int len = strlen (extra.directive);
+        if (strncmp (line, extra.directive, len))
+            continue;
+
+        StringBuf utf8 = str_to_utf8 (line + len, -1);
+        if (utf8 && utf8[0])
+            tuple.set_str (extra.field, utf8);
+
+        return true;
+    }
+
+    return false;
+}
+
+/* line breaks would end the #EXTINF line early */
+static StringBuf extinf_text (const char * text)
+{
+    StringBuf buf = str_copy (text);
+
+    for (char * c = buf; * c; c ++)
+    {
+        if (* c == '\r' || * c == '\n')
+            * c = ' ';
+    }
+
+    return buf;
+}
+
+static StringBuf make_extinf (const Tuple & tuple)
+{
+    int length = tuple.get_int (Tuple::Length);
+    String artist = tuple.get_str (Tuple::Artist);
+    String title = tuple.get_str (Tuple::Title);
+
+    StringBuf extinf = str_concat ({"#EXTINF:",
+     int_to_str ((length > 0) ? (length + 500) / 1000 : -1), ","});
+
+    if (artist && title)
+        str_append (extinf, extinf_text (str_concat ({artist, " - ", title})));
+    else if (title)
+        str_append (extinf, extinf_text (title));
+
+    str_append (extinf, "\n");
+
+    for (auto & extra : extra_fields)
+    {
+        String value = tuple.get_str (extra.field);
+        if (value && value[0])
+            str_append (extinf, str_concat ({extra.directive, extinf_text (value), "\n"}));
+    }
+
+    return extinf;
+}
+
 bool M3ULoader::load (const char * filename, VFSFile & file, String & title,
  Index<PlaylistAddItem> & items)
 {
@@ -67,6 +184,8 @@ bool M3ULoader::load (const char * filename, VFSFile & file, String & title,
 
     bool firstline = true;
     bool extm3u = false;
+    Tuple extinf;  /* applies to the next entry */
+    bool have_extinf = false;
 
     char * parse = text.begin ();
     if (! strncmp (parse, "\xef\xbb\xbf", 3)) /* byte order mark */
@@ -85,12 +204,29 @@ bool M3ULoader::load (const char * filename, VFSFile & file, String & title,
                 extm3u = true;
             else if (extm3u && ! strncmp (parse, "#EXT-X-", 7))
                 goto HLS;
+            else if (! strncmp (parse, "#EXTINF:", 8))
+            {
+                parse_extinf (parse + 8, extinf);
+                have_extinf = true;
+            }
+            else if (parse_extra_field (parse, extinf))
+                have_extinf = true;
         }
         else if (* parse)
         {
             StringBuf s = uri_construct (parse, filename);
             if (s)
-                items.append (String (s));
+            {
+                String uri (s);
+
+                if (have_extinf)
+                    extinf.set_filename (uri);
+
+                items.append (std::move (uri), std::move (extinf));
+            }
+
+            extinf = Tuple ();
+            have_extinf = false;
         }
 
         firstline = false;
@@ -112,8 +248,29 @@ HLS:
 bool M3ULoader::save (const char * filename, VFSFile & file, const char * title,
  const Index<PlaylistAddItem> & items)
 {
+    /* write extended M3U only if there is anything to put in it */
+    bool extm3u = false;
+    for (auto & item : items)
+    {
+        if (item.tuple.state () == Tuple::Valid)
+        {
+            extm3u = true;
+            break;
+        }
+    }
+
+    if (extm3u && file.fwrite ("#EXTM3U\n", 1, 8) != 8)
+        return false;
+
     for (auto & item : items)
     {
+        if (item.tuple.state () == Tuple::Valid)
+        {
+            StringBuf extinf = make_extinf (item.tuple);
+            if (file.fwrite (extinf, 1, extinf.len ()) != extinf.len ())
+                return false;
+        }
+
         StringBuf path = uri_deconstruct (item.filename, filename);
         StringBuf line = str_concat ({path, "\n"});
         if (file.fwrite (line, 1, line.len ()) != line.len ())
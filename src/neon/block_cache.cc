@@ -0,0 +1,228 @@
+/*
+ *  Block cache for seekable HTTP resources
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <map>
+#include <string>
+
+#include <pthread.h>
+#include <string.h>
+
+#include <libaudcore/index.h>
+
+#include "block_cache.h"
+
+struct CacheBlock
+{
+    Index<char> data;
+    uint64_t last_use = 0;
+};
+
+struct CacheResource
+{
+    int64_t total = 0;
+    std::map<int64_t, CacheBlock> blocks;
+};
+
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static std::map<std::string, CacheResource> cache_resources;
+
+static int cache_block_size = 65536;
+static int64_t cache_budget = 0;
+static int64_t cache_used = 0;
+static uint64_t cache_clock = 0;
+
+static void clear_locked ()
+{
+    cache_resources.clear ();
+    cache_used = 0;
+}
+
+void block_cache_configure (int block_size, int64_t budget)
+{
+    pthread_mutex_lock (& cache_mutex);
+
+    if (block_size != cache_block_size)
+        clear_locked ();
+
+    cache_block_size = block_size;
+    cache_budget = budget;
+
+    pthread_mutex_unlock (& cache_mutex);
+}
+
+void block_cache_clear ()
+{
+    pthread_mutex_lock (& cache_mutex);
+    clear_locked ();
+    pthread_mutex_unlock (& cache_mutex);
+}
+
+int block_cache_block_size ()
+{
+    pthread_mutex_lock (& cache_mutex);
+    int block_size = cache_block_size;
+    pthread_mutex_unlock (& cache_mutex);
+
+    return block_size;
+}
+
+/* returns the entry of a URL, dropping stale data */
+static CacheResource & lookup (const char * url, int64_t total)
+{
+    CacheResource & res = cache_resources[url];
+
+    if (res.total != total)
+    {
+        for (auto & it : res.blocks)
+            cache_used -= it.second.data.len ();
+
+        res.blocks.clear ();
+        res.total = total;
+    }
+
+    return res;
+}
+
+/* drops least recently used blocks until the budget is met again */
+static void evict (const CacheBlock * keep)
+{
+    while (cache_used > cache_budget)
+    {
+        CacheResource * oldest_res = nullptr;
+        std::map<int64_t, CacheBlock>::iterator oldest;
+
+        for (auto & res : cache_resources)
+        {
+            for (auto it = res.second.blocks.begin (); it != res.second.blocks.end (); it ++)
+            {
+                if (& it->second == keep)
+                    continue;
+
+                if (! oldest_res || it->second.last_use < oldest->second.last_use)
+                {
+                    oldest_res = & res.second;
+                    oldest = it;
+                }
+            }
+        }
+
+        if (! oldest_res)
+            break;
+
+        cache_used -= oldest->second.data.len ();
+        oldest_res->blocks.erase (oldest);
+    }
+}
+
+int64_t block_cache_read (const char * url, int64_t total, int64_t pos,
+ void * buf, int64_t len)
+{
+    int64_t done = 0;
+
+    pthread_mutex_lock (& cache_mutex);
+
+    CacheResource & res = lookup (url, total);
+
+    while (done < len)
+    {
+        auto it = res.blocks.find (pos / cache_block_size);
+        if (it == res.blocks.end ())
+            break;
+
+        CacheBlock & block = it->second;
+        int64_t offset = pos % cache_block_size;
+
+        if (offset >= block.data.len ())
+            break;
+
+        int64_t part = aud::min (len - done, block.data.len () - offset);
+        memcpy ((char *) buf + done, block.data.begin () + offset, part);
+        block.last_use = ++ cache_clock;
+
+        pos += part;
+        done += part;
+
+        /* stop at an incomplete block */
+        if (offset + part < cache_block_size && pos < total)
+            break;
+    }
+
+    pthread_mutex_unlock (& cache_mutex);
+
+    return done;
+}
+
+void block_cache_write (const char * url, int64_t total, int64_t pos,
+ const void * buf, int64_t len)
+{
+    pthread_mutex_lock (& cache_mutex);
+
+    if (cache_budget < cache_block_size)
+    {
+        pthread_mutex_unlock (& cache_mutex);
+        return;
+    }
+
+    CacheResource & res = lookup (url, total);
+
+    while (len > 0)
+    {
+        int64_t offset = pos % cache_block_size;
+        int64_t part = aud::min (len, cache_block_size - offset);
+
+        CacheBlock & block = res.blocks[pos / cache_block_size];
+        int64_t have = block.data.len ();
+
+        /* append the part not cached yet, unless that would leave a gap */
+        if (offset <= have && offset + part > have)
+        {
+            int64_t skip = have - offset;
+            block.data.insert ((const char *) buf + skip, -1, part - skip);
+            cache_used += part - skip;
+        }
+
+        block.last_use = ++ cache_clock;
+        evict (& block);
+
+        /* the block may have been emptied if nothing could be stored */
+        if (! block.data.len ())
+            res.blocks.erase (pos / cache_block_size);
+
+        buf = (const char *) buf + part;
+        pos += part;
+        len -= part;
+    }
+
+    pthread_mutex_unlock (& cache_mutex);
+}
+
+int64_t block_cache_resume_point (const char * url, int64_t total, int64_t pos)
+{
+    pthread_mutex_lock (& cache_mutex);
+
+    CacheResource & res = lookup (url, total);
+    int64_t start = pos - pos % cache_block_size;
+
+    auto it = res.blocks.find (pos / cache_block_size);
+    if (it != res.blocks.end ())
+        start = aud::min (start + it->second.data.len (), pos);
+
+    pthread_mutex_unlock (& cache_mutex);
+
+    return start;
+}
@@ -0,0 +1,52 @@
+/*
+ *  Block cache for seekable HTTP resources
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef NEON_BLOCK_CACHE_H
+#define NEON_BLOCK_CACHE_H
+
+#include <stdint.h>
+
+/* Data of remote files is kept in fixed-size blocks, shared by all handles
+ * opened on the same URL.  Each block holds the bytes from its start up to
+ * the point where data stopped arriving, so a block is either complete or
+ * can be completed by a request starting at its end.  When the memory
+ * budget is exceeded, the least recently used blocks are dropped.
+ *
+ * <total> is the size of the remote file; cached data of a URL is dropped
+ * when it turns out to have changed size. */
+
+void block_cache_configure (int block_size, int64_t budget);
+void block_cache_clear ();
+
+int block_cache_block_size ();
+
+/* Copies up to <len> cached bytes starting at <pos> and returns how many
+ * were available (0 if <pos> itself is not cached). */
+int64_t block_cache_read (const char * url, int64_t total, int64_t pos,
+ void * buf, int64_t len);
+
+/* Stores bytes received from the network; data which would leave a gap in
+ * a block is ignored. */
+void block_cache_write (const char * url, int64_t total, int64_t pos,
+ const void * buf, int64_t len);
+
+/* Returns the position, at or before <pos>, from which data has to be
+ * requested so that the block containing <pos> can be filled. */
+int64_t block_cache_resume_point (const char * url, int64_t total, int64_t pos);
+
+#endif
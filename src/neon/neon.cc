@@ -18,16 +18,20 @@
  */
 
 #define __STDC_FORMAT_MACROS
+#include <errno.h>
 #include <inttypes.h>
 #include <pthread.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <glib.h>
 
 #include <libaudcore/audstrings.h>
 #include <libaudcore/i18n.h>
 #include <libaudcore/plugin.h>
+#include <libaudcore/preferences.h>
 #include <libaudcore/ringbuf.h>
 #include <libaudcore/runtime.h>
 
@@ -44,11 +48,14 @@
 #include <wincrypt.h>
 #endif
 
+#include "block_cache.h"
 #include "cert_verification.h"
 
 #define NEON_NETBLKSIZE     (4096)
+#define NEON_NETBLKSIZE_MAX (32768)
 #define NEON_ICY_BUFSIZE    (4096)
 #define NEON_RETRY_COUNT 6
+#define NEON_RECONNECT_DELAY_MAX 16
 
 enum FillBufferResult {
     FILL_BUFFER_SUCCESS,
@@ -61,6 +68,7 @@ enum neon_reader_t {
     NEON_READER_RUN = 1,
     NEON_READER_ERROR,
     NEON_READER_EOF,
+    NEON_READER_RECONNECT,
     NEON_READER_TERM
 };
 
@@ -94,12 +102,28 @@ struct icy_metadata
     int stream_bitrate = 0;
 };
 
+/* A new connection whose data starts at a given point in the ringbuffer */
+struct icy_switch
+{
+    int64_t at;         /* Total bytes put into the ringbuffer before the new data */
+    int64_t metaint;    /* ICY metadata interval of the new connection */
+};
+
 static const char * const neon_schemes[] = {"http", "https"};
 
 class NeonTransport : public TransportPlugin
 {
 public:
-    static constexpr PluginInfo info = {N_("Neon HTTP/HTTPS Plugin"), PACKAGE};
+    static const char * const defaults[];
+    static const PreferencesWidget widgets[];
+    static const PluginPreferences prefs;
+
+    static constexpr PluginInfo info = {
+        N_("Neon HTTP/HTTPS Plugin"),
+        PACKAGE,
+        nullptr,
+        & prefs
+    };
 
     constexpr NeonTransport () : TransportPlugin (info, neon_schemes) {}
 
@@ -111,8 +135,44 @@ public:
 
 EXPORT NeonTransport aud_plugin_instance;
 
+const char * const NeonTransport::defaults[] = {
+    "cache_block_kb", "64",
+    "cache_size_kb", "8192",
+    "range_request_kb", "1024",
+    "reconnect_attempts", "8",
+    nullptr
+};
+
+static void configure_cache ()
+{
+    block_cache_configure (1024 * aud::clamp (aud_get_int ("neon", "cache_block_kb"), 4, 4096),
+     1024 * (int64_t) aud::max (aud_get_int ("neon", "cache_size_kb"), 0));
+}
+
+const PreferencesWidget NeonTransport::widgets[] = {
+    WidgetLabel (N_("<b>Cache for seekable files</b>")),
+    WidgetSpin (N_("Block size:"),
+        WidgetInt ("neon", "cache_block_kb", configure_cache),
+        {4, 4096, 4, N_("KiB")}),
+    WidgetSpin (N_("Memory budget:"),
+        WidgetInt ("neon", "cache_size_kb", configure_cache),
+        {0, 1048576, 256, N_("KiB")}),
+    WidgetSpin (N_("Request size:"),
+        WidgetInt ("neon", "range_request_kb"),
+        {64, 65536, 64, N_("KiB")}),
+    WidgetLabel (N_("<b>Internet radio</b>")),
+    WidgetSpin (N_("Reconnect attempts:"),
+        WidgetInt ("neon", "reconnect_attempts"),
+        {0, 100, 1})
+};
+
+const PluginPreferences NeonTransport::prefs = {{widgets}};
+
 bool NeonTransport::init ()
 {
+    aud_config_set_defaults ("neon", defaults);
+    configure_cache ();
+
     int ret = ne_sock_init ();
 
     if (ret != 0)
@@ -126,6 +186,7 @@ bool NeonTransport::init ()
 
 void NeonTransport::cleanup ()
 {
+    block_cache_clear ();
     ne_sock_exit ();
 }
 
@@ -158,6 +219,12 @@ private:
     unsigned char m_redircount = 0;     /* Redirect count for the opened URL */
     int64_t m_pos = 0;                  /* Current position in the stream
                                            (number of last byte delivered to the player) */
+    int64_t m_stream_pos = 0;           /* Position of the next byte in the ringbuffer;
+                                           differs from m_pos only for cached files */
+    int64_t m_range_end = -1;           /* Last byte of a bounded range request, -1 if
+                                           the current request runs to the end of file */
+    bool m_cached = false;              /* true if the file is seekable and read through
+                                           the block cache */
     int64_t m_content_start = 0;        /* Start position in the stream */
     int64_t m_content_length = -1;      /* Total content length, counting from
                                            content_start, if known. -1 if unknown */
@@ -166,9 +233,17 @@ private:
                                            send metadata announcements. 0 if no announcments */
     int64_t m_icy_metaleft = 0;         /* Bytes left until the next metadata block */
     int m_icy_len = 0;                  /* Bytes in current metadata block */
+    int64_t m_rb_total = 0;             /* Total bytes put into the ringbuffer */
+    Index<icy_switch> m_icy_switches;   /* Reconnects not yet reached by the player */
 
     bool m_eof = false;
 
+    int m_rb_max = 0;                   /* Size the ringbuffer may grow to on underruns */
+    bool m_rebuffering = false;         /* true after an underrun, until the buffer has
+                                           been refilled to a safe level */
+    int m_underruns = 0;                /* Number of buffer underruns so far */
+    int m_reconnects = 0;               /* Number of successful reconnects so far */
+
     RingBuf<char> m_rb;           /* Ringbuffer for our data */
     Index<char> m_icy_buf;        /* Buffer for ICY metadata */
     icy_metadata m_icy_metadata;  /* Current ICY metadata */
@@ -180,13 +255,22 @@ private:
     reader_status m_reader_status;
 
     void kill_reader ();
+    void create_session ();
     int server_auth (const char * realm, int attempt, char * username, char * password);
     void handle_headers ();
-    int open_request (int64_t startbyte, String * error);
+    int open_request (int64_t startbyte, String * error, bool headers = true);
     FillBufferResult fill_buffer ();
+    bool is_live_stream ();
+    bool reopen_stream (int64_t & icy_metaint);
+    bool reconnect ();
     void reader ();
     int64_t try_fread (void * ptr, int64_t size, int64_t nmemb, bool & data_read);
 
+    void enable_cache ();
+    bool restart_stream (int64_t startbyte);
+    bool seek_stream (int64_t pos);
+    int64_t cached_fread (char * buffer, int64_t len);
+
     static int server_auth_callback (void * data, const char * realm, int attempt,
      char * username, char * password)
         { return ((NeonFile *) data)->server_auth (realm, attempt, username, password); }
@@ -200,6 +284,9 @@ NeonFile::NeonFile (const char * url) :
 {
     int buffer_kb = aud_get_int ("net_buffer_kb");
     m_rb.alloc (1024 * aud::clamp (buffer_kb, 16, 1024));
+
+    /* Streams that underrun get up to four times the configured buffer */
+    m_rb_max = 4 * m_rb.size ();
 }
 
 NeonFile::~NeonFile ()
@@ -443,7 +530,11 @@ static int neon_proxy_auth_cb (void * userdata, const char * realm, int attempt,
     return attempt;
 }
 
-int NeonFile::open_request (int64_t startbyte, String * error)
+/* If headers is false, the response headers are ignored; this is used
+ * for further range requests on a file whose properties are known.
+ * Responses to the bounded range requests used for cached files never
+ * describe the whole file, so their headers are ignored as well. */
+int NeonFile::open_request (int64_t startbyte, String * error, bool headers)
 {
     int ret;
     const ne_status * status;
@@ -457,7 +548,18 @@ int NeonFile::open_request (int64_t startbyte, String * error)
     else
         m_request = ne_request_create (m_session, "GET", m_purl.path);
 
-    if (startbyte > 0)
+    m_range_end = -1;
+
+    if (m_cached)
+    {
+        /* Bounded requests read to completion let neon keep the
+         * connection open for the next request */
+        int64_t range = 1024 * (int64_t) aud::clamp (aud_get_int ("neon", "range_request_kb"), 64, 65536);
+        m_range_end = aud::min (startbyte + range, fsize ()) - 1;
+        ne_add_request_header (m_request, "Range",
+         str_printf ("bytes=%" PRId64 "-%" PRId64, startbyte, m_range_end));
+    }
+    else if (startbyte > 0)
         ne_add_request_header (m_request, "Range", str_printf ("bytes=%" PRIu64 "-", startbyte));
 
     ne_add_request_header (m_request, "Icy-MetaData", "1");
@@ -504,9 +606,13 @@ int NeonFile::open_request (int64_t startbyte, String * error)
         {
             /* URL opened OK */
             AUDDBG ("<%p> URL opened OK\n", this);
-            m_content_start = startbyte;
-            m_pos = startbyte;
-            handle_headers ();
+
+            if (headers && ! m_cached)
+            {
+                m_content_start = startbyte;
+                handle_headers ();
+            }
+
             return 0;
         }
 
@@ -573,9 +679,9 @@ static void trust_win32_root_certs (ne_session * m_session)
 }
 #endif
 
-int NeonFile::open_handle (int64_t startbyte, String * error)
+/* Creates a session for the (already parsed) URL in m_purl */
+void NeonFile::create_session ()
 {
-    int ret;
     String proxy_host;
     int proxy_port = 0;
     String proxy_user (""); // ne_session_socks_proxy requires non NULL user and password
@@ -604,6 +710,56 @@ int NeonFile::open_handle (int64_t startbyte, String * error)
         }
     }
 
+    if (! m_purl.port)
+        m_purl.port = ne_uri_defaultport (m_purl.scheme);
+
+    AUDDBG ("<%p> Creating session to %s://%s:%d\n", this,
+     m_purl.scheme, m_purl.host, m_purl.port);
+    m_session = ne_session_create (m_purl.scheme,
+     m_purl.host, m_purl.port);
+    ne_redirect_register (m_session);
+    ne_add_server_auth (m_session, NE_AUTH_BASIC, server_auth_callback, this);
+    ne_set_session_flag (m_session, NE_SESSFLAG_ICYPROTO, 1);
+    ne_set_session_flag (m_session, NE_SESSFLAG_PERSIST, 0);
+    ne_set_connect_timeout (m_session, 10);
+    ne_set_read_timeout (m_session, 10);
+    ne_set_useragent (m_session, "Audacious/" PACKAGE_VERSION);
+
+    if (use_proxy)
+    {
+        AUDDBG ("<%p> Using proxy: %s:%d\n", this, (const char *) proxy_host, proxy_port);
+        if (socks_proxy)
+        {
+            ne_session_socks_proxy (m_session, socks_type, proxy_host, proxy_port, proxy_user, proxy_pass);
+        }
+        else
+        {
+            ne_session_proxy (m_session, proxy_host, proxy_port);
+        }
+
+        if (use_proxy_auth)
+        {
+            AUDDBG ("<%p> Using proxy authentication\n", this);
+            ne_add_proxy_auth (m_session, NE_AUTH_BASIC,
+             neon_proxy_auth_cb, (void *) this);
+        }
+    }
+
+    if (! strcmp ("https", m_purl.scheme))
+    {
+        ne_ssl_trust_default_ca (m_session);
+#ifdef _WIN32
+        trust_win32_root_certs (m_session);
+#endif
+        ne_ssl_set_verify (m_session,
+         neon_vfs_verify_environment_ssl_certs, m_session);
+    }
+}
+
+int NeonFile::open_handle (int64_t startbyte, String * error)
+{
+    int ret;
+
     m_redircount = 0;
 
     AUDDBG ("<%p> Parsing URL\n", this);
@@ -619,50 +775,7 @@ int NeonFile::open_handle (int64_t startbyte, String * error)
 
     while (m_redircount < 10)
     {
-        if (! m_purl.port)
-            m_purl.port = ne_uri_defaultport (m_purl.scheme);
-
-        AUDDBG ("<%p> Creating session to %s://%s:%d\n", this,
-         m_purl.scheme, m_purl.host, m_purl.port);
-        m_session = ne_session_create (m_purl.scheme,
-         m_purl.host, m_purl.port);
-        ne_redirect_register (m_session);
-        ne_add_server_auth (m_session, NE_AUTH_BASIC, server_auth_callback, this);
-        ne_set_session_flag (m_session, NE_SESSFLAG_ICYPROTO, 1);
-        ne_set_session_flag (m_session, NE_SESSFLAG_PERSIST, 0);
-        ne_set_connect_timeout (m_session, 10);
-        ne_set_read_timeout (m_session, 10);
-        ne_set_useragent (m_session, "Audacious/" PACKAGE_VERSION);
-
-        if (use_proxy)
-        {
-            AUDDBG ("<%p> Using proxy: %s:%d\n", this, (const char *) proxy_host, proxy_port);
-            if (socks_proxy)
-            {
-                ne_session_socks_proxy (m_session, socks_type, proxy_host, proxy_port, proxy_user, proxy_pass);
-            }
-            else
-            {
-                ne_session_proxy (m_session, proxy_host, proxy_port);
-            }
-
-            if (use_proxy_auth)
-            {
-                AUDDBG ("<%p> Using proxy authentication\n", this);
-                ne_add_proxy_auth (m_session, NE_AUTH_BASIC,
-                 neon_proxy_auth_cb, (void *) this);
-            }
-        }
-
-        if (! strcmp ("https", m_purl.scheme))
-        {
-            ne_ssl_trust_default_ca (m_session);
-#ifdef _WIN32
-            trust_win32_root_certs (m_session);
-#endif
-            ne_ssl_set_verify (m_session,
-             neon_vfs_verify_environment_ssl_certs, m_session);
-        }
+        create_session ();
 
         AUDDBG ("<%p> Creating request\n", this);
         ret = open_request (startbyte, error);
@@ -692,17 +805,31 @@ int NeonFile::open_handle (int64_t startbyte, String * error)
 
 FillBufferResult NeonFile::fill_buffer ()
 {
-    char buffer[NEON_NETBLKSIZE];
+    char buffer[NEON_NETBLKSIZE_MAX];
     int to_read;
 
     pthread_mutex_lock (& m_reader_status.mutex);
-    to_read = aud::min (m_rb.space (), NEON_NETBLKSIZE);
+    to_read = aud::min (m_rb.space (), NEON_NETBLKSIZE_MAX);
     pthread_mutex_unlock (& m_reader_status.mutex);
 
     int bsize = ne_read_response_block (m_request, buffer, to_read);
 
     if (! bsize)
     {
+        if (m_range_end >= 0 && m_range_end + 1 < fsize ())
+        {
+            /* End of a bounded range, request the next one */
+            AUDDBG ("<%p> Requesting next range from %" PRId64 "\n", this, m_range_end + 1);
+            ne_end_request (m_request);
+            ne_request_destroy (m_request);
+            m_request = nullptr;
+
+            if (open_request (m_range_end + 1, nullptr, false) != 0)
+                return FILL_BUFFER_ERROR;
+
+            return FILL_BUFFER_SUCCESS;
+        }
+
         AUDDBG ("<%p> End of file encountered\n", this);
         return FILL_BUFFER_EOF;
     }
@@ -719,11 +846,117 @@ FillBufferResult NeonFile::fill_buffer ()
 
     pthread_mutex_lock (& m_reader_status.mutex);
     m_rb.copy_in (buffer, bsize);
+    m_rb_total += bsize;
     pthread_mutex_unlock (& m_reader_status.mutex);
 
     return FILL_BUFFER_SUCCESS;
 }
 
+/* A live stream has no known length and identifies itself as a radio
+ * station; for those, losing the connection is not the end of the stream. */
+bool NeonFile::is_live_stream ()
+{
+    return m_content_length < 0 && ! m_cached &&
+     (m_icy_metaint || m_icy_metadata.stream_name || m_icy_metadata.stream_bitrate);
+}
+
+/* Opens a new connection to the stream, following redirects. Called from
+ * the reader thread without the mutex held. The ICY metadata interval of
+ * the new connection is returned separately, since the player may still
+ * be reading data from the old one. */
+bool NeonFile::reopen_stream (int64_t & icy_metaint)
+{
+    if (m_request)
+    {
+        ne_request_destroy (m_request);
+        m_request = nullptr;
+    }
+
+    if (m_session)
+    {
+        ne_session_destroy (m_session);
+        m_session = nullptr;
+    }
+
+    m_redircount = 0;
+
+    while (m_redircount < 10)
+    {
+        create_session ();
+
+        int ret = open_request (0, nullptr, false);
+
+        if (! ret)
+        {
+            const char * value = ne_get_response_header (m_request, "icy-metaint");
+            icy_metaint = value ? aud::max ((int64_t) strtoll (value, nullptr, 10), (int64_t) 0) : 0;
+            return true;
+        }
+
+        ne_session_destroy (m_session);
+        m_session = nullptr;
+
+        if (ret < 0)
+            return false;
+    }
+
+    return false;
+}
+
+/* Tries to get a live stream going again after the connection was lost,
+ * waiting longer after each failed attempt. Called from the reader thread
+ * with the mutex held. Data from the new connection is buffered right
+ * behind what is left of the old one; the player switches to the new ICY
+ * metadata countdown once it reaches that point. */
+bool NeonFile::reconnect ()
+{
+    int attempts = aud_get_int ("neon", "reconnect_attempts");
+    int delay = 1;
+
+    m_reader_status.status = NEON_READER_RECONNECT;
+
+    for (int attempt = 1; attempt <= attempts && m_reader_status.reading; attempt ++)
+    {
+        AUDINFO ("<%p> Connection lost, reconnecting (attempt %d of %d)\n",
+         this, attempt, attempts);
+
+        int64_t icy_metaint = 0;
+
+        pthread_mutex_unlock (& m_reader_status.mutex);
+        bool success = reopen_stream (icy_metaint);
+        pthread_mutex_lock (& m_reader_status.mutex);
+
+        if (success)
+        {
+            m_icy_switches.append (icy_switch {m_rb_total, icy_metaint});
+
+            m_reconnects ++;
+            m_reader_status.status = NEON_READER_RUN;
+            pthread_cond_broadcast (& m_reader_status.cond);
+
+            AUDINFO ("<%p> Reconnected to stream\n", this);
+            return true;
+        }
+
+        if (attempt == attempts)
+            break;
+
+        /* The main thread wakes us up regularly, so wait for the deadline */
+        timespec until;
+        clock_gettime (CLOCK_REALTIME, & until);
+        until.tv_sec += delay;
+
+        while (m_reader_status.reading && pthread_cond_timedwait
+         (& m_reader_status.cond, & m_reader_status.mutex, & until) != ETIMEDOUT)
+            ;
+
+        delay = aud::min (delay * 2, NEON_RECONNECT_DELAY_MAX);
+    }
+
+    AUDERR ("<%p> Could not reconnect to stream\n", this);
+    return false;
+}
+
 void NeonFile::reader ()
 {
     pthread_mutex_lock (& m_reader_status.mutex);
@@ -742,6 +975,14 @@ void NeonFile::reader ()
             /* Wake up main thread if it is waiting. */
             pthread_cond_broadcast (& m_reader_status.cond);
 
+            if (ret != FILL_BUFFER_SUCCESS && is_live_stream ())
+            {
+                if (reconnect ())
+                    continue;
+                if (! m_reader_status.reading)
+                    break;
+            }
+
             if (ret == FILL_BUFFER_ERROR)
             {
                 AUDERR ("<%p> Error while reading from the network. "
@@ -785,12 +1026,141 @@ VFSImpl * NeonTransport::fopen (const char * path, const char * mode, String & e
         return nullptr;
     }
 
+    file->enable_cache ();
+
     return file;
 }
 
+/* Files which can be seeked in are read through the block cache, so that
+ * data read once (e.g. by a tag reader looking at the end of the file)
+ * need not be fetched again. */
+void NeonFile::enable_cache ()
+{
+    if (m_content_length < 0 || ! m_can_ranges || m_icy_metaint)
+        return;
+
+    if (block_cache_block_size () <= 0)
+        return;
+
+    AUDDBG ("<%p> Enabling block cache\n", this);
+    m_cached = true;
+
+    /* Allow neon to reuse the connection for further range requests */
+    ne_set_session_flag (m_session, NE_SESSFLAG_PERSIST, 1);
+}
+
+/* Replaces the current request by one starting at startbyte. The session
+ * (and its connection, if the server kept it open) is reused if possible. */
+bool NeonFile::restart_stream (int64_t startbyte)
+{
+    AUDDBG ("<%p> Restarting stream at %" PRId64 "\n", this, startbyte);
+
+    if (m_reader_status.reading)
+        kill_reader ();
+
+    if (m_request)
+    {
+        ne_request_destroy (m_request);
+        m_request = nullptr;
+    }
+
+    m_rb.discard ();
+    m_rb_total = 0;
+    m_icy_switches.clear ();
+    m_eof = false;
+
+    if (! m_session || open_request (startbyte, nullptr, false) != 0)
+    {
+        /* The session could not be reused, start over */
+        if (m_session)
+        {
+            ne_session_destroy (m_session);
+            m_session = nullptr;
+        }
+
+        ne_uri_free (& m_purl);
+        m_purl = ne_uri ();
+
+        if (open_handle (startbyte) != 0)
+            return false;
+
+        ne_set_session_flag (m_session, NE_SESSFLAG_PERSIST, 1);
+    }
+
+    m_stream_pos = startbyte;
+    return true;
+}
+
+/* Makes the network stream deliver the byte at pos next. If the current
+ * request is only a short way behind, the bytes in between are read (and
+ * cached) instead of starting a new request. */
+bool NeonFile::seek_stream (int64_t pos)
+{
+    int64_t total = fsize ();
+    int64_t max_skip = 2 * (int64_t) block_cache_block_size ();
+
+    if (! m_request || m_eof || m_stream_pos > pos || pos - m_stream_pos > max_skip)
+    {
+        if (! restart_stream (block_cache_resume_point (m_url, total, pos)))
+            return false;
+    }
+
+    while (m_stream_pos < pos)
+    {
+        char buffer[NEON_NETBLKSIZE];
+        int64_t start = m_stream_pos;
+        bool data_read = false;
+
+        int64_t part = try_fread (buffer, 1,
+         aud::min (pos - m_stream_pos, (int64_t) sizeof buffer), data_read);
+
+        if (! data_read)
+            return false;
+
+        block_cache_write (m_url, total, start, buffer, part);
+    }
+
+    return true;
+}
+
+int64_t NeonFile::cached_fread (char * buffer, int64_t len)
+{
+    int64_t total = fsize ();
+    int64_t done = 0;
+
+    while (done < len && m_pos < total)
+    {
+        int64_t part = block_cache_read (m_url, total, m_pos, buffer + done, len - done);
+
+        if (! part)
+        {
+            /* Not cached, get the data from the network */
+            if (m_stream_pos != m_pos || ! m_request || m_eof)
+            {
+                if (! seek_stream (m_pos))
+                    break;
+            }
+
+            bool data_read = false;
+            part = try_fread (buffer + done, 1, len - done, data_read);
+
+            if (! data_read)
+                break;
+
+            block_cache_write (m_url, total, m_pos, buffer + done, part);
+        }
+
+        m_pos += part;
+        done += part;
+    }
+
+    return done;
+}
+
 int64_t NeonFile::try_fread (void * ptr, int64_t size, int64_t nmemb, bool & data_read)
 {
-    if (! m_request)
+    /* While reconnecting, the reader thread may be without a request */
+    if (! m_reader_status.reading && ! m_request)
     {
         AUDERR ("<%p> No request to read from, seek gone wrong?\n", this);
         return 0;
@@ -802,16 +1172,53 @@ int64_t NeonFile::try_fread (void * ptr, int64_t size, int64_t nmemb, bool & dat
     /* If the buffer is empty, wait for the reader thread to fill it. */
     pthread_mutex_lock (& m_reader_status.mutex);
 
-    for (int retries = 0; retries < NEON_RETRY_COUNT; retries ++)
+    if (! m_rb.len () && ! m_cached && m_reader_status.reading &&
+     (m_reader_status.status == NEON_READER_RUN ||
+      m_reader_status.status == NEON_READER_RECONNECT))
     {
-        if (m_rb.len () / size > 0 || ! m_reader_status.reading ||
-         m_reader_status.status != NEON_READER_RUN)
+        /* The network did not keep up. Enlarge the buffer (if allowed) and
+         * let it fill up a bit before playing on, so that we do not run
+         * dry again right away. */
+        m_underruns ++;
+        m_rebuffering = true;
+
+        if (m_rb.size () < m_rb_max)
+        {
+            m_rb.alloc (aud::min (2 * m_rb.size (), m_rb_max));
+            AUDINFO ("<%p> Buffer underrun, buffer size now %d KiB\n", this, m_rb.size () / 1024);
+        }
+        else
+            AUDINFO ("<%p> Buffer underrun\n", this);
+    }
+
+    int64_t last_len = -1;
+
+    for (int retries = 0; retries < NEON_RETRY_COUNT && m_reader_status.reading; )
+    {
+        neon_reader_t status = m_reader_status.status;
+        int64_t wanted = (m_rebuffering && status == NEON_READER_RUN) ? m_rb.size () / 4 : size;
+
+        if (m_rb.len () >= wanted)
             break;
 
+        /* Only count waits in which no data arrived. There is no limit
+         * while reconnecting, the reader thread gives up on its own. */
+        if (status == NEON_READER_RUN)
+        {
+            if (m_rb.len () == last_len)
+                retries ++;
+        }
+        else if (status != NEON_READER_RECONNECT)
+            break;
+
+        last_len = m_rb.len ();
+
         pthread_cond_broadcast (& m_reader_status.cond);
         pthread_cond_wait (& m_reader_status.cond, & m_reader_status.mutex);
     }
 
+    m_rebuffering = false;
+
     pthread_mutex_unlock (& m_reader_status.mutex);
 
     if (! m_reader_status.reading)
@@ -861,6 +1268,7 @@ int64_t NeonFile::try_fread (void * ptr, int64_t size, int64_t nmemb, bool & dat
         {
         case NEON_READER_INIT:
         case NEON_READER_RUN:
+        case NEON_READER_RECONNECT:
             /* All is well, nothing to be done. */
             break;
 
@@ -917,6 +1325,25 @@ int64_t NeonFile::try_fread (void * ptr, int64_t size, int64_t nmemb, bool & dat
         return 0;
     }
 
+    /* Data from a new connection starts with a new metadata countdown;
+     * whatever is left of a metadata block from the old one is dropped */
+    int64_t to_switch = -1;
+
+    while (m_icy_switches.len ())
+    {
+        to_switch = m_icy_switches[0].at - (m_rb_total - m_rb.len ());
+        if (to_switch > 0)
+            break;
+
+        m_icy_metaint = m_icy_switches[0].metaint;
+        m_icy_metaleft = m_icy_metaint;
+        m_icy_buf.clear ();
+        m_icy_len = 0;
+
+        m_icy_switches.remove (0, 1);
+        to_switch = -1;
+    }
+
     int64_t belem = m_rb.len () / size;
 
     if (m_icy_metaint)
@@ -930,11 +1357,20 @@ int64_t NeonFile::try_fread (void * ptr, int64_t size, int64_t nmemb, bool & dat
                 m_icy_len = 16 * (unsigned char) m_rb.head ();
                 m_rb.pop ();
 
+                if (to_switch > 0)
+                    to_switch --;
+
                 AUDDBG ("<%p> Expecting %d bytes of ICY metadata\n", this, m_icy_len);
             }
 
             if (m_icy_buf.len () < m_icy_len)
-                m_rb.move_out (m_icy_buf, -1, aud::min (m_icy_len - m_icy_buf.len (), m_rb.len ()));
+            {
+                int64_t avail = m_rb.len ();
+                if (to_switch >= 0)
+                    avail = aud::min (avail, to_switch);
+
+                m_rb.move_out (m_icy_buf, -1, aud::min ((int64_t) (m_icy_len - m_icy_buf.len ()), avail));
+            }
 
             if (m_icy_buf.len () >= m_icy_len)
             {
@@ -953,6 +1389,10 @@ int64_t NeonFile::try_fread (void * ptr, int64_t size, int64_t nmemb, bool & dat
         belem = aud::min ((int64_t) m_rb.len (), m_icy_metaleft) / size;
     }
 
+    /* Stop at the start of the data from a new connection */
+    if (to_switch >= 0)
+        belem = aud::min (belem, to_switch / size);
+
     nmemb = aud::min (belem, nmemb);
     m_rb.move_out ((char *) ptr, nmemb * size);
 
@@ -968,10 +1408,11 @@ int64_t NeonFile::try_fread (void * ptr, int64_t size, int64_t nmemb, bool & dat
     else
         pthread_cond_broadcast (& m_reader_status.cond);
 
+    m_icy_metaleft -= nmemb * size;
+
     pthread_mutex_unlock (& m_reader_status.mutex);
 
-    m_pos += nmemb * size;
-    m_icy_metaleft -= nmemb * size;
+    m_stream_pos += nmemb * size;
 
     return nmemb;
 }
@@ -984,6 +1425,13 @@ int64_t NeonFile::fread (void * buffer, int64_t size, int64_t count)
 
     AUDDBG ("<%p> fread %d x %d\n", this, (int) size, (int) count);
 
+    if (m_cached)
+    {
+        total = size ? cached_fread ((char *) buffer, size * count) / size : 0;
+        AUDDBG ("<%p> fread = %d (cached)\n", this, (int) total);
+        return total;
+    }
+
     while (count > 0)
     {
         bool data_read = false;
@@ -992,6 +1440,7 @@ int64_t NeonFile::fread (void * buffer, int64_t size, int64_t count)
             break;
 
         buffer = (char *) buffer + size * part;
+        m_pos += size * part;
         total += part;
         count -= part;
     }
@@ -1017,9 +1466,11 @@ int64_t NeonFile::ftell ()
 
 bool NeonFile::feof ()
 {
-    AUDDBG ("<%p> EOF status: %s\n", this, m_eof ? "true" : "false");
+    bool eof = m_cached ? m_pos >= fsize () : m_eof;
 
-    return m_eof;
+    AUDDBG ("<%p> EOF status: %s\n", this, eof ? "true" : "false");
+
+    return eof;
 }
 
 int NeonFile::ftruncate (int64_t size)
@@ -1094,6 +1545,14 @@ int NeonFile::fseek (int64_t offset, VFSSeekType whence)
     if (newpos == m_pos)
         return 0;
 
+    /* Cached files are read from the cache or the network as needed,
+     * so nothing has to be done until the next read */
+    if (m_cached)
+    {
+        m_pos = newpos;
+        return 0;
+    }
+
     /* To seek to the new position we have to
      * - stop the current reader thread, if there is one
      * - destroy the current request
@@ -1115,6 +1574,8 @@ int NeonFile::fseek (int64_t offset, VFSSeekType whence)
     }
 
     m_rb.discard ();
+    m_rb_total = 0;
+    m_icy_switches.clear ();
     m_icy_buf.clear ();
     m_icy_len = 0;
 
@@ -1126,6 +1587,8 @@ int NeonFile::fseek (int64_t offset, VFSSeekType whence)
 
     /* Things seem to have worked. The next read request will start
      * the reader thread again. */
+    m_pos = newpos;
+    m_stream_pos = newpos;
     m_eof = false;
 
     return 0;
@@ -1147,6 +1610,22 @@ String NeonFile::get_metadata (const char * field)
     if (! strcmp (field, "content-bitrate"))
         return String (int_to_str (m_icy_metadata.stream_bitrate * 1000));
 
+    if (! strcmp (field, "buffer-fill") || ! strcmp (field, "buffer-size"))
+    {
+        pthread_mutex_lock (& m_reader_status.mutex);
+        int value = ! strcmp (field, "buffer-size") ? m_rb.size () :
+         (int) ((int64_t) 100 * m_rb.len () / m_rb.size ());
+        pthread_mutex_unlock (& m_reader_status.mutex);
+
+        return String (int_to_str (value));
+    }
+
+    if (! strcmp (field, "buffer-underruns"))
+        return String (int_to_str (m_underruns));
+
+    if (! strcmp (field, "stream-reconnects"))
+        return String (int_to_str (m_reconnects));
+
     return String ();
 }
 
@@ -38,6 +38,8 @@ static bool force_apply = false;
 static constexpr const char *CFG_SECTION               = "openmpt";
 static constexpr const char *SETTING_STEREO_SEPARATION = "stereo_separation";
 static constexpr const char *SETTING_INTERPOLATOR      = "interpolator";
+static constexpr const char *SETTING_CHANNELS          = "channels";
+static constexpr const char *SETTING_BLOCK_SIZE        = "block_size";
 
 class MPTPlugin : public InputPlugin
 {
@@ -66,6 +68,8 @@ public:
         {
             SETTING_STEREO_SEPARATION, aud::numeric_string<MPTWrap::default_stereo_separation>::str,
             SETTING_INTERPOLATOR, aud::numeric_string<MPTWrap::default_interpolator>::str,
+            SETTING_CHANNELS, aud::numeric_string<MPTWrap::default_channels>::str,
+            SETTING_BLOCK_SIZE, aud::numeric_string<MPTWrap::default_block_size>::str,
             nullptr,
         };
 
@@ -76,16 +80,17 @@ public:
 
     bool is_our_file(const char *filename, VFSFile &file)
     {
-        MPTWrap mpt;
-        return mpt.open(file);
+        return MPTWrap::probe(file);
     }
 
     bool read_tag(const char *filename, VFSFile &file, Tuple &tuple, Index<char> *)
     {
         MPTWrap mpt;
-        if (!mpt.open(file))
+        if (!mpt.open(file, true))
             return false;
 
+        mpt.set_channels(aud_get_int(CFG_SECTION, SETTING_CHANNELS));
+
         tuple.set_filename(filename);
         tuple.set_format(mpt.format(), mpt.channels(), mpt.rate(), 0);
         tuple.set_int(Tuple::Length, mpt.duration());
@@ -105,11 +110,15 @@ public:
 
         force_apply = true;
 
+        mpt.set_channels(aud_get_int(CFG_SECTION, SETTING_CHANNELS));
         open_audio(FMT_FLOAT, mpt.rate(), mpt.channels());
 
+        int block_size = aud::clamp(aud_get_int(CFG_SECTION, SETTING_BLOCK_SIZE), 256, 65536);
+        Index<float> buffer;
+        buffer.resize(block_size * mpt.channels());
+
         while (!check_stop())
         {
-            float buffer[16384];
             int seek_value = check_seek();
 
             if (seek_value >= 0)
@@ -122,11 +131,11 @@ public:
                 force_apply = false;
             }
 
-            auto n = mpt.read(buffer, aud::n_elems(buffer));
+            auto n = mpt.read(buffer.begin(), buffer.len());
             if (n == 0)
                 break;
 
-            write_audio(buffer, n * sizeof buffer[0]);
+            write_audio(buffer.begin(), n * sizeof buffer[0]);
         }
 
         return true;
@@ -160,6 +169,16 @@ const PreferencesWidget MPTPlugin::widgets[] =
             N_("Interpolation:"),
             WidgetInt(CFG_SECTION, SETTING_INTERPOLATOR, values_changed),
             { MPTWrap::interpolators }
+    ),
+    WidgetCombo(
+            N_("Output channels:"),
+            WidgetInt(CFG_SECTION, SETTING_CHANNELS),
+            { MPTWrap::channel_modes }
+    ),
+    WidgetSpin(
+            N_("Render block size:"),
+            WidgetInt(CFG_SECTION, SETTING_BLOCK_SIZE),
+            { 256.0, 65536.0, 256.0, N_("samples") }
     )
 };
 
@@ -32,6 +32,7 @@
 #include "mptwrap.h"
 
 constexpr ComboItem MPTWrap::interpolators[];
+constexpr ComboItem MPTWrap::channel_modes[];
 constexpr openmpt_stream_callbacks MPTWrap::callbacks;
 
 static String to_aud_str(const char * str)
@@ -41,14 +42,48 @@ static String to_aud_str(const char * str)
     return aud_str;
 }
 
-bool MPTWrap::open(VFSFile &file)
+// Check the file header only, without loading the whole module.  Files
+// which are too short to tell are loaded to be sure.
+bool MPTWrap::probe(VFSFile &file)
+{
+#if OPENMPT_API_VERSION_MAJOR <= 0 && OPENMPT_API_VERSION_MINOR < 3
+    MPTWrap mpt;
+    return mpt.open(file, true);
+#else
+    int result = openmpt_probe_file_header_from_stream(OPENMPT_PROBE_FILE_HEADER_FLAGS_DEFAULT,
+     callbacks, &file, openmpt_log_func_silent, nullptr, nullptr, nullptr, nullptr, nullptr);
+
+    if (result == OPENMPT_PROBE_FILE_HEADER_RESULT_SUCCESS)
+        return true;
+
+    if (result != OPENMPT_PROBE_FILE_HEADER_RESULT_WANTMOREDATA)
+        return false;
+
+    if (file.fseek(0, VFS_SEEK_SET) < 0)
+        return false;
+
+    MPTWrap mpt;
+    return mpt.open(file, true);
+#endif
+}
+
+// When only the metadata is needed, sample data and plugins are skipped,
+// which makes scanning large libraries much faster.
+bool MPTWrap::open(VFSFile &file, bool metadata_only)
 {
 #if OPENMPT_API_VERSION_MAJOR <= 0 && OPENMPT_API_VERSION_MINOR < 3
     auto m = openmpt_module_create(callbacks, &file, openmpt_log_func_silent,
      nullptr, nullptr);
 #else
+    static constexpr openmpt_module_initial_ctl metadata_ctls[] =
+    {
+        {"load.skip_samples", "1"},
+        {"load.skip_plugins", "1"},
+        {nullptr, nullptr}
+    };
+
     auto m = openmpt_module_create2(callbacks, &file, openmpt_log_func_silent,
-     nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
+     nullptr, nullptr, nullptr, nullptr, nullptr, metadata_only ? metadata_ctls : nullptr);
 #endif
 
     if (m == nullptr)
@@ -106,12 +141,38 @@ void MPTWrap::set_stereo_separation(int separation)
          OPENMPT_MODULE_RENDER_STEREOSEPARATION_PERCENT, separation);
 }
 
-int64_t MPTWrap::read(float *buf, int64_t bufcnt)
+bool MPTWrap::is_valid_channels(int channels)
+{
+    return std::any_of(std::begin(channel_modes), std::end(channel_modes),
+     [channels](const ComboItem &ci) { return ci.num == channels; });
+}
+
+void MPTWrap::set_channels(int channels)
 {
-    auto n = openmpt_module_read_interleaved_float_stereo(mod.get(), rate(),
-     bufcnt / channels(), buf);
+    if (is_valid_channels(channels))
+        m_channels = channels;
+}
 
-    return n * channels();
+int64_t MPTWrap::read(float *buf, int64_t bufcnt)
+{
+    size_t n;
+
+    switch (m_channels)
+    {
+    case 1:
+        n = openmpt_module_read_float_mono(mod.get(), rate(), bufcnt, buf);
+        break;
+    case 4:
+        n = openmpt_module_read_interleaved_float_quad(mod.get(), rate(),
+         bufcnt / 4, buf);
+        break;
+    default:
+        n = openmpt_module_read_interleaved_float_stereo(mod.get(), rate(),
+         bufcnt / 2, buf);
+        break;
+    }
+
+    return n * m_channels;
 }
 
 void MPTWrap::seek(int pos)
@@ -44,6 +44,8 @@ public:
 
     static constexpr int default_interpolator = interp_windowed;
     static constexpr int default_stereo_separation = 100;
+    static constexpr int default_channels = 2;
+    static constexpr int default_block_size = 8192;
 
     static constexpr ComboItem interpolators[] =
     {
@@ -53,18 +55,29 @@ public:
         {N_("Windowed sinc"), interp_windowed}
     };
 
+    static constexpr ComboItem channel_modes[] =
+    {
+        {N_("Mono"),   1},
+        {N_("Stereo"), 2},
+        {N_("Quad"),   4}
+    };
+
     static bool is_valid_interpolator(int);
     void set_interpolator(int);
 
     static bool is_valid_stereo_separation(int);
     void set_stereo_separation(int);
 
-    bool open(VFSFile &);
+    static bool is_valid_channels(int);
+    void set_channels(int);
+
+    static bool probe(VFSFile &);
+    bool open(VFSFile &, bool metadata_only = false);
     int64_t read(float *, int64_t);
     void seek(int pos);
 
     static constexpr int rate() { return 48000; }
-    static constexpr int channels() { return 2; }
+    int channels() const { return m_channels; }
 
     int duration() const { return m_duration; }
     const String & title() const { return m_title; }
@@ -80,6 +93,7 @@ private:
 
     SmartPtr<openmpt_module, openmpt_module_destroy> mod;
 
+    int m_channels = default_channels;
     int m_duration = 0;
     String m_title;
     String m_format;
@@ -30,14 +30,15 @@
 #include <libaudcore/plugin.h>
 #include <libaudqt/libaudqt.h>
 
+#include "../vis-common/spectrum.h"
+
 #define MAX_BANDS   (256)
 #define VIS_DELAY 2 /* delay before falloff in frames */
 #define VIS_FALLOFF 2 /* falloff in pixels per frame */
 
-static float xscale[MAX_BANDS + 1];
+static LogBands log_bands;
 static int bands;
-static int bars[MAX_BANDS + 1];
-static int delay[MAX_BANDS + 1];
+static FalloffBars bars (VIS_FALLOFF, VIS_DELAY);
 
 class SpectrumWidget : public QWidget
 {
@@ -79,8 +80,8 @@ void SpectrumWidget::paint_spectrum (QPainter & p)
         int x = ((width () / bands) * i) + 2;
         auto color = audqt::vis_bar_color (palette ().color (QPalette::Highlight), i, bands);
 
-        p.fillRect (x + 1, height () - (bars[i] * height () / 40),
-         (width () / bands) - 1, (bars[i] * height () / 40), color);
+        p.fillRect (x + 1, height () - ((int) bars[i] * height () / 40),
+         (width () / bands) - 1, ((int) bars[i] * height () / 40), color);
     }
 }
 
@@ -88,7 +89,8 @@ void SpectrumWidget::resizeEvent (QResizeEvent * event)
 {
     bands = width () / 10;
     bands = aud::clamp(bands, 12, MAX_BANDS);
-    Visualizer::compute_log_xscale (xscale, bands);
+    log_bands.set_bands (bands);
+    bars.resize (bands);
     update ();
 }
 
@@ -126,23 +128,14 @@ void QtSpectrum::render_freq (const float * freq)
     if (! bands)
         return;
 
-    for (int i = 0; i < bands; i ++)
-    {
-        /* 40 dB range */
-        int x = 40 + compute_freq_band (freq, xscale, i, bands);
-        x = aud::clamp (x, 0, 40);
-
-        bars[i] -= aud::max (0, VIS_FALLOFF - delay[i]);
+    float levels[MAX_BANDS];
+    log_bands.compute (freq, levels);
 
-        if (delay[i])
-            delay[i]--;
+    /* 40 dB range */
+    for (int i = 0; i < bands; i ++)
+        levels[i] = aud::clamp ((int) (40 + levels[i]), 0, 40);
 
-        if (x > bars[i])
-        {
-            bars[i] = x;
-            delay[i] = VIS_DELAY;
-        }
-    }
+    bars.update (levels);
 
     if (spect_widget)
         spect_widget->update ();
@@ -150,8 +143,7 @@ void QtSpectrum::render_freq (const float * freq)
 
 void QtSpectrum::clear ()
 {
-    memset (bars, 0, sizeof bars);
-    memset (delay, 0, sizeof delay);
+    bars.clear ();
 
     if (spect_widget)
         spect_widget->update ();
@@ -31,6 +31,8 @@
 #include <QOpenGLWidget>
 #include <QOpenGLFunctions_2_0>
 
+#include "../vis-common/spectrum.h"
+
 #define NUM_BANDS 32
 #define DB_RANGE 40
 
@@ -69,7 +71,7 @@ public:
 
 EXPORT GLSpectrumQt aud_plugin_instance;
 
-static float logscale[NUM_BANDS + 1];
+static LogBands log_bands;
 static float colors[NUM_BANDS][NUM_BANDS][3];
 
 static int s_pos = 0;
@@ -97,8 +99,7 @@ GLSpectrumWidget * s_widget = nullptr;
 
 bool GLSpectrumQt::init ()
 {
-    for (int i = 0; i <= NUM_BANDS; i ++)
-        logscale[i] = powf (256, (float) i / NUM_BANDS) - 0.5f;
+    log_bands.set_bands (NUM_BANDS);
 
     for (int y = 0; y < NUM_BANDS; y ++)
     {
@@ -117,47 +118,9 @@ bool GLSpectrumQt::init ()
     return true;
 }
 
-/* stolen from the skins plugin */
-/* convert linear frequency graph to logarithmic one */
-static void make_log_graph (const float * freq, float * graph)
-{
-    for (int i = 0; i < NUM_BANDS; i ++)
-    {
-        /* sum up values in freq array between logscale[i] and logscale[i + 1],
-           including fractional parts */
-        int a = ceilf (logscale[i]);
-        int b = floorf (logscale[i + 1]);
-        float sum = 0;
-
-        if (b < a)
-            sum += freq[b] * (logscale[i + 1] - logscale[i]);
-        else
-        {
-            if (a > 0)
-                sum += freq[a - 1] * (a - logscale[i]);
-            for (; a < b; a ++)
-                sum += freq[a];
-            if (b < 256)
-                sum += freq[b] * (logscale[i + 1] - b);
-        }
-
-        /* fudge factor to make the graph have the same overall height as a
-           12-band one no matter how many bands there are */
-        sum *= (float) NUM_BANDS / 12;
-
-        /* convert to dB */
-        float val = 20 * log10f (sum);
-
-        /* scale (-DB_RANGE, 0.0) to (0.0, 1.0) */
-        val = 1 + val / DB_RANGE;
-
-        graph[i] = aud::clamp (val, 0.0f, 1.0f);
-    }
-}
-
 void GLSpectrumQt::render_freq (const float * freq)
 {
-    make_log_graph (freq, s_bars[s_pos]);
+    log_bands.compute_scaled (freq, DB_RANGE, s_bars[s_pos]);
     s_pos = (s_pos + 1) % NUM_BANDS;
 
     s_angle += s_anglespeed;
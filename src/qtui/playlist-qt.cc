@@ -43,6 +43,7 @@ PlaylistWidget::PlaylistWidget(QWidget * parent, Playlist playlist)
 
     /* setting up filtering model */
     proxyModel->setSourceModel(model);
+    proxyModel->setFilterReadyFunc([this]() { applyFilter(); });
 
     inUpdate = true; /* prevents changing focused row */
     setModel(proxyModel);
@@ -430,6 +431,8 @@ void PlaylistWidget::playlistUpdate()
     if (update.level == Playlist::NoUpdate)
         return;
 
+    proxyModel->playlistUpdate(update);
+
     inUpdate = true;
 
     int entries = m_playlist.n_entries();
@@ -479,6 +482,13 @@ void PlaylistWidget::playlistUpdate()
 }
 
 void PlaylistWidget::setFilter(const char * text)
+{
+    // The filter is applied later, once matching has finished in the
+    // background.  This keeps typing responsive on a large playlist.
+    proxyModel->setFilter(text);
+}
+
+void PlaylistWidget::applyFilter()
 {
     // Save the current focus before filtering
     int focus = m_playlist.get_focus();
@@ -489,7 +499,7 @@ void PlaylistWidget::setFilter(const char * text)
     model->entriesRemoved(0, model->rowCount());
 
     // Update the filter
-    proxyModel->setFilter(text);
+    proxyModel->applyFilter();
 
     // Repopulate the model
     model->entriesAdded(0, m_playlist.n_entries());
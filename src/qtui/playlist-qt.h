@@ -69,6 +69,7 @@ private:
                            QItemSelection & selected,
                            QItemSelection & deselected);
     void updateSelection(int rowsBefore, int rowsAfter);
+    void applyFilter();
 
     void changeEvent(QEvent * event) override;
     void contextMenuEvent(QContextMenuEvent * event) override;
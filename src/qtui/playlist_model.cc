@@ -17,6 +17,9 @@
  * the use of this software.
  */
 
+#include <atomic>
+#include <string.h>
+
 #include <QApplication>
 #include <QIcon>
 #include <QMimeData>
@@ -43,10 +46,16 @@ static const Tuple::Field s_fields[] = {
     Tuple::FormattedTitle, Tuple::Bitrate,     Tuple::Comment, Tuple::Publisher,
     Tuple::CatalogNum,     Tuple::Disc};
 
+// size of the display cache, and how many of its rows are kept behind the
+// direction of scrolling
+static constexpr int s_cache_rows = 256;
+static constexpr int s_cache_behind = 32;
+
 static_assert(aud::n_elems(PlaylistModel::labels) == PlaylistModel::n_cols,
               "update PlaylistModel::labels");
 static_assert(aud::n_elems(s_fields) == PlaylistModel::n_cols,
               "update s_fields");
+static_assert(PlaylistModel::n_cols <= 32, "update PlaylistModel::CachedRow");
 
 PlaylistModel::PlaylistModel(QObject * parent, Playlist playlist)
     : QAbstractListModel(parent), m_playlist(playlist),
@@ -95,30 +104,11 @@ QVariant PlaylistModel::data(const QModelIndex & index, int role) const
     if (col < 0 || col >= n_cols)
         return QVariant();
 
-    Tuple tuple;
-    int val = -1;
-
     switch (role)
     {
     case Qt::DisplayRole:
         if (s_fields[col] != Tuple::Invalid)
-        {
-            tuple = m_playlist.entry_tuple(index.row(), Playlist::NoWait);
-
-            if (col == Filename)
-                return filename(tuple);
-
-            switch (tuple.get_value_type(s_fields[col]))
-            {
-            case Tuple::Empty:
-                return QVariant();
-            case Tuple::String:
-                return QString(tuple.get_str(s_fields[col]));
-            case Tuple::Int:
-                val = tuple.get_int(s_fields[col]);
-                break;
-            }
-        }
+            return cachedCell(index.row(), col);
 
         switch (col)
         {
@@ -126,12 +116,8 @@ QVariant PlaylistModel::data(const QModelIndex & index, int role) const
             return QVariant(index.row() + 1);
         case QueuePos:
             return queuePos(index.row());
-        case Length:
-            return QString(str_format_time(val));
-        case Bitrate:
-            return QString(str_printf(_("%d kbit/s"), val));
         default:
-            return QVariant(val);
+            return QVariant();
         }
 
     case Qt::FontRole:
@@ -257,11 +243,113 @@ bool PlaylistModel::dropMimeData(const QMimeData * data, Qt::DropAction action,
     return true;
 }
 
+QVariant PlaylistModel::cellValue(const Tuple & tuple, int col) const
+{
+    if (col == Filename)
+        return filename(tuple);
+
+    int val = -1;
+
+    switch (tuple.get_value_type(s_fields[col]))
+    {
+    case Tuple::Empty:
+        return QVariant();
+    case Tuple::String:
+        return QString(tuple.get_str(s_fields[col]));
+    case Tuple::Int:
+        val = tuple.get_int(s_fields[col]);
+        break;
+    }
+
+    switch (col)
+    {
+    case Length:
+        return QString(str_format_time(val));
+    case Bitrate:
+        return QString(str_printf(_("%d kbit/s"), val));
+    default:
+        return QVariant(val);
+    }
+}
+
+void PlaylistModel::fillRow(CachedRow & cached, int row) const
+{
+    cached.tuple = m_playlist.entry_tuple(row, Playlist::NoWait);
+    cached.valid = true;
+    cached.filled = 0;
+
+    // convert the columns that have been shown so far
+    for (int col = 0; col < n_cols; col++)
+    {
+        if (m_usedCols & (1u << col))
+        {
+            cached.cells[col] = cellValue(cached.tuple, col);
+            cached.filled |= 1u << col;
+        }
+    }
+}
+
+// Moves the cache window so that it covers <row>, extending further in the
+// direction of scrolling, and fetches the rows not already cached.
+void PlaylistModel::fillCache(int row) const
+{
+    int first = (row >= m_lastRow) ? row - s_cache_behind
+                                   : row - s_cache_rows + s_cache_behind + 1;
+
+    first = aud::clamp(first, 0, aud::max(m_rows - s_cache_rows, 0));
+    int count = aud::min(s_cache_rows, m_rows - first);
+
+    Index<CachedRow> cache;
+    cache.insert(0, count);
+
+    for (int i = 0; i < count; i++)
+    {
+        int old = first + i - m_cacheFirst;
+        if (old >= 0 && old < m_cache.len() && m_cache[old].valid)
+            cache[i] = std::move(m_cache[old]);
+        else
+            fillRow(cache[i], first + i);
+    }
+
+    m_cache = std::move(cache);
+    m_cacheFirst = first;
+}
+
+QVariant PlaylistModel::cachedCell(int row, int col) const
+{
+    if (row < 0 || row >= m_rows)
+        return QVariant();
+
+    if (row < m_cacheFirst || row >= m_cacheFirst + m_cache.len())
+        fillCache(row);
+
+    m_lastRow = row;
+    m_usedCols |= 1u << col;
+
+    CachedRow & cached = m_cache[row - m_cacheFirst];
+
+    if (!cached.valid)
+        fillRow(cached, row);
+
+    if (!(cached.filled & (1u << col)))
+    {
+        cached.cells[col] = cellValue(cached.tuple, col);
+        cached.filled |= 1u << col;
+    }
+
+    return cached.cells[col];
+}
+
 void PlaylistModel::entriesAdded(int row, int count)
 {
     if (count < 1)
         return;
 
+    if (row <= m_cacheFirst)
+        m_cacheFirst += count;
+    else if (row < m_cacheFirst + m_cache.len())
+        m_cache.clear();
+
     int last = row + count - 1;
     beginInsertRows(QModelIndex(), row, last);
     m_rows += count;
@@ -273,6 +361,11 @@ void PlaylistModel::entriesRemoved(int row, int count)
     if (count < 1)
         return;
 
+    if (row + count <= m_cacheFirst)
+        m_cacheFirst -= count;
+    else if (row < m_cacheFirst + m_cache.len())
+        m_cache.clear();
+
     int last = row + count - 1;
     beginRemoveRows(QModelIndex(), row, last);
     m_rows -= count;
@@ -284,6 +377,12 @@ void PlaylistModel::entriesChanged(int row, int count)
     if (count < 1)
         return;
 
+    int from = aud::max(row - m_cacheFirst, 0);
+    int to = aud::min(row + count - m_cacheFirst, m_cache.len());
+
+    for (int i = from; i < to; i++)
+        m_cache[i].valid = false;
+
     int bottom = row + count - 1;
     auto topLeft = createIndex(row, 0);
     auto bottomRight = createIndex(bottom, columnCount() - 1);
@@ -314,13 +413,254 @@ QString PlaylistModel::filename(const Tuple & tuple) const
 
 /* ---------------------------------- */
 
+// Search text is folded to lower case once per row and then matched with
+// plain strstr().  The fields are separated by newlines so that a search term
+// never matches across two of them.
+static const Tuple::Field s_search_fields[] = {Tuple::Title, Tuple::Artist,
+                                               Tuple::Album, Tuple::Basename};
+
+// rows are matched in chunks so that a running search can be cancelled
+static constexpr int s_filter_chunk = 4096;
+
+enum
+{
+    NoMatch,
+    Match,
+    Unknown, // not matched against the current search terms
+    Changed  // changed since the running search was started
+};
+
+struct PlaylistProxyModel::FilterJob
+{
+    Index<String> terms;
+    Index<String> haystacks; // empty where the tuple must be folded
+    Index<Tuple> tuples;
+    Index<char> matches;
+    bool narrow = false;
+    std::atomic<bool> cancel{false};
+};
+
+static String make_haystack(const Tuple & tuple)
+{
+    StringBuf text;
+
+    for (auto field : s_search_fields)
+    {
+        String str = tuple.get_str(field);
+        if (str)
+        {
+            text.insert(-1, str);
+            text.insert(-1, "\n");
+        }
+    }
+
+    return String(str_tolower_utf8(text));
+}
+
+static bool match_terms(const char * haystack, const Index<String> & terms)
+{
+    for (auto & term : terms)
+    {
+        if (!strstr(haystack, term))
+            return false;
+    }
+
+    return true;
+}
+
+// true if every row matching <terms> also matches <prev>; in that case only
+// rows which matched <prev> need to be checked again
+static bool narrows(const Index<String> & terms, const Index<String> & prev)
+{
+    for (auto & p : prev)
+    {
+        bool found = false;
+
+        for (auto & term : terms)
+        {
+            if (strstr(term, p))
+            {
+                found = true;
+                break;
+            }
+        }
+
+        if (!found)
+            return false;
+    }
+
+    return true;
+}
+
+// runs in the filter thread; returns false if cancelled
+bool PlaylistProxyModel::runJob(FilterJob * job)
+{
+    int rows = job->matches.len();
+
+    for (int row = 0; row < rows; row++)
+    {
+        if (!(row % s_filter_chunk) && job->cancel)
+            return false;
+
+        if (job->narrow && job->matches[row] == NoMatch)
+            continue;
+
+        String & haystack = job->haystacks[row];
+        if (!haystack)
+            haystack = make_haystack(job->tuples[row]);
+
+        job->matches[row] = match_terms(haystack, job->terms) ? Match : NoMatch;
+    }
+
+    return !job->cancel;
+}
+
+PlaylistProxyModel::PlaylistProxyModel(QObject * parent, Playlist playlist)
+    : QSortFilterProxyModel(parent), m_playlist(playlist)
+{
+    int entries = playlist.n_entries();
+
+    m_haystacks.insert(0, entries);
+    m_matches.insert(0, entries);
+
+    for (char & match : m_matches)
+        match = Unknown;
+}
+
+PlaylistProxyModel::~PlaylistProxyModel() { stopJob(); }
+
 void PlaylistProxyModel::setFilter(const char * filter)
+{
+    Index<String> terms;
+    for (auto & term : str_list_to_index(filter, " "))
+        terms.append(String(str_tolower_utf8(term)));
+
+    auto same_terms = [&terms](const Index<String> & other) {
+        if (terms.len() != other.len())
+            return false;
+
+        for (int i = 0; i < terms.len(); i++)
+        {
+            if (strcmp(terms[i], other[i]))
+                return false;
+        }
+
+        return true;
+    };
+
+    if (same_terms(m_job ? m_pendingTerms : m_searchTerms))
+        return;
+
+    stopJob();
+    m_pendingTerms = std::move(terms);
+
+    if (m_pendingTerms.len())
+        startJob();
+    else if (m_filterReady)
+        m_filterReady();
+}
+
+void PlaylistProxyModel::startJob()
+{
+    auto job = new FilterJob;
+
+    for (auto & term : m_pendingTerms)
+        job->terms.append(term);
+
+    job->narrow = narrows(m_pendingTerms, m_searchTerms);
+
+    int rows = m_matches.len();
+    job->haystacks.insert(0, rows);
+    job->tuples.insert(0, rows);
+    job->matches.insert(0, rows);
+
+    for (int row = 0; row < rows; row++)
+    {
+        if (m_matches[row] == Changed)
+            m_matches[row] = Unknown;
+
+        job->matches[row] = m_matches[row];
+
+        if (job->narrow && m_matches[row] == NoMatch)
+            continue;
+
+        if (m_haystacks[row])
+            job->haystacks[row] = m_haystacks[row];
+        else
+            job->tuples[row] = m_playlist.entry_tuple(row, Playlist::NoWait);
+    }
+
+    m_job.capture(job);
+    m_jobEdits.clear();
+    m_thread = std::thread([this, job]() {
+        if (runJob(job))
+            m_jobDone.queue([this]() { finishJob(); });
+    });
+}
+
+void PlaylistProxyModel::stopJob()
+{
+    if (!m_job)
+        return;
+
+    m_job->cancel = true;
+    m_thread.join();
+    m_jobDone.stop();
+    m_job.clear();
+    m_jobEdits.clear();
+}
+
+void PlaylistProxyModel::finishJob()
+{
+    m_thread.join();
+
+    // bring the results in line with the playlist if it was restructured
+    // meanwhile; rows added since are left to filterAcceptsRow()
+    for (auto & edit : m_jobEdits)
+    {
+        m_job->haystacks.remove(edit.pos, edit.removed);
+        m_job->haystacks.insert(edit.pos, edit.added);
+        m_job->matches.remove(edit.pos, edit.removed);
+        m_job->matches.insert(edit.pos, edit.added);
+    }
+
+    m_jobEdits.clear();
+
+    if (m_filterReady)
+        m_filterReady();
+    else
+        applyFilter();
+}
+
+void PlaylistProxyModel::applyFilter()
 {
 #if QT_VERSION >= QT_VERSION_CHECK(6, 10, 0)
     beginFilterChange();
 #endif
 
-    m_searchTerms = str_list_to_index(filter, " ");
+    if (m_job)
+    {
+        for (int row = 0; row < m_matches.len(); row++)
+        {
+            if (m_matches[row] == Changed)
+                continue;
+
+            if (!m_haystacks[row])
+                m_haystacks[row] = std::move(m_job->haystacks[row]);
+
+            m_matches[row] = m_job->matches[row];
+        }
+
+        m_job.clear();
+    }
+    else
+    {
+        // every row matches an empty search
+        for (char & match : m_matches)
+            match = Match;
+    }
+
+    m_searchTerms = std::move(m_pendingTerms);
 
 #if QT_VERSION >= QT_VERSION_CHECK(6, 10, 0)
     endFilterChange(QSortFilterProxyModel::Direction::Rows);
@@ -329,35 +669,59 @@ void PlaylistProxyModel::setFilter(const char * filter)
 #endif
 }
 
+void PlaylistProxyModel::playlistUpdate(const Playlist::Update & update)
+{
+    int entries = m_playlist.n_entries();
+    int changed = entries - update.before - update.after;
+
+    if (update.level == Playlist::Structure)
+    {
+        int removed = m_matches.len() - update.before - update.after;
+
+        m_haystacks.remove(update.before, removed);
+        m_haystacks.insert(update.before, changed);
+        m_matches.remove(update.before, removed);
+        m_matches.insert(update.before, changed);
+
+        if (m_job)
+            m_jobEdits.append(RowEdit{update.before, removed, changed});
+    }
+    else if (update.level == Playlist::Metadata)
+    {
+        for (int row = update.before; row < update.before + changed; row++)
+            m_haystacks[row] = String();
+    }
+    else
+        return;
+
+    for (int row = update.before; row < update.before + changed; row++)
+        m_matches[row] = Changed;
+}
+
 bool PlaylistProxyModel::filterAcceptsRow(int source_row,
                                           const QModelIndex &) const
 {
     if (!m_searchTerms.len())
         return true;
 
-    Tuple tuple = m_playlist.entry_tuple(source_row);
+    if (source_row >= m_matches.len())
+        return false;
 
-    String strings[] = {tuple.get_str(Tuple::Title),
-                        tuple.get_str(Tuple::Artist),
-                        tuple.get_str(Tuple::Album),
-                        tuple.get_str(Tuple::Basename)};
+    char & match = m_matches[source_row];
+    if (match == Match || match == NoMatch)
+        return match == Match;
 
-    for (auto & term : m_searchTerms)
-    {
-        bool found = false;
+    // changed since the last search; check this row right away
+    String & haystack = m_haystacks[source_row];
+    if (!haystack)
+        haystack = make_haystack(
+            m_playlist.entry_tuple(source_row, Playlist::NoWait));
 
-        for (auto & s : strings)
-        {
-            if (s && strstr_nocase_utf8(s, term))
-            {
-                found = true;
-                break;
-            }
-        }
+    bool found = match_terms(haystack, m_searchTerms);
 
-        if (!found)
-            return false;
-    }
+    // a running search will not have seen the change
+    if (!(m_job && match == Changed))
+        match = found ? Match : NoMatch;
 
-    return true;
+    return found;
 }
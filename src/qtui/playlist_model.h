@@ -20,9 +20,13 @@
 #ifndef PLAYLIST_MODEL_H
 #define PLAYLIST_MODEL_H
 
+#include <functional>
+#include <thread>
+
 #include <QAbstractListModel>
 #include <QSortFilterProxyModel>
 
+#include <libaudcore/mainloop.h>
 #include <libaudcore/playlist.h>
 
 class PlaylistModel : public QAbstractListModel
@@ -76,31 +80,78 @@ public:
     void setPlayingCol(int playing_col);
 
 private:
+    // converted cell values for a window of rows around the visible ones
+    struct CachedRow
+    {
+        Tuple tuple;
+        bool valid = false;
+        unsigned filled = 0; // bit mask of converted columns
+        QVariant cells[n_cols];
+    };
+
     Playlist m_playlist;
     int m_rows;
     QFont m_bold;
     int m_playing_col = -1;
 
+    mutable Index<CachedRow> m_cache;
+    mutable int m_cacheFirst = 0;
+    mutable int m_lastRow = 0;
+    mutable unsigned m_usedCols = 0;
+
     QVariant alignment(int col) const;
     QString queuePos(int row) const;
     QString filename(const Tuple & tuple) const;
+    QVariant cellValue(const Tuple & tuple, int col) const;
+    QVariant cachedCell(int row, int col) const;
+    void fillCache(int row) const;
+    void fillRow(CachedRow & cached, int row) const;
 };
 
 class PlaylistProxyModel : public QSortFilterProxyModel
 {
 public:
-    PlaylistProxyModel(QObject * parent, Playlist playlist)
-        : QSortFilterProxyModel(parent), m_playlist(playlist)
-    {
-    }
+    PlaylistProxyModel(QObject * parent, Playlist playlist);
+    ~PlaylistProxyModel();
 
+    // Matching runs in the background; the ready function is called (in
+    // the main thread) once the results can be shown with applyFilter().
     void setFilter(const char * filter);
+    void setFilterReadyFunc(std::function<void()> func) { m_filterReady = func; }
+    void applyFilter();
+
+    // must be called before the source model is updated
+    void playlistUpdate(const Playlist::Update & update);
 
 private:
+    struct FilterJob;
+
+    // a structural change made to the playlist while a job was running
+    struct RowEdit
+    {
+        int pos, removed, added;
+    };
+
     bool filterAcceptsRow(int source_row, const QModelIndex &) const;
 
+    static bool runJob(FilterJob * job);
+    void startJob();
+    void stopJob();
+    void finishJob();
+
     Playlist m_playlist;
-    Index<String> m_searchTerms;
+    Index<String> m_searchTerms;  // case-folded, currently shown
+    Index<String> m_pendingTerms; // case-folded, being matched
+
+    // per-row search text and match state, kept in step with the playlist
+    mutable Index<String> m_haystacks;
+    mutable Index<char> m_matches;
+
+    SmartPtr<FilterJob> m_job;
+    Index<RowEdit> m_jobEdits;
+    std::thread m_thread;
+    QueuedFunc m_jobDone;
+    std::function<void()> m_filterReady;
 };
 
 #endif
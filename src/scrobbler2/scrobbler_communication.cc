@@ -8,12 +8,14 @@
  */
 
 //external includes
+#include <errno.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <sys/time.h>
 #include <curl/curl.h>
 
 #include <glib.h>
+#include <glib/gstdio.h>
 
 //audacious includes
 #include <libaudcore/audstrings.h>
@@ -27,7 +29,17 @@ typedef struct {
     String argument;
 } API_Parameter;
 
+#define SCROBBLE_BATCH_SIZE 50 //the most tracks last.fm accepts in one request
+
+//the dealt-with start of scrobbler.log is removed once it grows this large
+#define COMPACT_OFFSET (256 * 1024)
+
+//delay before retrying after a failure, doubled on each failure in a row
+#define MIN_RETRY_DELAY 7
+#define MAX_RETRY_DELAY (30 * 60)
+
 static CURL *curlHandle = nullptr;     //global handle holding cURL options
+static int retry_delay = 0;            //seconds; 0 after a success
 
 gboolean scrobbling_enabled = true;
 
@@ -83,32 +95,21 @@ static char * scrobbler_get_signature (Index<API_Parameter> & params)
  *
  * Returns nullptr if an error occurrs
  */
-static String create_message_to_lastfm (const char * method_name, int n_args, ...)
+static String create_message_to_lastfm (const char * method_name, Index<API_Parameter> & params)
 {
-    Index<API_Parameter> params;
-    params.append (String ("method"), String (method_name));
-
     StringBuf buf = str_concat ({"method=", method_name});
 
-    va_list vl;
-    va_start (vl, n_args);
-
-    for (int i = 0; i < n_args; i ++)
+    for (const API_Parameter & param : params)
     {
-        const char * name = va_arg (vl, const char *);
-        const char * arg = va_arg (vl, const char *);
-
-        params.append (String (name), String (arg));
-
-        char * esc = curl_easy_escape (curlHandle, arg, 0);
+        char * esc = curl_easy_escape (curlHandle, param.argument, 0);
         buf.insert (-1, "&");
-        buf.insert (-1, name);
+        buf.insert (-1, param.paramName);
         buf.insert (-1, "=");
         buf.insert (-1, esc ? esc : "");
         curl_free (esc);
     }
 
-    va_end (vl);
+    params.append (String ("method"), String (method_name));
 
     char * api_sig = scrobbler_get_signature (params);
     buf.insert (-1, "&api_sig=");
@@ -120,6 +121,26 @@ static String create_message_to_lastfm (const char * method_name, int n_args, ..
     return String (buf);
 }
 
+static String create_message_to_lastfm (const char * method_name, int n_args, ...)
+{
+    Index<API_Parameter> params;
+
+    va_list vl;
+    va_start (vl, n_args);
+
+    for (int i = 0; i < n_args; i ++)
+    {
+        const char * name = va_arg (vl, const char *);
+        const char * arg = va_arg (vl, const char *);
+
+        params.append (String (name), String (arg));
+    }
+
+    va_end (vl);
+
+    return create_message_to_lastfm (method_name, params);
+}
+
 static gboolean send_message_to_lastfm (const char * data)
 {
     AUDDBG("This message will be sent to last.fm:\n%s\n%%%%End of message%%%%\n", data);//Enter?\n", data);
@@ -270,7 +291,10 @@ gboolean scrobbler_communication_init() {
         return false;
     }
 
-    curl_requests_result = curl_easy_setopt(curlHandle, CURLOPT_URL, SCROBBLER_URL);
+    //the API address can be overridden to test against a local server
+    const char *url = getenv("AUD_SCROBBLER_URL");
+
+    curl_requests_result = curl_easy_setopt(curlHandle, CURLOPT_URL, url ? url : SCROBBLER_URL);
     if (curl_requests_result != CURLE_OK) {
         AUDDBG("Could not define scrobbler destination URL: %s.\n", curl_easy_strerror(curl_requests_result));
         return false;
@@ -298,210 +322,337 @@ static void set_timestamp_to_current(char **line) {
     g_strfreev(split_line);
 }
 
-static void delete_lines_from_scrobble_log (GSList **lines_to_remove_ptr, GSList **lines_to_retry_ptr, char *queuepath) {
-    GSList *lines_to_remove = *lines_to_remove_ptr;
-    GSList *lines_to_retry = *lines_to_retry_ptr;
+static gboolean is_valid_scrobble_format(char **line) {
+    if (line == nullptr) return false;
+
+    guint num_fields = g_strv_length(line);
+
+    //in normal circumstances cache entry is expected to have 8 fields,
+    //but allow entries with 7 fields (i.e. without album artist) for compatibility with old cache format
+    if (num_fields != 8 && num_fields != 7) return false;
+
+    //string literal "L" in the 6th field is part of scrobbler.log format
+    if (g_strcmp0(line[5], "L") != 0) return false;
+
+    //artist, title and timestamp are mandatory parameters of last.fm track.Scrobble API
+    if (!strlen(line[0]) || !strlen(line[2]) || !strlen(line[6])) return false;
+
+    return true;
+}
+
+/*
+ * scrobbler.log is only ever appended to.  Entries up to the offset stored in
+ * scrobbler.log.offset have been dealt with (scrobbled, rejected, or appended
+ * again to be retried later); the file is emptied once all of it is, and
+ * replaced by a copy of the rest once the offset grows large.
+ *
+ * The offset file also holds the inode of the log it refers to, so that an
+ * offset left over from before the log was replaced is not applied to the
+ * new one.
+ */
+typedef struct {
+    String line;
+    int64_t end;    //offset just past this entry in scrobbler.log
+} QueueEntry;
+
+static StringBuf get_offset_path(const char *queuepath) {
+    return str_concat({queuepath, ".offset"});
+}
+
+static guint64 get_log_inode(const char *queuepath) {
+    GStatBuf info;
+    return (g_stat(queuepath, &info) == 0) ? (guint64) info.st_ino : 0;
+}
+
+//call with log_access_mutex locked
+static int64_t read_committed_offset(const char *queuepath) {
     char *contents = nullptr;
-    char **lines = nullptr;
-    char **finallines = g_new (char *, 1);
-    int n_finallines;
+    int64_t offset = 0;
+
+    if (g_file_get_contents(get_offset_path(queuepath), &contents, nullptr, nullptr)) {
+        char *end;
+        offset = g_ascii_strtoll(contents, &end, 10);
 
-    if (lines_to_remove != nullptr) {
-        lines_to_remove = g_slist_reverse(lines_to_remove);
+        //older versions stored only the offset
+        if (*end == ' ' && g_ascii_strtoull(end + 1, nullptr, 10) != get_log_inode(queuepath))
+            offset = 0;
+
+        g_free(contents);
     }
-    if (lines_to_retry != nullptr) {
-        lines_to_retry = g_slist_reverse(lines_to_retry);
+
+    return offset;
+}
+
+//call with log_access_mutex locked
+static void write_committed_offset(const char *queuepath, int64_t offset) {
+    StringBuf offset_str = str_printf("%" G_GINT64_FORMAT " %" G_GUINT64_FORMAT,
+     offset, get_log_inode(queuepath));
+
+    if (!g_file_set_contents(get_offset_path(queuepath), offset_str, -1, nullptr))
+        AUDERR("Could not write to scrobbler.log.offset!\n");
+}
+
+//call with log_access_mutex locked
+//replaces the log by a new file holding only what follows offset
+static bool compact_scrobble_queue(const char *queuepath, int64_t offset) {
+    StringBuf temppath = str_concat({queuepath, ".tmp"});
+    FILE *in = g_fopen(queuepath, "rb");
+    FILE *out = g_fopen(temppath, "wb");
+    bool ok = (in != nullptr && out != nullptr && fseeko(in, offset, SEEK_SET) == 0);
+
+    char buf[65536];
+    size_t len;
+    while (ok && (len = fread(buf, 1, sizeof buf, in)) > 0)
+        ok = (fwrite(buf, 1, len, out) == len);
+
+    if (in != nullptr) {
+        ok = ok && !ferror(in);
+        fclose(in);
     }
+    if (out != nullptr && fclose(out) != 0)
+        ok = false;
+
+    //if the offset is not written after this, the inode no longer matches
+    //and the whole new log is sent again, which is what it holds anyway
+    if (ok && g_rename(temppath, queuepath) == 0)
+        return true;
+
+    AUDERR("Could not compact scrobbler.log.\n");
+    g_unlink(temppath);
+    return false;
+}
+
+//reads the entries which are not dealt with yet
+//unscrobbable lines are skipped, so they will be committed along with the next entry
+static Index<QueueEntry> read_scrobble_queue(const char *queuepath, int64_t &read_end) {
+    Index<QueueEntry> entries;
+    Index<char> data;
 
     pthread_mutex_lock(&log_access_mutex);
 
-    gboolean success = g_file_get_contents(queuepath, &contents, nullptr, nullptr);
-    if (!success) {
-        AUDDBG("Could not read scrobbler.log contents.\n");
-    } else {
-        lines = g_strsplit(contents, "\n", 0);
+    int64_t offset = read_committed_offset(queuepath);
+    FILE *f = g_fopen(queuepath, "rb");
 
-        n_finallines = 0;
-        for (int i = 0 ; lines[i] != nullptr; i++) {
-            if (!strlen(lines[i])) continue;
+    if (f != nullptr) {
+        //the log was removed or replaced since the offset was saved
+        if (fseeko(f, 0, SEEK_END) < 0 || ftello(f) < offset)
+            offset = 0;
 
-            if (lines_to_remove != nullptr && *((int *) (lines_to_remove->data)) == i) {
-                //this line is to remove
-                lines_to_remove = g_slist_next(lines_to_remove);
-            } else {
-                //keep this line
-                AUDDBG("Going to keep line %i\n", i);
-                if (lines_to_retry != nullptr && *((int *) (lines_to_retry->data)) == i) {
-                  lines_to_retry = g_slist_next(lines_to_retry);
-                  //this line will be retried with a zero timestamp
-                  AUDDBG("Going to zero this line.\n");
-                  AUDDBG("Line before: %s.\n", lines[i]);
-                  set_timestamp_to_current(&(lines[i]));
-                  AUDDBG("Line after: %s.\n", lines[i]);
-                } else {
-                  AUDDBG("not zeroing this line\n");
-                }
-                n_finallines++;
-                finallines = g_renew (char *, finallines, n_finallines);
-                finallines[n_finallines-1] = g_strdup(lines[i]);
-            }
+        if (fseeko(f, offset, SEEK_SET) == 0) {
+            char buf[65536];
+            size_t len;
+            while ((len = fread(buf, 1, sizeof buf, f)) > 0)
+                data.insert(buf, -1, len);
         }
 
-        finallines = g_renew (char *, finallines, n_finallines + 2);
-        finallines[n_finallines] = g_strdup("");
-        finallines[n_finallines+1] = nullptr;
-        g_free(contents);
-        contents = g_strjoinv("\n", finallines);
-        success = g_file_set_contents(queuepath, contents, -1, nullptr);
-        if (!success) {
-            AUDERR("Could not write to scrobbler.log!\n");
-        }
+        fclose(f);
     }
 
     pthread_mutex_unlock(&log_access_mutex);
 
-    g_strfreev(finallines);
-    g_strfreev(lines);
-    g_free(contents);
-}
+    read_end = offset;
 
-static void save_line_to_remove(GSList **lines_to_remove, int linenumber) {
-    int *rem = g_new (int, 1);
-    *rem = linenumber;
-    (*lines_to_remove) = g_slist_prepend((*lines_to_remove), rem);
-}
+    const char *start = data.begin();
+    const char *newline;
 
-static gboolean is_valid_scrobble_format(char **line) {
-    if (line == nullptr) return false;
+    //a line without newline may be still being written
+    while (start < data.end() && (newline = (const char *) memchr(start, '\n', data.end() - start))) {
+        StringBuf text = str_copy(start, newline - start);
+        read_end = offset + (newline + 1 - data.begin());
+        start = newline + 1;
 
-    guint num_fields = g_strv_length(line);
+        char **line = g_strsplit(text, "\t", 0);
 
-    //in normal circumstances cache entry is expected to have 8 fields,
-    //but allow entries with 7 fields (i.e. without album artist) for compatibility with old cache format
-    if (num_fields != 8 && num_fields != 7) return false;
-
-    //string literal "L" in the 6th field is part of scrobbler.log format
-    if (g_strcmp0(line[5], "L") != 0) return false;
+        if (is_valid_scrobble_format(line))
+            entries.append(String(text), read_end);
+        else if (text[0])
+            AUDDBG("Unscrobbable line.\n");
 
-    //artist, title and timestamp are mandatory parameters of last.fm track.Scrobble API
-    if (!strlen(line[0]) || !strlen(line[2]) || !strlen(line[6])) return false;
+        g_strfreev(line);
+    }
 
-    return true;
+    return entries;
 }
 
-static void scrobble_cached_queue() {
-    char *queuepath = g_build_filename(aud_get_path(AudPath::UserDir),"scrobbler.log", nullptr);
-    char *contents = nullptr;
-    gboolean success;
-    char **lines = nullptr;
-    char **line;
-    GSList *lines_to_remove = nullptr; //lines to remove because they were scrobbled (or ignored, and will not be retried)
-    GSList *lines_to_retry = nullptr; //lines to retry later because they were too old TODO: or "daily scrobble limit reached"
+//appends the entries to be retried and marks everything before offset as done
+//returns the number of bytes removed from the start of the log
+static int64_t commit_scrobble_queue(const char *queuepath, const Index<String> &retry, int64_t offset) {
+    int64_t removed = 0;
 
     pthread_mutex_lock(&log_access_mutex);
-    success = g_file_get_contents(queuepath, &contents, nullptr, nullptr);
+
+    if (retry.len()) {
+        FILE *f = g_fopen(queuepath, "a");
+
+        if (f == nullptr) {
+            perror("fopen");
+        } else {
+            for (const String &line : retry)
+                fprintf(f, "%s\n", (const char *)line);
+            fclose(f);
+        }
+    }
+
+    GStatBuf info;
+    if (g_stat(queuepath, &info) == 0 && info.st_size == offset) {
+        //everything is done; truncate the log before resetting the offset,
+        //so that a crash in between cannot resend anything
+        FILE *f = g_fopen(queuepath, "w");
+        if (f != nullptr)
+            fclose(f);
+        removed = offset;
+        offset = 0;
+    } else if (offset >= COMPACT_OFFSET && compact_scrobble_queue(queuepath, offset)) {
+        //entries which keep being retried would otherwise never let
+        //the log become empty
+        removed = offset;
+        offset = 0;
+    }
+
+    write_committed_offset(queuepath, offset);
+
     pthread_mutex_unlock(&log_access_mutex);
+    return removed;
+}
 
-    if (!success) {
-        AUDDBG("Couldn't access the queue file.\n");
-    } else {
-        lines = g_strsplit(contents, "\n", 0);
-
-        for (int i = 0; lines[i] != nullptr && scrobbling_enabled; i++) {
-            if (!strlen(lines[i])) continue;
-
-            line = g_strsplit(lines[i], "\t", 0);
-
-            //line[0] line[1] line[2] line[3] line[4] line[5] line[6]   line[7]      line[8]
-            //artist  album   title   number  length  "L"     timestamp album_artist nullptr
-
-            if (is_valid_scrobble_format(line))
-            {
-                String scrobblemsg = create_message_to_lastfm ("track.scrobble",
-                 9, "artist", line[0], "album", line[1], "track", line[2],
-                 "trackNumber", line[3], "duration", line[4],
-                 "timestamp", line[6],
-                 "albumArtist", line[7] != nullptr ? line[7] : "",  //in case cache uses old format without album artist field
-                 "api_key", SCROBBLER_API_KEY, "sk", (const char *) session_key);
-
-                if (send_message_to_lastfm(scrobblemsg) == true) {
-                    String error_code;
-                    String error_detail;
-                    gboolean ignored = false;
-                    String ignored_code;
-
-                    if (read_scrobble_result(error_code, error_detail, &ignored, ignored_code) == true) {
-                        AUDDBG("SCROBBLE OK. Error code: %s. Error detail: %s\n",
-                         (const char *)error_code, (const char *)error_detail);
-                        AUDDBG("SCROBBLE OK. ignored: %i.\n", ignored);
-                        AUDDBG("SCROBBLE OK. ignored code: %s.\n",
-                         (const char *)ignored_code);
-                        if (ignored == true && g_strcmp0(ignored_code, "3") == 0) { //3: Timestamp was too old
-                            AUDDBG("SCROBBLE IGNORED!!! %i, detail: %s\n",
-                             ignored, (const char *)ignored_code);
-                            save_line_to_remove(&lines_to_retry, i);
-                        } else if (ignored == true && g_strcmp0(ignored_code, "") == 0) { //5: Daily scrobble limit reached
-                           //TODO: a track might not be scrobbled due to "daily scrobble limit exeeded".
-                           //This message comes on the ignoredMessage attribute, inside the XML of the response.
-                           //We are not dealing with this case currently and are losing that scrobble.
-                           //TODO
-                        } else {
-                            AUDDBG("Not ignored. Carrying on...\n");
-                            save_line_to_remove(&lines_to_remove, i);
-                        }
-                    } else {
-                        AUDINFO("SCROBBLE NOT OK. Error code: %s. Error detail: %s.\n",
-                         (const char *)error_code, (const char *)error_detail);
-
-                        if (! error_code) { //net error(?) or the answer from last.fm was not well read
-                            //scrobble to be retried
-                        }
-                        else if (g_strcmp0(error_code, "11") == 0 ||
-                                 g_strcmp0(error_code, "16") == 0){
-                            //error code 11: Service Offline - This service is temporarily offline. Try again later.
-                            //error code 16: The service is temporarily unavailable, please try again.
-                            //scrobble to be retried
-                        }
-                        else if (g_strcmp0(error_code,  "9") == 0) {
-                            //Bad Session. Reauth.
-                            scrobbling_enabled = false;
-                            session_key = String();
-                            aud_set_str("scrobbler", "session_key", "");
-                        }
-                        else {
-                            save_line_to_remove(&lines_to_remove, i);
-                        }
-                    }
-                } else {
-                    AUDDBG("Could not scrobble a track on the queue. Network problem?\n");
-                    //scrobble to be retried
-                    scrobbling_enabled = false;
-                }
+static void add_scrobble_parameter(Index<API_Parameter> &params, const char *name, int i, const char *value) {
+    params.append(String(str_printf("%s[%d]", name, i)), String(value));
+}
 
-                //TODO: Avoid spamming last.fm --- It's not as simple as just adding a wait here:
-                //If audacious is closed while we're on this loop, tracks might be re-scrobbled.
-                //This shall be doable if we only pick one track at a time from the scrobbler.log
-            } else {
-                AUDDBG("Unscrobbable line.\n");
-                //leave entry on the cache file
-            }
-            g_strfreev(line);
-        }//for
+enum SubmitResult {
+    SUBMIT_OK,        //all entries were dealt with
+    SUBMIT_LIMITED,   //dealt with, but some will be retried later; stop for now
+    SUBMIT_RETRY,     //nothing was dealt with; retry later
+    SUBMIT_REJECTED   //the request was refused as a whole
+};
+
+//sends count entries at once, using the array form of track.scrobble
+static SubmitResult submit_scrobbles(const QueueEntry *entries, int count, Index<String> &retry) {
+    Index<API_Parameter> params;
+
+    for (int i = 0; i < count; i++) {
+        char **line = g_strsplit(entries[i].line, "\t", 0);
+
+        //line[0] line[1] line[2] line[3] line[4] line[5] line[6]   line[7]      line[8]
+        //artist  album   title   number  length  "L"     timestamp album_artist nullptr
 
-        delete_lines_from_scrobble_log(&lines_to_remove, &lines_to_retry, queuepath);
+        add_scrobble_parameter(params, "artist", i, line[0]);
+        add_scrobble_parameter(params, "album", i, line[1]);
+        add_scrobble_parameter(params, "track", i, line[2]);
+        add_scrobble_parameter(params, "trackNumber", i, line[3]);
+        add_scrobble_parameter(params, "duration", i, line[4]);
+        add_scrobble_parameter(params, "timestamp", i, line[6]);
+        //in case cache uses old format without album artist field
+        add_scrobble_parameter(params, "albumArtist", i, line[7] != nullptr ? line[7] : "");
 
-        if (lines_to_remove != nullptr) {
-            g_slist_free_full(lines_to_remove, g_free);
+        g_strfreev(line);
+    }
+
+    params.append(String("api_key"), String(SCROBBLER_API_KEY));
+    params.append(String("sk"), session_key);
+
+    String scrobblemsg = create_message_to_lastfm("track.scrobble", params);
+
+    if (send_message_to_lastfm(scrobblemsg) == false) {
+        AUDDBG("Could not scrobble the tracks on the queue. Network problem?\n");
+        scrobbling_enabled = false;
+        return SUBMIT_RETRY;
+    }
+
+    String error_code;
+    String error_detail;
+    Index<String> ignored_codes;
+
+    if (read_scrobble_batch_result(error_code, error_detail, ignored_codes) == false) {
+        AUDINFO("SCROBBLE NOT OK. Error code: %s. Error detail: %s.\n",
+         (const char *)error_code, (const char *)error_detail);
+
+        if (! error_code) { //net error(?) or the answer from last.fm was not well read
+            return SUBMIT_RETRY;
         }
-        if (lines_to_retry != nullptr) {
-            g_slist_free_full(lines_to_retry, g_free);
+        else if (g_strcmp0(error_code, "11") == 0 ||
+                 g_strcmp0(error_code, "16") == 0 ||
+                 g_strcmp0(error_code, "29") == 0) {
+            //error code 11: Service Offline - This service is temporarily offline. Try again later.
+            //error code 16: The service is temporarily unavailable, please try again.
+            //error code 29: Rate limit exceeded
+            return SUBMIT_RETRY;
         }
+        else if (g_strcmp0(error_code,  "9") == 0) {
+            //Bad Session. Reauth.
+            scrobbling_enabled = false;
+            session_key = String();
+            aud_set_str("scrobbler", "session_key", "");
+            return SUBMIT_RETRY;
+        }
+
+        return SUBMIT_REJECTED;
+    }
 
-        g_strfreev(lines);
+    SubmitResult result = SUBMIT_OK;
+
+    for (int i = 0; i < count && i < ignored_codes.len(); i++) {
+        const char *code = ignored_codes[i];
+
+        if (g_strcmp0(code, "3") == 0) { //3: Timestamp was too old
+            AUDDBG("SCROBBLE IGNORED (timestamp too old), retrying with the current time.\n");
+            char *line = g_strdup(entries[i].line);
+            set_timestamp_to_current(&line);
+            retry.append(String(line));
+            g_free(line);
+        } else if (g_strcmp0(code, "5") == 0) { //5: Daily scrobble limit reached
+            AUDDBG("SCROBBLE IGNORED (daily limit reached), retrying later.\n");
+            retry.append(entries[i].line);
+            result = SUBMIT_LIMITED;
+        } else if (code && g_strcmp0(code, "0") != 0) {
+            AUDDBG("SCROBBLE IGNORED, code: %s.\n", code);
+        }
     }
 
-    g_free(contents);
-    g_free(queuepath);
+    return result;
+}
+
+//returns FALSE if some entries were left for later because of a temporary problem
+static gboolean scrobble_cached_queue() {
+    StringBuf queuepath = filename_build({aud_get_path(AudPath::UserDir), "scrobbler.log"});
+
+    int64_t read_end;
+    Index<QueueEntry> entries = read_scrobble_queue(queuepath, read_end);
+
+    int first = 0;
+    int split_end = 0;      //entries before this are sent one at a time
+    int64_t removed = 0;    //bytes removed from the start of the log so far
+
+    while (first < entries.len() && scrobbling_enabled) {
+        int batch_size = (first < split_end) ? 1 : SCROBBLE_BATCH_SIZE;
+        int count = aud::min(entries.len() - first, batch_size);
+        Index<String> retry;
+
+        SubmitResult result = submit_scrobbles(&entries[first], count, retry);
+
+        if (result == SUBMIT_RETRY)
+            return false;
+
+        if (result == SUBMIT_REJECTED && count > 1) {
+            //one bad entry makes the whole request fail;
+            //send this batch again one at a time so that only that one is dropped
+            split_end = first + count;
+            continue;
+        }
+
+        first += count;
+        int64_t end = (first == entries.len()) ? read_end : entries[first - 1].end;
+        removed += commit_scrobble_queue(queuepath, retry, end - removed);
+
+        if (result == SUBMIT_LIMITED)
+            return false;
+    }
+
+    //only unscrobbable lines were left
+    if (!entries.len() && read_end > 0)
+        commit_scrobble_queue(queuepath, Index<String>(), read_end);
+
+    return (first == entries.len());
 }
 
 static void send_now_playing() {
@@ -611,6 +762,29 @@ static void treat_permission_check_request() {
     } //session_key == nullptr || strlen(session_key) == 0
 }
 
+//waits longer after each failure in a row, so as not to flood last.fm
+//while it (or the network) is down
+static void wait_before_retry() {
+    retry_delay = retry_delay ? aud::min(retry_delay * 2, MAX_RETRY_DELAY) : MIN_RETRY_DELAY;
+    AUDDBG("Retrying in %d seconds.\n", retry_delay);
+
+    struct timeval curtime;
+    struct timespec timeout;
+    pthread_mutex_lock(&communication_mutex);
+    gettimeofday(&curtime, nullptr);
+    timeout.tv_sec = curtime.tv_sec + retry_delay;
+    timeout.tv_nsec = curtime.tv_usec * 1000;
+
+    //new tracks are only logged meanwhile; quitting or a permission check
+    //from the settings window end the wait early
+    while (scrobbler_running && !permission_check_requested && !invalidate_session_requested) {
+        if (pthread_cond_timedwait(&communication_signal, &communication_mutex, &timeout) == ETIMEDOUT)
+            break;
+    }
+
+    pthread_mutex_unlock(&communication_mutex);
+}
+
 //Scrobbling will only be enabled after the first connection test passed
 void * scrobbling_thread (void * input_data) {
     while (scrobbler_running) {
@@ -627,30 +801,27 @@ void * scrobbling_thread (void * input_data) {
             }
             now_playing_requested = false;
         } else {
+            gboolean queue_done = false;
             if (scrobbling_enabled) {
-              scrobble_cached_queue();
+              queue_done = scrobble_cached_queue();
             }
             //scrobbling may be disabled at this point if communication errors occur
 
-            pthread_mutex_lock(&communication_mutex);
-            if (scrobbling_enabled) {
+            if (scrobbling_enabled && queue_done) {
+                retry_delay = 0;
+                pthread_mutex_lock(&communication_mutex);
                 pthread_cond_wait(&communication_signal, &communication_mutex);
                 pthread_mutex_unlock(&communication_mutex);
             }
+            else if (scrobbling_enabled) {
+                //some scrobbles were left for later
+                wait_before_retry();
+            }
             else {
                 //We don't want to wait until receiving a signal to retry
                 //if submitting the cache failed due to network problems
-                pthread_mutex_unlock(&communication_mutex);
-
                 if (scrobbler_test_connection() == false || !scrobbling_enabled) {
-                    struct timeval curtime;
-                    struct timespec timeout;
-                    pthread_mutex_lock(&communication_mutex);
-                    gettimeofday(&curtime, nullptr);
-                    timeout.tv_sec = curtime.tv_sec + 7;
-                    timeout.tv_nsec = curtime.tv_usec * 1000;
-                    pthread_cond_timedwait(&communication_signal, &communication_mutex, &timeout);
-                    pthread_mutex_unlock(&communication_mutex);
+                    wait_before_retry();
                 }
             }
         }
@@ -665,5 +836,6 @@ void * scrobbling_thread (void * input_data) {
     curlHandle = nullptr;
 
     scrobbling_enabled = true;
+    retry_delay = 0;
     return nullptr;
 }
@@ -76,6 +76,34 @@ static String get_attribute_value (const char *node_expression, const char *attr
     return result;
 }
 
+//returns the attribute's value for every node matching the expression,
+//with nullptr for nodes where the attribute was not found
+static Index<String> get_attribute_values (const char *node_expression, const char *attribute) {
+    Index<String> results;
+
+    if (doc == nullptr || context == nullptr) {
+        AUDDBG("Response from last.fm not parsed successfully. Did you call prepare_data?\n");
+        return results;
+    }
+
+    xmlXPathObjectPtr statusObj = xmlXPathEvalExpression((xmlChar *) node_expression, context);
+    if (statusObj == nullptr) {
+        AUDDBG ("Error in xmlXPathEvalExpression.\n");
+        return results;
+    }
+
+    if (!xmlXPathNodeSetIsEmpty(statusObj->nodesetval)) {
+        for (int i = 0; i < statusObj->nodesetval->nodeNr; i++) {
+            xmlChar *prop = xmlGetProp(statusObj->nodesetval->nodeTab[i], (xmlChar *) attribute);
+            results.append((prop && prop[0]) ? String((const char *)prop) : String());
+            xmlFree(prop);
+        }
+    }
+
+    xmlXPathFreeObject(statusObj);
+    return results;
+}
+
 //returns:
 // nullptr if an error occurs or the node was not found
 static String get_node_string (const char *node_expression) {
@@ -188,6 +216,40 @@ gboolean read_scrobble_result(String &error_code, String &error_detail,
     return result;
 }
 
+/*
+ * Same as read_scrobble_result(), for a request scrobbling several tracks.
+ * On success, ignored_codes holds the ignoredMessage code of each track, in
+ * the order they were sent ("0" when the track was accepted).
+ */
+gboolean read_scrobble_batch_result(String &error_code, String &error_detail,
+ Index<String> &ignored_codes) {
+    gboolean result = true;
+
+    if (!prepare_data()) {
+        AUDDBG("Could not read received data from last.fm. What's up?\n");
+        return false;
+    }
+
+    String status = check_status(error_code, error_detail);
+
+    if (!status) {
+        AUDDBG("Status was nullptr. Invalid API answer.\n");
+        clean_data();
+        return false;
+    }
+
+    if (!strcmp(status, "failed")) {
+        AUDDBG("Error code: %s. Detail: %s.\n", (const char *)error_code,
+         (const char *)error_detail);
+        result = false;
+    } else {
+        ignored_codes = get_attribute_values("/lfm/scrobbles/scrobble/ignoredMessage", "code");
+    }
+
+    clean_data();
+    return result;
+}
+
 //returns
 //FALSE if there was an error with the connection
 gboolean read_authentication_test_result (String &error_code, String &error_detail) {
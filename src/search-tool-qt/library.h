@@ -20,27 +20,76 @@
 #ifndef LIBRARY_H
 #define LIBRARY_H
 
+#include <atomic>
+#include <thread>
+
 #include <libaudcore/hook.h>
+#include <libaudcore/mainloop.h>
 #include <libaudcore/multihash.h>
 #include <libaudcore/playlist.h>
 
+/* the audio files and folders found in the library folder, as of the last
+ * scan; saved between sessions so that only changes need to be scanned */
+struct LibraryManifest
+{
+    struct File {
+        int64_t size, mtime;
+    };
+
+    struct Folder {
+        Index<String> files, subfolders;  /* URIs */
+    };
+
+    String root;  /* URI of the library folder */
+    SimpleHash<String, File> files;
+    SimpleHash<String, Folder> folders;
+
+    void clear ()
+    {
+        root = String ();
+        files.clear ();
+        folders.clear ();
+    }
+
+    void load (const char * path);
+    bool save (const char * path);
+};
+
+/* identifies a folder on disk, to catch links back to a parent folder */
+struct FolderID
+{
+    uint64_t device, inode;
+
+    bool operator== (const FolderID & b) const
+        { return inode && device == b.device && inode == b.inode; }
+};
+
 class Library
 {
 public:
     Library () { find_playlist (); }
-    ~Library () { set_adding (false); }
+    ~Library ();
 
     Playlist playlist () const { return m_playlist; }
     bool is_ready () const { return m_is_ready; }
+    bool entries_changed () const { return m_changes.level == Playlist::Structure; }
 
     void begin_add (const char * uri);
+    void begin_rescan (const char * uri, Index<String> && folders);
     void check_ready_and_update (bool force);
+    Playlist::Update take_changes ();
+    Index<String> folders (const char * uri);
 
     void connect_update (void (* func) (void *), void * data) {
         update_func = func;
         update_data = data;
     };
 
+    void connect_walk_done (void (* func) (void *), void * data) {
+        walk_done_func = func;
+        walk_done_data = data;
+    };
+
 private:
     void find_playlist ();
     void create_playlist ();
@@ -49,14 +98,44 @@ private:
 
     static bool filter_cb (const char * filename, void *);
 
+    void add_folder (const char * uri);
+    void begin_walk (const char * uri, Index<String> && folders);
+    void walk_worker ();
+    void walk_folder (const char * uri, bool recurse, Index<FolderID> & parents);
+    void walk_done ();
+    void apply_full_walk ();
+    void apply_partial_walk ();
+    void forget_folder (const String & uri, SimpleHash<String, bool> & removed);
+    void update_entries (SimpleHash<String, bool> & removed,
+     SimpleHash<String, bool> & changed, Index<String> & added);
+
     void add_complete (void);
     void scan_complete (void);
     void playlist_update (void);
 
     Playlist m_playlist;
     bool m_is_ready = false;
+    Playlist::Update m_changes {};  /* since the last take_changes () */
     SimpleHash<String, bool> m_added_table;
 
+    SmartPtr<LibraryManifest> m_manifest {new LibraryManifest};
+    bool m_manifest_loaded = false;
+    bool m_manifest_changed = false;
+
+    /* walk of the library folder in progress;
+     * the thread reads m_manifest but does not change it */
+    std::thread m_walk_thread;
+    std::atomic<bool> m_walk_cancel {false};
+    String m_walk_root;
+    Index<String> m_walk_folders;  /* folders to list, or empty for all */
+    bool m_walk_full = false;
+    SmartPtr<LibraryManifest> m_walk_found;
+    QueuedFunc m_walk_done;
+
+    /* walk requested while another was in progress */
+    String m_pending_root;
+    Index<String> m_pending_folders;  /* or empty for all */
+
     /* to allow safe callback access from playlist add thread */
     static aud::spinlock s_adding_lock;
     static Library * s_adding_library;
@@ -64,6 +143,9 @@ private:
     void (* update_func) (void *) = nullptr;
     void * update_data = nullptr;
 
+    void (* walk_done_func) (void *) = nullptr;
+    void * walk_done_data = nullptr;
+
     HookReceiver<Library>
      hook1 {"playlist add complete", this, & Library::add_complete},
      hook2 {"playlist scan complete", this, & Library::scan_complete},
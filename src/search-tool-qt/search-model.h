@@ -58,6 +58,17 @@ struct Key
         { return (unsigned) field + name.hash (); }
 };
 
+/* trigram (three bytes of a folded name) used as key of the search index */
+struct Trigram
+{
+    uint32_t code;
+
+    bool operator== (const Trigram & b) const
+        { return code == b.code; }
+    unsigned hash () const
+        { return code * 0x9e3779b1; }
+};
+
 struct Item
 {
     SearchField field;
@@ -65,6 +76,7 @@ struct Item
     Item * parent;
     SimpleHash<Key, Item> children;
     Index<int> matches;
+    int id = -1;  /* position in SearchModel::m_all_items */
 
     Item (SearchField field, const String & name, Item * parent) :
         field (field),
@@ -83,9 +95,18 @@ public:
     const Item & item_at (int idx) const { return * m_items[idx]; }
     int num_hidden_items () const { return m_hidden_items; }
 
+    Playlist playlist () const { return m_playlist; }
+    bool is_usable () const { return m_playlist != Playlist () && ! m_suspended; }
+    bool is_validating () const { return m_validated < m_entries; }
+
     void update ();
     void destroy_database ();
     void create_database (Playlist playlist);
+    void update_database (Playlist playlist, const Playlist::Update & changes);
+    void suspend ();
+    bool validate (int count);
+    bool load_cache (Playlist playlist);
+    void save_cache ();
     void do_search (const Index<String> & terms, int max_results);
 
 protected:
@@ -113,12 +134,30 @@ protected:
     QMimeData * mimeData (const QModelIndexList & indexes) const;
 
 private:
-    void add_to_database (int entry, std::initializer_list<Key> keys);
+    Item * add_to_database (int entry, std::initializer_list<Key> keys);
+    uint32_t add_entry (int entry, const Tuple & tuple, Item * * leaves);
+    void remove_entry (int entry);
+    void remove_item (Item * item);
+    void shift_entries (int from, int delta);
+    void index_item (Item * item);
+    void find_term (const char * term, Index<int> & ids);
+    void collect_results (Item * item, uint32_t mask, uint32_t all_terms);
+    bool read_cache (Playlist playlist, const char * data, int64_t size);
 
     Playlist m_playlist;
+    int m_entries = 0;
     SimpleHash<Key, Item> m_database;
+    Index<Item *> m_leaves;  /* per entry, the last item of each chain (or null) */
+    Index<uint32_t> m_fingerprints;  /* per entry, see entry_fingerprint () */
+    int m_validated = 0;  /* entries checked since loading from the cache */
+    bool m_changed = false;  /* since loading from or saving to the cache */
+    Index<Item *> m_all_items;
+    int m_dead_items = 0;  /* removed items, still counted in m_all_items */
+    SimpleHash<Trigram, Index<int>> m_trigrams;
+    Index<uint32_t> m_term_mask;  /* per item, terms found in its own name */
     Index<const Item *> m_items;
     int m_hidden_items = 0;
+    bool m_suspended = false;
     int m_rows = 0;
 };
 
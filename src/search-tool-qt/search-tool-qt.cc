@@ -22,7 +22,6 @@
 #include <QApplication>
 #include <QBoxLayout>
 #include <QContextMenuEvent>
-#include <QDirIterator>
 #include <QFileSystemWatcher>
 #include <QIcon>
 #include <QLabel>
@@ -30,6 +29,7 @@
 #include <QMenu>
 #include <QPointer>
 #include <QPushButton>
+#include <QSet>
 #include <QTreeView>
 
 #include <libaudcore/i18n.h>
@@ -46,6 +46,9 @@
 
 #define CFG_ID "search-tool"
 #define SEARCH_DELAY 300
+#define RESCAN_DELAY 1000
+#define VALIDATE_DELAY 50
+#define VALIDATE_ENTRIES 2000
 
 class SearchToolQt : public GeneralPlugin
 {
@@ -113,6 +116,7 @@ class SearchWidget : public QWidget
 {
 public:
     SearchWidget ();
+    ~SearchWidget ();
 
     void grab_focus () { m_search_entry.setFocus (Qt::OtherFocusReason); }
 
@@ -123,9 +127,11 @@ private:
     void init_library ();
     void show_hide_widgets ();
     void search_timeout ();
+    void validate_timeout ();
     void library_updated ();
     void location_changed ();
-    void walk_library_paths ();
+    void watch_library_paths ();
+    void rescan_changed_paths ();
     void setup_monitor ();
 
     void do_add (bool play, bool set_title);
@@ -139,9 +145,12 @@ private:
     HtmlDelegate m_delegate;
 
     SmartPtr<QFileSystemWatcher> m_watcher;
-    QStringList m_watcher_paths;
+    QSet<QString> m_watcher_paths;
+    QStringList m_changed_paths;
+    QueuedFunc m_rescan_timer;
 
     QueuedFunc m_search_timer;
+    QueuedFunc m_validate_timer;
     bool m_search_pending = false;
 
     QLabel m_help_label, m_wait_label, m_stats_label;
@@ -266,10 +275,23 @@ SearchWidget::SearchWidget () :
     QObject::connect (& m_refresh_btn, & QPushButton::clicked, this, & SearchWidget::location_changed);
 }
 
+SearchWidget::~SearchWidget ()
+{
+    m_validate_timer.stop ();
+    m_model.save_cache ();
+}
+
 void SearchWidget::init_library ()
 {
     m_library.connect_update
      (aud::obj_member<SearchWidget, & SearchWidget::library_updated>, this);
+    m_library.connect_walk_done
+     (aud::obj_member<SearchWidget, & SearchWidget::watch_library_paths>, this);
+
+    // search the database saved last time until the library is ready
+    if (m_library.playlist () != Playlist () &&
+        m_model.load_cache (m_library.playlist ()))
+        m_validate_timer.start (VALIDATE_DELAY, [this] () { validate_timeout (); });
 
     if (aud_get_bool (CFG_ID, "rescan_on_startup"))
         m_library.begin_add (get_uri ());
@@ -290,7 +312,7 @@ void SearchWidget::show_hide_widgets ()
     {
         m_help_label.hide ();
 
-        if (m_library.is_ready ())
+        if (m_library.is_ready () || m_model.is_usable ())
         {
             m_wait_label.hide ();
             m_results_list.show ();
@@ -334,6 +356,16 @@ void SearchWidget::search_timeout ()
     m_search_pending = false;
 }
 
+// a database loaded from the cache is checked against the library a bit
+// at a time, so that searching can start right away
+void SearchWidget::validate_timeout ()
+{
+    if (! m_model.is_validating ())
+        m_validate_timer.stop ();
+    else if (m_model.validate (VALIDATE_ENTRIES) && m_model.is_usable ())
+        search_timeout ();
+}
+
 void SearchWidget::trigger_search ()
 {
     m_search_timer.queue (SEARCH_DELAY, [this] () { search_timeout (); });
@@ -344,14 +376,26 @@ void SearchWidget::library_updated ()
 {
     if (m_library.is_ready ())
     {
-        m_model.create_database (m_library.playlist ());
+        m_model.update_database (m_library.playlist (), m_library.take_changes ());
         search_timeout ();
     }
     else
     {
-        m_model.destroy_database ();
-        m_model.update ();
-        m_stats_label.clear ();
+        // keep the database to be updated once the library is ready;
+        // until entries are added or removed, it can still be searched
+        if (m_library.playlist () == Playlist ())
+            m_model.destroy_database ();
+        else if (m_library.entries_changed () ||
+                 m_model.playlist () != m_library.playlist ())
+            m_model.suspend ();
+
+        if (m_model.is_usable ())
+            search_timeout ();
+        else
+        {
+            m_model.update ();
+            m_stats_label.clear ();
+        }
     }
 
     show_hide_widgets ();
@@ -374,28 +418,64 @@ void SearchWidget::location_changed ()
     reset_monitor ();
 }
 
-// QFileSystemWatcher doesn't support recursion, so we must do it ourselves.
+// QFileSystemWatcher doesn't support recursion, so every folder is watched.
+// The folders are taken from the last walk of the library, so that they need
+// not be listed again here; new folders are found when their parent folder
+// is rescanned and are watched once that walk is done.
 // TODO: Since MacOS has an abysmally low default per-process FD limit, this
 // means it probably won't work on MacOS with a huge media library.
 // In the case of MacOS, we should use the FSEvents API instead.
-void SearchWidget::walk_library_paths ()
+void SearchWidget::watch_library_paths ()
 {
-    if (! m_watcher_paths.isEmpty ())
-        m_watcher->removePaths (m_watcher_paths);
+    if (! m_watcher)
+        return;
 
-    m_watcher_paths.clear ();
+    QSet<QString> paths;
+    for (auto & uri : m_library.folders (get_uri ()))
+    {
+        StringBuf path = uri_to_filename (uri);
+        if (path)
+            paths.insert ((QString) path);
+    }
 
-    auto root = (QString) uri_to_filename (get_uri ());
-    if (root.isEmpty ())
+    // a walk is running; it will call back when done
+    if (paths.isEmpty ())
         return;
 
-    m_watcher_paths.append (root);
+    QStringList removed, added;
+
+    for (auto & path : m_watcher_paths)
+    {
+        if (! paths.contains (path))
+            removed.append (path);
+    }
+
+    for (auto & path : paths)
+    {
+        if (! m_watcher_paths.contains (path))
+            added.append (path);
+    }
+
+    if (! removed.isEmpty ())
+        m_watcher->removePaths (removed);
+    if (! added.isEmpty ())
+        m_watcher->addPaths (added);
+
+    m_watcher_paths = std::move (paths);
+}
 
-    QDirIterator it (root, QDir::Dirs | QDir::NoDot | QDir::NoDotDot, QDirIterator::Subdirectories);
-    while (it.hasNext ())
-        m_watcher_paths.append (it.next ());
+// Changes often come in bursts (copying an album, for example), so they are
+// collected for a moment and then only the changed folders are rescanned.
+void SearchWidget::rescan_changed_paths ()
+{
+    Index<String> folders;
+    for (auto & path : m_changed_paths)
+        folders.append (String (filename_to_uri (path.toUtf8 ())));
 
-    m_watcher->addPaths (m_watcher_paths);
+    m_changed_paths.clear ();
+
+    m_library.begin_rescan (get_uri (), std::move (folders));
+    m_library.check_ready_and_update (true);
 }
 
 void SearchWidget::setup_monitor ()
@@ -405,17 +485,17 @@ void SearchWidget::setup_monitor ()
     m_watcher_paths.clear ();
 
     QObject::connect (m_watcher.get (), & QFileSystemWatcher::directoryChanged,
-     [this] (const QString &)
+     [this] (const QString & path)
     {
-        AUDINFO ("Library directory changed, refreshing library.\n");
+        AUDINFO ("Library directory changed: %s\n", path.toUtf8 ().constData ());
 
-        m_library.begin_add (get_uri ());
-        m_library.check_ready_and_update (true);
+        if (! m_changed_paths.contains (path))
+            m_changed_paths.append (path);
 
-        walk_library_paths ();
+        m_rescan_timer.queue (RESCAN_DELAY, [this] () { rescan_changed_paths (); });
     });
 
-    walk_library_paths ();
+    watch_library_paths ();
 }
 
 void SearchWidget::reset_monitor ()
@@ -429,6 +509,8 @@ void SearchWidget::reset_monitor ()
         AUDINFO ("Stopping monitoring.\n");
         m_watcher.clear ();
         m_watcher_paths.clear ();
+        m_changed_paths.clear ();
+        m_rescan_timer.stop ();
     }
 }
 
@@ -19,15 +19,200 @@
 
 #include "library.h"
 
+#include <inttypes.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <libaudcore/audstrings.h>
 #include <libaudcore/i18n.h>
+#include <libaudcore/probe.h>
+#include <libaudcore/runtime.h>
+#include <libaudcore/vfs.h>
+
+#define MANIFEST_NAME "search-library"
 
 aud::spinlock Library::s_adding_lock;
 Library * Library::s_adding_library = nullptr;
 
+static StringBuf manifest_path ()
+{
+    return filename_build ({aud_get_path (AudPath::UserDir), MANIFEST_NAME});
+}
+
+/* subtunes (of a cue sheet, for example) belong to the file they are in */
+static String entry_file (const String & filename)
+{
+    const char * sub;
+    uri_parse (filename, nullptr, nullptr, & sub, nullptr);
+    return sub[0] ? String (str_copy (filename, sub - filename)) : filename;
+}
+
+/* inodes are not available on all systems; FolderID treats 0 as unknown */
+static bool get_folder_id (const char * path, FolderID & id)
+{
+    GStatBuf info;
+    if (! path || g_stat (path, & info) < 0)
+        return false;
+
+    id = {(uint64_t) info.st_dev, (uint64_t) info.st_ino};
+    return true;
+}
+
+/* Like the player's own folder adder, a folder with cue sheets gets the
+ * cue sheets instead of the audio files they refer to.  Finds the files
+ * named by the FILE lines of a cue sheet. */
+static void find_cue_files (const char * folder, const char * cue_path,
+ SimpleHash<String, bool> & files)
+{
+    VFSFile file (filename_to_uri (cue_path), "r");
+    if (! file)
+        return;
+
+    Index<char> data = file.read_all ();
+    data.append (0);
+
+    for (char * line = data.begin (); line; )
+    {
+        char * next = strchr (line, '\n');
+        if (next)
+            * (next ++) = 0;
+
+        line += strspn (line, " \t");
+
+        if (! strncmp (line, "FILE", 4) && (line[4] == ' ' || line[4] == '\t'))
+        {
+            char * name = line + 4 + strspn (line + 4, " \t");
+            char * end;
+
+            if (name[0] == '"')
+                end = strchr (++ name, '"');
+            else
+                end = name + strcspn (name, " \t\r");
+
+            if (end && end > name)
+            {
+                * end = 0;
+
+                StringBuf path = g_path_is_absolute (name) ?
+                 str_copy (name) : filename_build ({folder, name});
+                StringBuf uri = filename_to_uri (path);
+
+                if (uri)
+                    files.add (String (uri), true);
+            }
+        }
+
+        line = next;
+    }
+}
+
+/* The manifest is a text file: the URI of the library folder, then one
+ * line per folder ("D uri"), each followed by one line per audio file in
+ * it ("F size mtime uri"). */
+void LibraryManifest::load (const char * path)
+{
+    clear ();
+
+    VFSFile file (path, "r");
+    if (! file)
+        return;
+
+    Index<char> data = file.read_all ();
+    data.append (0);
+
+    Folder * folder = nullptr;
+    char * line = data.begin ();
+
+    while (line[0])
+    {
+        char * next = strchr (line, '\n');
+        if (next)
+            * (next ++) = 0;
+        else
+            next = line + strlen (line);
+
+        if (! strncmp (line, "root ", 5))
+            root = String (line + 5);
+        else if (! strncmp (line, "D ", 2))
+            folder = folders.add (String (line + 2), Folder ());
+        else if (! strncmp (line, "F ", 2) && folder)
+        {
+            char * end;
+            int64_t size = strtoll (line + 2, & end, 10);
+            int64_t mtime = strtoll (end, & end, 10);
+
+            if (end[0] == ' ' && end[1])
+            {
+                String uri (end + 1);
+                files.add (uri, File {size, mtime});
+                folder->files.append (uri);
+            }
+        }
+
+        line = next;
+    }
+
+    /* link each folder to its parent */
+    folders.iterate ([&] (const String & uri, Folder &) {
+        const char * slash = strrchr (uri, '/');
+        Folder * parent = slash ? folders.lookup (String (str_copy (uri, slash - uri))) : nullptr;
+        if (parent)
+            parent->subfolders.append (uri);
+    });
+}
+
+bool LibraryManifest::save (const char * path)
+{
+    VFSFile file (path, "w");
+    if (! file)
+        return false;
+
+    auto write = [&] (const char * line) {
+        int64_t len = strlen (line);
+        return file.fwrite (line, 1, len) == len;
+    };
+
+    bool ok = write (str_concat ({"root ", root, "\n"}));
+
+    folders.iterate ([&] (const String & uri, Folder & folder) {
+        ok = ok && write (str_concat ({"D ", uri, "\n"}));
+
+        for (auto & name : folder.files)
+        {
+            File * info = files.lookup (name);
+            if (info)
+                ok = ok && write (str_printf ("F %" PRId64 " %" PRId64 " %s\n",
+                 info->size, info->mtime, (const char *) name));
+        }
+    });
+
+    return ok && file.fflush () == 0;
+}
+
+Library::~Library ()
+{
+    set_adding (false);
+
+    if (m_walk_thread.joinable ())
+    {
+        m_walk_cancel = true;
+        m_walk_thread.join ();
+    }
+
+    m_walk_done.stop ();
+
+    if (m_manifest_changed && ! m_manifest->save (manifest_path ()))
+        AUDERR ("Failed to save library manifest.\n");
+}
+
 void Library::find_playlist ()
 {
     m_playlist = Playlist ();
+    m_changes = Playlist::Update ();
 
     for (int p = 0; p < Playlist::n_playlists (); p ++)
     {
@@ -43,6 +228,7 @@ void Library::find_playlist ()
 void Library::create_playlist ()
 {
     m_playlist = Playlist::blank_playlist ();
+    m_changes = Playlist::Update ();
     m_playlist.set_title (_("Library"));
     m_playlist.active_playlist ();
 }
@@ -55,7 +241,7 @@ bool Library::check_playlist (bool require_added, bool require_scanned)
         return false;
     }
 
-    if (require_added && m_playlist.add_in_progress ())
+    if (require_added && (m_playlist.add_in_progress () || m_walk_thread.joinable ()))
         return false;
     if (require_scanned && m_playlist.scan_in_progress ())
         return false;
@@ -87,7 +273,7 @@ bool Library::filter_cb (const char * filename, void *)
     return add;
 }
 
-void Library::begin_add (const char * uri)
+void Library::add_folder (const char * uri)
 {
     if (s_adding_library)
         return;
@@ -121,6 +307,454 @@ void Library::begin_add (const char * uri)
     m_playlist.insert_filtered (-1, std::move (add), filter_cb, nullptr, false);
 }
 
+/* Local folders are walked here instead, comparing the size and modification
+ * time of each file to the manifest, so that only new and changed files are
+ * scanned.  Given a list of folders (which have changed), only those are
+ * listed, and any new folders in them. */
+void Library::begin_add (const char * uri)
+{
+    if (uri_to_filename (uri))
+        begin_walk (uri, Index<String> ());
+    else
+        add_folder (uri);
+}
+
+void Library::begin_rescan (const char * uri, Index<String> && folders)
+{
+    if (uri_to_filename (uri))
+        begin_walk (uri, std::move (folders));
+    else
+        add_folder (uri);
+}
+
+void Library::begin_walk (const char * uri, Index<String> && folders)
+{
+    if (s_adding_library)
+        return;
+
+    if (! check_playlist (false, false))
+        create_playlist ();
+
+    if (m_walk_thread.joinable ())
+    {
+        bool merge = m_pending_root && ! strcmp (m_pending_root, uri);
+        m_pending_root = String (uri);
+
+        if (! merge)
+            m_pending_folders = std::move (folders);
+        else if (! m_pending_folders.len () || ! folders.len ())
+            m_pending_folders.clear ();  /* one of them is a full walk */
+        else
+        {
+            for (auto & folder : folders)
+                m_pending_folders.append (std::move (folder));
+        }
+
+        return;
+    }
+
+    m_walk_root = String (uri);
+    m_walk_folders = std::move (folders);
+    m_walk_cancel = false;
+    m_walk_thread = std::thread (& Library::walk_worker, this);
+}
+
+void Library::walk_worker ()
+{
+    if (! m_manifest_loaded)
+    {
+        m_manifest->load (manifest_path ());
+        m_manifest_loaded = true;
+    }
+
+    /* without a manifest of this folder, there is no telling what is new */
+    m_walk_full = ! m_walk_folders.len () || m_manifest->root != m_walk_root;
+
+    m_walk_found.capture (new LibraryManifest);
+    m_walk_found->root = m_walk_root;
+
+    if (m_walk_full)
+    {
+        Index<FolderID> parents;
+        walk_folder (m_walk_root, true, parents);
+    }
+    else
+    {
+        for (auto & folder : m_walk_folders)
+        {
+            /* the folders above this one, up to the library folder */
+            Index<FolderID> parents;
+            FolderID id;
+            int root_len = strlen (m_walk_root);
+
+            if (get_folder_id (uri_to_filename (m_walk_root), id))
+                parents.append (id);
+
+            for (const char * slash = strchr ((const char *) folder + root_len, '/');
+             slash; slash = strchr (slash + 1, '/'))
+            {
+                if (get_folder_id (uri_to_filename (str_copy (folder, slash - folder)), id))
+                    parents.append (id);
+            }
+
+            walk_folder (folder, false, parents);
+        }
+    }
+
+    m_walk_done.queue ([this] () { walk_done (); });
+}
+
+void Library::walk_folder (const char * uri, bool recurse, Index<FolderID> & parents)
+{
+    if (m_walk_cancel)
+        return;
+
+    StringBuf path = uri_to_filename (uri);
+    GDir * dir = path ? g_dir_open (path, 0, nullptr) : nullptr;
+    if (! dir)
+        return;
+
+    FolderID id;
+    if (get_folder_id (path, id))
+        parents.append (id);
+    else
+        parents.append (FolderID ());
+
+    Index<String> cuesheets;
+
+    String key (uri);
+    auto old = recurse ? nullptr : m_manifest->folders.lookup (key);
+    auto & folder = * m_walk_found->folders.add (key, LibraryManifest::Folder ());
+
+    const char * name;
+    while ((name = g_dir_read_name (dir)))
+    {
+        StringBuf child_path = filename_build ({path, name});
+        GStatBuf info;
+
+        if (g_stat (child_path, & info) < 0)
+            continue;
+
+        String child (filename_to_uri (child_path));
+        if (! child)
+            continue;
+
+        if (S_ISDIR (info.st_mode))
+        {
+            /* a link to this folder or one above it would never end */
+            if (parents.find ({(uint64_t) info.st_dev, (uint64_t) info.st_ino}) < 0)
+                folder.subfolders.append (child);
+        }
+        else if (S_ISREG (info.st_mode))
+        {
+            bool is_cue = str_has_suffix_nocase (name, ".cue");
+
+            /* files not seen before are added only if they can be played;
+             * cue sheets are opened by a playlist plugin, not a decoder */
+            if (! is_cue && ! m_manifest->files.lookup (child))
+            {
+                VFSFile file;
+                if (! aud_file_find_decoder (child, ! aud_get_bool (nullptr, "slow_probe"), file))
+                    continue;
+            }
+
+            if (is_cue)
+                cuesheets.append (String (child_path));
+
+            folder.files.append (child);
+            m_walk_found->files.add (child, LibraryManifest::File
+             {(int64_t) info.st_size, (int64_t) info.st_mtime});
+        }
+    }
+
+    g_dir_close (dir);
+
+    if (cuesheets.len ())
+    {
+        SimpleHash<String, bool> cue_files;
+        for (auto & cue_path : cuesheets)
+            find_cue_files (path, cue_path, cue_files);
+
+        for (int i = 0; i < folder.files.len (); )
+        {
+            if (cue_files.lookup (folder.files[i]))
+            {
+                m_walk_found->files.remove (folder.files[i]);
+                folder.files.remove (i, 1);
+            }
+            else
+                i ++;
+        }
+    }
+
+    for (auto & sub : folder.subfolders)
+    {
+        if (! old || old->subfolders.find (sub) < 0)
+            walk_folder (sub, true, parents);
+    }
+
+    parents.remove (parents.len () - 1, 1);
+}
+
+void Library::walk_done ()
+{
+    m_walk_thread.join ();
+
+    if (check_playlist (false, false))
+    {
+        if (m_walk_full)
+            apply_full_walk ();
+        else
+            apply_partial_walk ();
+    }
+
+    m_walk_found.clear ();
+    m_walk_folders.clear ();
+
+    if (m_pending_root)
+    {
+        String root = m_pending_root;
+        m_pending_root = String ();
+        begin_walk (root, std::move (m_pending_folders));
+    }
+    else
+        signal_walk_done ();
+
+    if (! m_playlist.update_pending ())
+        check_ready_and_update (false);
+}
+
+/* the folders found in the library folder <uri> by the last walk; nothing
+ * is returned while a walk is running, since it may still be loading the
+ * manifest */
+Index<String> Library::folders (const char * uri)
+{
+    Index<String> list;
+
+    if (m_walk_thread.joinable ())
+        return list;
+
+    if (! m_manifest_loaded)
+    {
+        m_manifest->load (manifest_path ());
+        m_manifest_loaded = true;
+    }
+
+    if (m_manifest->root && ! strcmp (m_manifest->root, uri))
+    {
+        m_manifest->folders.iterate ([&] (const String & folder, LibraryManifest::Folder &)
+            { list.append (folder); });
+    }
+
+    return list;
+}
+
+void Library::apply_full_walk ()
+{
+    SimpleHash<String, bool> present, removed, changed;
+    Index<String> added;
+    bool any_removed = false;
+
+    int entries = m_playlist.n_entries ();
+
+    for (int entry = 0; entry < entries; entry ++)
+    {
+        String filename = m_playlist.entry_filename (entry);
+        String file = entry_file (filename);
+        auto info = m_walk_found->files.lookup (file);
+
+        /* remove entries of files which are gone, and duplicates */
+        bool remove = ! info || present.lookup (filename);
+        m_playlist.select_entry (entry, remove);
+
+        if (remove)
+        {
+            any_removed = true;
+            continue;
+        }
+
+        present.add (filename, true);
+        present.add (file, true);
+
+        auto known = m_manifest->files.lookup (file);
+        if (known && (known->size != info->size || known->mtime != info->mtime))
+            changed.add (file, true);
+    }
+
+    if (any_removed)
+        m_playlist.remove_selected ();
+    else
+        m_playlist.select_all (false);
+
+    m_walk_found->files.iterate ([&] (const String & file, LibraryManifest::File &) {
+        if (! present.lookup (file))
+            added.append (file);
+    });
+
+    update_entries (removed, changed, added);
+
+    m_manifest.capture (m_walk_found.release ());
+    m_manifest_changed = ! m_manifest->save (manifest_path ());
+
+    if (m_manifest_changed)
+        AUDERR ("Failed to save library manifest.\n");
+}
+
+void Library::apply_partial_walk ()
+{
+    SimpleHash<String, bool> removed, changed;
+    Index<String> added;
+
+    /* folders which were to be listed but are gone */
+    for (auto & uri : m_walk_folders)
+    {
+        if (! m_walk_found->folders.lookup (uri))
+            forget_folder (uri, removed);
+    }
+
+    m_walk_found->folders.iterate ([&] (const String & uri, LibraryManifest::Folder & folder) {
+        auto old = m_manifest->folders.lookup (uri);
+
+        if (old)
+        {
+            for (auto & file : old->files)
+            {
+                if (! m_walk_found->files.lookup (file))
+                    removed.add (file, true);
+            }
+
+            for (auto & sub : old->subfolders)
+            {
+                if (folder.subfolders.find (sub) < 0)
+                    forget_folder (sub, removed);
+            }
+        }
+
+        for (auto & file : folder.files)
+        {
+            auto info = m_walk_found->files.lookup (file);
+            auto known = m_manifest->files.lookup (file);
+
+            if (! known)
+                added.append (file);
+            else if (known->size != info->size || known->mtime != info->mtime)
+                changed.add (file, true);
+        }
+    });
+
+    update_entries (removed, changed, added);
+
+    /* bring the manifest up to date; it is saved on exit */
+    removed.iterate ([&] (const String & file, bool &)
+        { m_manifest->files.remove (file); });
+
+    m_walk_found->files.iterate ([&] (const String & file, LibraryManifest::File & info)
+        { m_manifest->files.add (file, LibraryManifest::File (info)); });
+
+    m_walk_found->folders.iterate ([&] (const String & uri, LibraryManifest::Folder & folder) {
+        if (! m_manifest->folders.lookup (uri))
+        {
+            const char * slash = strrchr (uri, '/');
+            auto parent = slash ? m_manifest->folders.lookup (String (str_copy (uri, slash - uri))) : nullptr;
+            if (parent && parent->subfolders.find (uri) < 0)
+                parent->subfolders.append (uri);
+        }
+
+        m_manifest->folders.add (uri, std::move (folder));
+    });
+
+    m_manifest_changed = true;
+}
+
+/* removes a folder which is gone (and everything in it) from the manifest */
+void Library::forget_folder (const String & uri, SimpleHash<String, bool> & removed)
+{
+    auto folder = m_manifest->folders.lookup (uri);
+    if (! folder)
+        return;
+
+    for (auto & file : folder->files)
+        removed.add (file, true);
+    for (auto & sub : folder->subfolders)
+        forget_folder (sub, removed);
+
+    m_manifest->folders.remove (uri);
+}
+
+/* The library is kept sorted by path; new files are inserted in place, so
+ * that the rest of the playlist (and the search database) is left alone. */
+void Library::update_entries (SimpleHash<String, bool> & removed,
+ SimpleHash<String, bool> & changed, Index<String> & added)
+{
+    if (removed.n_items ())
+    {
+        int entries = m_playlist.n_entries ();
+        for (int entry = 0; entry < entries; entry ++)
+            m_playlist.select_entry (entry, (bool) removed.lookup
+             (entry_file (m_playlist.entry_filename (entry))));
+
+        m_playlist.remove_selected ();
+    }
+
+    if (changed.n_items ())
+    {
+        int entries = m_playlist.n_entries ();
+        for (int entry = 0; entry < entries; entry ++)
+            m_playlist.select_entry (entry, (bool) changed.lookup
+             (entry_file (m_playlist.entry_filename (entry))));
+
+        m_playlist.rescan_selected ();
+        m_playlist.select_all (false);
+    }
+
+    if (! added.len ())
+        return;
+
+    added.sort ([] (const String & a, const String & b)
+        { return str_compare_encoded (a, b); });
+
+    int entries = m_playlist.n_entries ();
+    Index<String> files;
+    Index<int> positions;
+
+    for (auto & file : added)
+    {
+        int low = 0, high = entries;
+
+        while (low < high)
+        {
+            int mid = (low + high) / 2;
+            if (str_compare_encoded (m_playlist.entry_filename (mid), file) < 0)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+
+        /* already in the library (if the manifest was out of date) */
+        if (low < entries && entry_file (m_playlist.entry_filename (low)) == file)
+            continue;
+
+        files.append (file);
+        positions.append (low);
+    }
+
+    /* insert from the end, so that the positions before stay valid */
+    for (int i = files.len (); i > 0; )
+    {
+        int end = i;
+        int pos = positions[i - 1];
+
+        while (i > 0 && positions[i - 1] == pos)
+            i --;
+
+        Index<PlaylistAddItem> items;
+        for (int j = i; j < end; j ++)
+            items.append (std::move (files[j]));
+
+        m_playlist.insert_items (pos, std::move (items), false);
+    }
+}
+
 void Library::check_ready_and_update (bool force)
 {
     bool now_ready = check_playlist (true, true);
@@ -171,7 +805,29 @@ void Library::scan_complete ()
         check_ready_and_update (false);
 }
 
+Playlist::Update Library::take_changes ()
+{
+    auto changes = m_changes;
+    m_changes = Playlist::Update ();
+    return changes;
+}
+
 void Library::playlist_update ()
 {
-    check_ready_and_update (m_playlist.update_detail ().level >= Playlist::Metadata);
+    auto update = m_playlist.update_detail ();
+
+    /* merge with earlier changes, keeping the common unchanged range */
+    if (update.level >= Playlist::Metadata)
+    {
+        if (m_changes.level == Playlist::NoUpdate)
+            m_changes = update;
+        else
+        {
+            m_changes.level = aud::max (m_changes.level, update.level);
+            m_changes.before = aud::min (m_changes.before, update.before);
+            m_changes.after = aud::min (m_changes.after, update.after);
+        }
+    }
+
+    check_ready_and_update (update.level >= Playlist::Metadata);
 }
@@ -20,15 +20,66 @@
 #include "search-model.h"
 #include <string.h>
 
+#include <algorithm>
+
+#include <glib.h>
+
+#include <libaudcore/runtime.h>
+#include <libaudcore/vfs.h>
+
+#define CACHE_NAME "search-index"
+#define CACHE_MAGIC "ASIX"
+#define CACHE_VERSION 1
+#define CACHE_HEADER_WORDS 7
+#define CACHE_NONE 0xffffffff
+
+/* each entry is added to the database along at most three chains of items
+ * (see add_entry); the last item of each is kept for removing the entry */
+static constexpr int leaves_per_entry = 3;
+
 void SearchModel::destroy_database ()
 {
     m_playlist = Playlist ();
+    m_entries = 0;
     m_items.clear ();
     m_hidden_items = 0;
+    m_suspended = false;
     m_database.clear ();
+    m_leaves.clear ();
+    m_fingerprints.clear ();
+    m_validated = 0;
+    m_changed = false;
+    m_all_items.clear ();
+    m_dead_items = 0;
+    m_trigrams.clear ();
+    m_term_mask.clear ();
 }
 
-void SearchModel::add_to_database (int entry, std::initializer_list<Key> keys)
+/* Adds each distinct trigram of the item's folded name to the index. Items
+ * are indexed in order of creation, so every posting list stays sorted and
+ * the item is already the last entry if the trigram occurs twice. */
+void SearchModel::index_item (Item * item)
+{
+    item->id = m_all_items.len ();
+    m_all_items.append (item);
+
+    auto s = (const unsigned char *) (const char *) item->folded;
+    int len = strlen ((const char *) s);
+
+    for (int i = 0; i + 3 <= len; i ++)
+    {
+        Trigram key = {(uint32_t) s[i] | (uint32_t) s[i + 1] << 8 | (uint32_t) s[i + 2] << 16};
+
+        Index<int> * ids = m_trigrams.lookup (key);
+        if (! ids)
+            ids = m_trigrams.add (key, Index<int> ());
+
+        if (! ids->len () || ids->end ()[-1] != item->id)
+            ids->append (item->id);
+    }
+}
+
+Item * SearchModel::add_to_database (int entry, std::initializer_list<Key> keys)
 {
     Item * parent = nullptr;
     auto hash = & m_database;
@@ -40,86 +91,574 @@ void SearchModel::add_to_database (int entry, std::initializer_list<Key> keys)
 
         Item * item = hash->lookup (key);
         if (! item)
+        {
             item = hash->add (key, Item (key.field, key.name, parent));
+            index_item (item);
+        }
 
-        item->matches.append (entry);
+        /* keep the matches in playlist order */
+        auto & matches = item->matches;
+        if (! matches.len () || matches.end ()[-1] < entry)
+            matches.append (entry);
+        else
+        {
+            int pos = std::lower_bound (matches.begin (), matches.end (), entry) - matches.begin ();
+            matches.insert (pos, 1);
+            matches[pos] = entry;
+        }
 
         parent = item;
         hash = & item->children;
     }
+
+    return parent;
+}
+
+/* identifies the file and the fields added to the database */
+static uint32_t entry_fingerprint (const Tuple & tuple)
+{
+    uint32_t hash = tuple.get_int (Tuple::Subtune);
+
+    for (auto field : {Tuple::Path, Tuple::Basename, Tuple::AlbumArtist,
+     Tuple::Artist, Tuple::Album, Tuple::Title, Tuple::Genre})
+    {
+        String str = tuple.get_str (field);
+        hash = hash * 31 + (str ? str.hash () : 0);
+    }
+
+    return hash;
+}
+
+uint32_t SearchModel::add_entry (int entry, const Tuple & tuple, Item * * leaves)
+{
+    String album_artist = tuple.get_str (Tuple::AlbumArtist);
+    String artist = tuple.get_str (Tuple::Artist);
+
+    if (album_artist && album_artist != artist)
+    {
+        /* album and song have different artists;
+         * add separately under respective artists */
+        leaves[0] = add_to_database (entry,
+         {{SearchField::Artist, album_artist},
+          {SearchField::Album, tuple.get_str (Tuple::Album)}});
+        /* add Title node under a HiddenAlbum node so that it can
+         * still be searched by album name (without listing the
+         * album twice) */
+        leaves[1] = add_to_database (entry,
+         {{SearchField::Artist, artist},
+          {SearchField::HiddenAlbum, tuple.get_str (Tuple::Album)},
+          {SearchField::Title, tuple.get_str (Tuple::Title)}});
+    }
+    else
+    {
+        /* album and song have the same artist;
+         * add hierarchically under that artist */
+        leaves[0] = add_to_database (entry,
+         {{SearchField::Artist, artist},
+          {SearchField::Album, tuple.get_str (Tuple::Album)},
+          {SearchField::Title, tuple.get_str (Tuple::Title)}});
+        leaves[1] = nullptr;
+    }
+
+    /* add separately under genre */
+    leaves[2] = add_to_database (entry,
+     {{SearchField::Genre, tuple.get_str (Tuple::Genre)}});
+
+    return entry_fingerprint (tuple);
+}
+
+/* Removes the entry from every item it was added to, and removes items
+ * which are left without matches.  Children are removed before their
+ * parents, since they never have more matches. */
+void SearchModel::remove_entry (int entry)
+{
+    for (int i = 0; i < leaves_per_entry; i ++)
+    {
+        Item * item = m_leaves[entry * leaves_per_entry + i];
+
+        while (item)
+        {
+            Item * parent = item->parent;
+            auto & matches = item->matches;
+
+            auto it = std::lower_bound (matches.begin (), matches.end (), entry);
+            if (it != matches.end () && * it == entry)
+                matches.remove (it - matches.begin (), 1);
+
+            if (! matches.len ())
+                remove_item (item);
+
+            item = parent;
+        }
+    }
+}
+
+/* The item's id is not reused; its slot in m_all_items (and any posting
+ * lists in the trigram index) are left pointing to nothing. */
+void SearchModel::remove_item (Item * item)
+{
+    m_all_items[item->id] = nullptr;
+    m_dead_items ++;
+
+    auto hash = item->parent ? & item->parent->children : & m_database;
+    hash->remove (Key {item->field, item->name});
+}
+
+void SearchModel::shift_entries (int from, int delta)
+{
+    for (Item * item : m_all_items)
+    {
+        if (! item)
+            continue;
+
+        auto & matches = item->matches;
+        for (auto it = std::lower_bound (matches.begin (), matches.end (), from);
+         it != matches.end (); it ++)
+            * it += delta;
+    }
 }
 
 void SearchModel::create_database (Playlist playlist)
 {
     destroy_database ();
 
-    int entries = playlist.n_entries ();
+    m_playlist = playlist;
+    m_entries = playlist.n_entries ();
+    m_leaves.insert (0, m_entries * leaves_per_entry);
+    m_fingerprints.insert (0, m_entries);
+
+    for (int e = 0; e < m_entries; e ++)
+        m_fingerprints[e] = add_entry (e, playlist.entry_tuple (e, Playlist::NoWait),
+         & m_leaves[e * leaves_per_entry]);
+
+    m_validated = m_entries;
+    m_changed = true;
+}
+
+/* Brings the database up to date with the changes made to the playlist
+ * since the last call.  The changed range is removed and added again,
+ * which is much cheaper than a rebuild for the usual case of a few files
+ * being added to or updated in a large library. */
+void SearchModel::update_database (Playlist playlist, const Playlist::Update & changes)
+{
+    int old_count = m_entries;
+    int new_count = playlist.n_entries ();
+
+    m_items.clear ();
+    m_hidden_items = 0;
+    m_suspended = false;
+
+    if (playlist != m_playlist)
+    {
+        create_database (playlist);
+        return;
+    }
+
+    if (changes.level == Playlist::NoUpdate && new_count == old_count)
+        return;
+
+    int first = changes.before;
+    int removed = old_count - changes.before - changes.after;
+    int added = new_count - changes.before - changes.after;
+
+    /* rebuild if the changes don't fit the database (an update was
+     * missed), or if most of the playlist was changed anyway */
+    if (changes.level == Playlist::NoUpdate || removed < 0 || added < 0 ||
+     aud::max (removed, added) > aud::max (old_count, new_count) / 2)
+    {
+        create_database (playlist);
+        return;
+    }
+
+    for (int e = first; e < first + removed; e ++)
+        remove_entry (e);
+
+    m_leaves.remove (first * leaves_per_entry, removed * leaves_per_entry);
+    m_fingerprints.remove (first, removed);
+
+    if (added != removed)
+        shift_entries (first + removed, added - removed);
+
+    m_leaves.insert (first * leaves_per_entry, added * leaves_per_entry);
+    m_fingerprints.insert (first, added);
+    m_entries = new_count;
+
+    for (int e = first; e < first + added; e ++)
+        m_fingerprints[e] = add_entry (e, playlist.entry_tuple (e, Playlist::NoWait),
+         & m_leaves[e * leaves_per_entry]);
+
+    /* entries after the changed range still need to be checked */
+    m_validated = aud::min (m_validated, first);
+    m_changed = true;
+
+    /* ids of removed items are not reused; start over once they
+     * take up half of the index */
+    if (m_dead_items > m_all_items.len () / 2)
+        create_database (playlist);
+}
+
+/* Keeps the database while the playlist is being changed, so that it can
+ * be updated afterwards.  No results are given until then. */
+void SearchModel::suspend ()
+{
+    m_items.clear ();
+    m_hidden_items = 0;
+    m_suspended = true;
+}
+
+/* Checks more entries of a database loaded from the cache against the
+ * playlist, adding again those which have changed.  Returns true if the
+ * database was changed (and the results cleared). */
+bool SearchModel::validate (int count)
+{
+    if (m_suspended)
+        return false;
+
+    bool changed = false;
+    int end = aud::min (m_validated + count, m_entries);
 
-    for (int e = 0; e < entries; e ++)
+    for (; m_validated < end; m_validated ++)
     {
-        Tuple tuple = playlist.entry_tuple (e, Playlist::NoWait);
-        String album_artist = tuple.get_str (Tuple::AlbumArtist);
-        String artist = tuple.get_str (Tuple::Artist);
+        int e = m_validated;
+        Tuple tuple = m_playlist.entry_tuple (e, Playlist::NoWait);
+
+        if (entry_fingerprint (tuple) == m_fingerprints[e])
+            continue;
 
-        if (album_artist && album_artist != artist)
+        if (! changed)
         {
-            /* album and song have different artists;
-             * add separately under respective artists */
-            add_to_database (e,
-             {{SearchField::Artist, album_artist},
-              {SearchField::Album, tuple.get_str (Tuple::Album)}});
-            /* add Title node under a HiddenAlbum node so that it can
-             * still be searched by album name (without listing the
-             * album twice) */
-            add_to_database (e,
-             {{SearchField::Artist, artist},
-              {SearchField::HiddenAlbum, tuple.get_str (Tuple::Album)},
-              {SearchField::Title, tuple.get_str (Tuple::Title)}});
+            m_items.clear ();
+            m_hidden_items = 0;
+            changed = true;
         }
-        else
+
+        remove_entry (e);
+        m_fingerprints[e] = add_entry (e, tuple, & m_leaves[e * leaves_per_entry]);
+        m_changed = true;
+    }
+
+    if (m_dead_items > m_all_items.len () / 2)
+    {
+        create_database (m_playlist);
+        changed = true;
+    }
+
+    return changed;
+}
+
+static StringBuf cache_path ()
+{
+    return filename_build ({aud_get_path (AudPath::UserDir), CACHE_NAME});
+}
+
+static uint32_t get_word (const char * data, int64_t word)
+{
+    auto p = (const unsigned char *) data + 4 * word;
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void put_word (Index<char> & buf, uint32_t value)
+{
+    char bytes[4] = {(char) value, (char) (value >> 8), (char) (value >> 16),
+     (char) (value >> 24)};
+    buf.insert (bytes, -1, 4);
+}
+
+/*
+ * Cache layout (all numbers are little-endian 32-bit words):
+ *
+ *   header     magic "ASIX", version, number of entries, stamp, number of
+ *              strings, number of items, size of the string data (in words)
+ *   strings    offset of each string into the string data
+ *   string data, NUL-terminated UTF-8, padded to a multiple of 4 bytes
+ *   items      per item, in order of creation: field, name (string index),
+ *              parent (item index), number of matches, the matches
+ *   entries    per entry: fingerprint, last item of each chain
+ *
+ * The stamp combines the fingerprints of all entries.
+ */
+bool SearchModel::read_cache (Playlist playlist, const char * data, int64_t size)
+{
+    int64_t words = size / 4;
+    if (words < CACHE_HEADER_WORDS || memcmp (data, CACHE_MAGIC, 4) ||
+     get_word (data, 1) != CACHE_VERSION)
+        return false;
+
+    uint32_t n_entries = get_word (data, 2);
+    uint32_t stamp = get_word (data, 3);
+    uint32_t n_strings = get_word (data, 4);
+    uint32_t n_items = get_word (data, 5);
+    uint32_t text_words = get_word (data, 6);
+
+    if (n_entries != (uint32_t) playlist.n_entries ())
+        return false;
+
+    int64_t text = CACHE_HEADER_WORDS + (int64_t) n_strings;
+    int64_t pos = text + text_words;
+    int64_t entries = words - (int64_t) n_entries * (1 + leaves_per_entry);
+
+    if (entries < pos)
+        return false;
+
+    uint32_t check = 0;
+    for (uint32_t e = 0; e < n_entries; e ++)
+        check = check * 31 + get_word (data, entries + e * (1 + leaves_per_entry));
+
+    if (check != stamp)
+        return false;
+
+    /* a quick check that this is still the same playlist;
+     * the other entries are checked later (see validate) */
+    for (int e : {0, (int) n_entries - 1})
+    {
+        if (e >= 0 && entry_fingerprint (playlist.entry_tuple (e, Playlist::NoWait)) !=
+         get_word (data, entries + e * (1 + leaves_per_entry)))
+            return false;
+    }
+
+    Index<String> strings;
+    strings.insert (0, n_strings);
+
+    for (uint32_t i = 0; i < n_strings; i ++)
+    {
+        uint32_t offset = get_word (data, CACHE_HEADER_WORDS + i);
+        const char * str = data + 4 * text + offset;
+
+        if (offset >= 4 * (int64_t) text_words ||
+         ! memchr (str, 0, 4 * (int64_t) text_words - offset))
+            return false;
+
+        strings[i] = String (str);
+    }
+
+    m_playlist = playlist;
+    m_entries = n_entries;
+
+    for (uint32_t i = 0; i < n_items; i ++)
+    {
+        if (pos + 4 > entries)
+            return false;
+
+        uint32_t field = get_word (data, pos);
+        uint32_t name = get_word (data, pos + 1);
+        uint32_t parent = get_word (data, pos + 2);
+        uint32_t n_matches = get_word (data, pos + 3);
+        pos += 4;
+
+        if (field >= (uint32_t) SearchField::count || name >= n_strings ||
+         (parent != CACHE_NONE && parent >= i) || n_matches > entries - pos)
+            return false;
+
+        Item * parent_item = (parent != CACHE_NONE) ? m_all_items[parent] : nullptr;
+        auto hash = parent_item ? & parent_item->children : & m_database;
+        Key key = {(SearchField) field, strings[name]};
+
+        if (hash->lookup (key))
+            return false;
+
+        Item * item = hash->add (key, Item (key.field, key.name, parent_item));
+        index_item (item);
+
+        item->matches.insert (0, n_matches);
+
+        for (uint32_t m = 0; m < n_matches; m ++)
+        {
+            uint32_t entry = get_word (data, pos + m);
+            if (entry >= n_entries || (m && entry <= (uint32_t) item->matches[m - 1]))
+                return false;
+
+            item->matches[m] = entry;
+        }
+
+        pos += n_matches;
+    }
+
+    if (pos != entries)
+        return false;
+
+    m_leaves.insert (0, n_entries * leaves_per_entry);
+    m_fingerprints.insert (0, n_entries);
+
+    for (uint32_t e = 0; e < n_entries; e ++, pos += 1 + leaves_per_entry)
+    {
+        m_fingerprints[e] = get_word (data, pos);
+
+        for (int i = 0; i < leaves_per_entry; i ++)
         {
-            /* album and song have the same artist;
-             * add hierarchically under that artist */
-            add_to_database (e,
-             {{SearchField::Artist, artist},
-              {SearchField::Album, tuple.get_str (Tuple::Album)},
-              {SearchField::Title, tuple.get_str (Tuple::Title)}});
+            uint32_t id = get_word (data, pos + 1 + i);
+            if (id != CACHE_NONE && id >= n_items)
+                return false;
+
+            m_leaves[e * leaves_per_entry + i] = (id != CACHE_NONE) ? m_all_items[id] : nullptr;
         }
+    }
 
-        /* add separately under genre */
-        add_to_database (e,
-         {{SearchField::Genre, tuple.get_str (Tuple::Genre)}});
+    return true;
+}
+
+/* Loads the database saved at the end of the last session, so that the
+ * library can be searched before it is ready.  The entries must then be
+ * checked against the playlist with validate (). */
+bool SearchModel::load_cache (Playlist playlist)
+{
+    destroy_database ();
+
+    GMappedFile * file = g_mapped_file_new (cache_path (), false, nullptr);
+    if (! file)
+        return false;
+
+    bool success = read_cache (playlist, g_mapped_file_get_contents (file),
+     g_mapped_file_get_length (file));
+
+    g_mapped_file_unref (file);
+
+    if (! success)
+    {
+        AUDWARN ("Search index is out of date, it will be rebuilt.\n");
+        destroy_database ();
     }
 
-    m_playlist = playlist;
+    return success;
 }
 
-static void search_recurse (SimpleHash<Key, Item> & domain,
- const Index<String> & terms, int mask, Index<const Item *> & results)
+void SearchModel::save_cache ()
 {
-    domain.iterate ([&] (const Key & key, Item & item)
+    if (! m_changed || ! is_usable ())
+        return;
+
+    SimpleHash<String, uint32_t> string_table;
+    Index<char> offsets, text, items, entries;
+
+    auto add_string = [&] (const String & str) {
+        uint32_t * index = string_table.lookup (str);
+        if (index)
+            return * index;
+
+        uint32_t added = offsets.len () / 4;
+        put_word (offsets, text.len ());
+        text.insert (str, -1, strlen (str) + 1);
+        string_table.add (str, std::move (added));
+        return added;
+    };
+
+    /* removed items are skipped, so the items are numbered anew */
+    Index<uint32_t> ids;
+    ids.insert (0, m_all_items.len ());
+    uint32_t n_items = 0;
+
+    for (Item * item : m_all_items)
+    {
+        if (! item)
+            continue;
+
+        ids[item->id] = n_items ++;
+        put_word (items, (uint32_t) item->field);
+        put_word (items, add_string (item->name));
+        put_word (items, item->parent ? ids[item->parent->id] : CACHE_NONE);
+        put_word (items, item->matches.len ());
+
+        for (int entry : item->matches)
+            put_word (items, entry);
+    }
+
+    uint32_t stamp = 0;
+
+    for (int e = 0; e < m_entries; e ++)
     {
-        int count = terms.len ();
-        int new_mask = mask;
+        stamp = stamp * 31 + m_fingerprints[e];
+        put_word (entries, m_fingerprints[e]);
 
-        for (int t = 0, bit = 1; t < count; t ++, bit <<= 1)
+        for (int i = 0; i < leaves_per_entry; i ++)
         {
-            if (! (new_mask & bit))
-                continue; /* skip term if it is already found */
+            Item * leaf = m_leaves[e * leaves_per_entry + i];
+            put_word (entries, leaf ? ids[leaf->id] : CACHE_NONE);
+        }
+    }
+
+    while (text.len () % 4)
+        text.append (0);
 
-            if (strstr (item.folded, terms[t]))
-                new_mask &= ~bit; /* we found it */
-            else if (! item.children.n_items ())
-                break; /* quit early if there are no children to search */
+    Index<char> header;
+    header.insert (CACHE_MAGIC, 0, 4);
+    put_word (header, CACHE_VERSION);
+    put_word (header, m_entries);
+    put_word (header, stamp);
+    put_word (header, offsets.len () / 4);
+    put_word (header, n_items);
+    put_word (header, text.len () / 4);
+
+    VFSFile file (cache_path (), "w");
+    bool success = false;
+
+    if (file)
+    {
+        success = true;
+        for (auto buf : {& header, & offsets, & text, & items, & entries})
+            success = success && file.fwrite (buf->begin (), 1, buf->len ()) == buf->len ();
+
+        success = success && file.fflush () == 0;
+    }
+
+    if (success)
+        m_changed = false;
+    else
+        AUDERR ("Failed to save search index.\n");
+}
+
+/* Finds the items whose own (folded) names contain the term. Names
+ * containing a term of three or more bytes must contain each of its
+ * trigrams, so only the items in the shortest posting list are checked. */
+void SearchModel::find_term (const char * term, Index<int> & ids)
+{
+    auto s = (const unsigned char *) term;
+    int len = strlen (term);
+
+    if (len < 3)
+    {
+        for (const Item * item : m_all_items)
+        {
+            if (item && strstr (item->folded, term))
+                ids.append (item->id);
         }
 
-        /* adding an item with exactly one child is redundant, so avoid it */
-        if (! new_mask && item.children.n_items () != 1 &&
-         item.field != SearchField::HiddenAlbum)
-            results.append (& item);
+        return;
+    }
+
+    const Index<int> * shortest = nullptr;
+
+    for (int i = 0; i + 3 <= len; i ++)
+    {
+        Trigram key = {(uint32_t) s[i] | (uint32_t) s[i + 1] << 8 | (uint32_t) s[i + 2] << 16};
+
+        const Index<int> * list = m_trigrams.lookup (key);
+        if (! list)
+            return; /* no name contains this trigram */
+
+        if (! shortest || list->len () < shortest->len ())
+            shortest = list;
+    }
+
+    for (int id : * shortest)
+    {
+        const Item * item = m_all_items[id];
+        if (item && strstr (item->folded, term))
+            ids.append (id);
+    }
+}
+
+/* A term is matched by an item if it is found in the name of the item or
+ * of any of its parents; mask holds the terms matched by the parents. */
+void SearchModel::collect_results (Item * item, uint32_t mask, uint32_t all_terms)
+{
+    mask |= m_term_mask[item->id];
+
+    /* adding an item with exactly one child is redundant, so avoid it */
+    if (mask == all_terms && item->children.n_items () != 1 &&
+     item->field != SearchField::HiddenAlbum)
+        m_items.append (item);
 
-        search_recurse (item.children, terms, new_mask, results);
-    });
+    item->children.iterate ([&] (const Key & key, Item & child)
+        { collect_results (& child, mask, all_terms); });
 }
 
 static int item_compare (const Item * const & a, const Item * const & b)
@@ -154,15 +693,76 @@ void SearchModel::do_search (const Index<String> & terms, int max_results)
     m_items.clear ();
     m_hidden_items = 0;
 
+    if (m_suspended)
+        return;
+
     /* effectively limits number of search terms to 32 */
-    search_recurse (m_database, terms, (1 << terms.len ()) - 1, m_items);
+    int count = aud::min (terms.len (), 32);
+    uint32_t all_terms = (count < 32) ? (1u << count) - 1 : 0xffffffff;
+
+    if (m_term_mask.len () != m_all_items.len ())
+        m_term_mask.resize (m_all_items.len ());
 
-    /* first sort by number of songs per item */
-    m_items.sort (item_compare_pass1);
+    /* look up each term in the index; every result is, or is a child of,
+     * an item matching the term with the fewest direct matches */
+    Index<Index<int>> found;
+    int rarest = -1;
 
-    /* limit to items with most songs */
+    for (int t = 0; t < count; t ++)
+    {
+        Index<int> & ids = found.append ();
+        find_term (terms[t], ids);
+
+        for (int id : ids)
+            m_term_mask[id] |= 1u << t;
+
+        if (rarest < 0 || ids.len () < found[rarest].len ())
+            rarest = t;
+    }
+
+    if (rarest < 0)
+    {
+        /* no terms; everything matches */
+        m_database.iterate ([&] (const Key & key, Item & item)
+            { collect_results (& item, 0, 0); });
+    }
+    else
+    {
+        uint32_t bit = 1u << rarest;
+
+        for (int id : found[rarest])
+        {
+            Item * item = m_all_items[id];
+            uint32_t mask = 0;
+            bool covered = false;
+
+            for (auto parent = item->parent; parent; parent = parent->parent)
+            {
+                /* the parent will be visited itself, with its children */
+                if (m_term_mask[parent->id] & bit)
+                    covered = true;
+
+                mask |= m_term_mask[parent->id];
+            }
+
+            if (! covered)
+                collect_results (item, mask, all_terms);
+        }
+    }
+
+    for (auto & ids : found)
+    {
+        for (int id : ids)
+            m_term_mask[id] = 0;
+    }
+
+    /* limit to items with most songs; a partial selection is enough */
     if (m_items.len () > max_results)
     {
+        std::nth_element (m_items.begin (), m_items.begin () + max_results,
+         m_items.end (), [] (const Item * a, const Item * b)
+            { return item_compare_pass1 (a, b) < 0; });
+
         m_hidden_items = m_items.len () - max_results;
         m_items.remove (max_results, -1);
     }
@@ -37,6 +37,9 @@
 
 #define CFG_ID "search-tool"
 #define SEARCH_DELAY 300
+#define RESCAN_DELAY 1000
+#define VALIDATE_DELAY 50
+#define VALIDATE_ENTRIES 2000
 
 class SearchTool : public GeneralPlugin
 {
@@ -63,10 +66,12 @@ public:
 EXPORT SearchTool aud_plugin_instance;
 
 static void trigger_search ();
+static void reset_monitor ();
 
 const char * const SearchTool::defaults[] = {
     "max_results", "20",
     "rescan_on_startup", "FALSE",
+    "monitor", "FALSE",
     nullptr
 };
 
@@ -75,7 +80,9 @@ const PreferencesWidget SearchTool::widgets[] = {
         WidgetInt (CFG_ID, "max_results", trigger_search),
          {10, 10000, 10}),
     WidgetCheck (N_("Rescan library at startup"),
-        WidgetBool (CFG_ID, "rescan_on_startup"))
+        WidgetBool (CFG_ID, "rescan_on_startup")),
+    WidgetCheck (N_("Monitor library for changes"),
+        WidgetBool (CFG_ID, "monitor", reset_monitor))
 };
 
 const PluginPreferences SearchTool::prefs = {{widgets}};
@@ -87,6 +94,13 @@ static Index<bool> s_selection;
 static QueuedFunc s_search_timer;
 static bool s_search_pending;
 
+static QueuedFunc s_validate_timer;
+
+static bool s_monitoring;
+static SimpleHash<String, GFileMonitor *> s_monitors;  /* by path */
+static Index<String> s_changed_folders;  /* URIs */
+static QueuedFunc s_rescan_timer;
+
 static GtkWidget * entry, * help_label, * wait_label, * scrolled, * results_list, * stats_label;
 
 static String get_uri ()
@@ -118,7 +132,7 @@ static void show_hide_widgets ()
     {
         gtk_widget_hide (help_label);
 
-        if (s_library->is_ready ())
+        if (s_library->is_ready () || s_model.is_usable ())
         {
             gtk_widget_hide (wait_label);
             gtk_widget_show (scrolled);
@@ -173,28 +187,183 @@ void Library::signal_update ()
 {
     if (s_library->is_ready ())
     {
-        s_model.create_database (s_library->playlist ());
+        s_model.update_database (s_library->playlist (), s_library->take_changes ());
         search_timeout ();
     }
     else
     {
-        s_model.destroy_database ();
-        s_selection.clear ();
-        audgui_list_delete_rows (results_list, 0, audgui_list_row_count (results_list));
-        gtk_label_set_text ((GtkLabel *) stats_label, "");
+        /* keep the database to be updated once the library is ready;
+         * until entries are added or removed, it can still be searched */
+        if (s_library->playlist () == Playlist ())
+            s_model.destroy_database ();
+        else if (s_library->entries_changed () ||
+         s_model.playlist () != s_library->playlist ())
+            s_model.suspend ();
+
+        if (s_model.is_usable ())
+            search_timeout ();
+        else
+        {
+            s_selection.clear ();
+            audgui_list_delete_rows (results_list, 0, audgui_list_row_count (results_list));
+            gtk_label_set_text ((GtkLabel *) stats_label, "");
+        }
     }
 
     show_hide_widgets ();
 }
 
+/* Changes often come in bursts (copying an album, for example), so they
+ * are collected for a moment and then only the changed folders are
+ * rescanned. */
+static void rescan_changed_folders ()
+{
+    s_library->begin_rescan (get_uri (), std::move (s_changed_folders));
+    s_library->check_ready_and_update (true);
+    s_changed_folders.clear ();
+}
+
+static void monitor_cb (GFileMonitor *, GFile * file, GFile *, GFileMonitorEvent event, void *)
+{
+    if (event != G_FILE_MONITOR_EVENT_CREATED &&
+     event != G_FILE_MONITOR_EVENT_DELETED &&
+     event != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT)
+        return;
+
+    CharPtr path (g_file_get_path (file));
+    if (! path)
+        return;
+
+    /* a new folder is listed when its parent is rescanned and is watched
+     * once that is done (see Library::signal_walk_done) */
+    if (event == G_FILE_MONITOR_EVENT_DELETED)
+    {
+        String key (path);
+        GFileMonitor * * monitor = s_monitors.lookup (key);
+
+        if (monitor)
+        {
+            g_object_unref (* monitor);
+            s_monitors.remove (key);
+        }
+    }
+
+    CharPtr folder (g_path_get_dirname (path));
+    String uri (filename_to_uri (folder));
+
+    if (uri && s_changed_folders.find (uri) < 0)
+        s_changed_folders.append (uri);
+
+    s_rescan_timer.queue (RESCAN_DELAY, rescan_changed_folders);
+}
+
+static void monitor_folder (const String & path)
+{
+    if (s_monitors.lookup (path))
+        return;
+
+    GFile * file = g_file_new_for_path (path);
+    GFileMonitor * monitor = g_file_monitor_directory (file, G_FILE_MONITOR_NONE, nullptr, nullptr);
+    g_object_unref (file);
+
+    if (! monitor)
+        return;
+
+    g_signal_connect (monitor, "changed", (GCallback) monitor_cb, nullptr);
+    s_monitors.add (path, std::move (monitor));
+}
+
+/* GFileMonitor doesn't support recursion, so every folder is watched; the
+ * list of folders is taken from the last walk of the library, so that the
+ * folders need not be listed again here */
+static void update_monitor ()
+{
+    if (! s_monitoring)
+        return;
+
+    SimpleHash<String, bool> folders;
+    for (auto & uri : s_library->folders (get_uri ()))
+    {
+        StringBuf path = uri_to_filename (uri);
+        if (path)
+            folders.add (String (path), true);
+    }
+
+    /* a walk is running; it will call back when done */
+    if (! folders.n_items ())
+        return;
+
+    Index<String> gone;
+    s_monitors.iterate ([&] (const String & path, GFileMonitor * & monitor) {
+        if (! folders.lookup (path))
+        {
+            g_object_unref (monitor);
+            gone.append (path);
+        }
+    });
+
+    for (auto & path : gone)
+        s_monitors.remove (path);
+
+    folders.iterate ([] (const String & path, bool &)
+        { monitor_folder (path); });
+}
+
+void Library::signal_walk_done ()
+{
+    update_monitor ();
+}
+
+static void stop_monitor ()
+{
+    s_monitors.iterate ([] (const String &, GFileMonitor * & monitor)
+        { g_object_unref (monitor); });
+
+    s_monitors.clear ();
+    s_changed_folders.clear ();
+    s_rescan_timer.stop ();
+    s_monitoring = false;
+}
+
+static void reset_monitor ()
+{
+    if (s_monitoring)
+    {
+        AUDINFO ("Stopping monitoring.\n");
+        stop_monitor ();
+    }
+
+    if (s_library && aud_get_bool (CFG_ID, "monitor") && uri_to_filename (get_uri ()))
+    {
+        AUDINFO ("Starting monitoring.\n");
+        s_monitoring = true;
+        update_monitor ();
+    }
+}
+
+/* a database loaded from the cache is checked against the library a bit
+ * at a time, so that searching can start right away */
+static void validate_cb ()
+{
+    if (! s_model.is_validating ())
+        s_validate_timer.stop ();
+    else if (s_model.validate (VALIDATE_ENTRIES) && s_model.is_usable ())
+        search_timeout ();
+}
+
 static void search_init ()
 {
     s_library = new Library;
 
+    if (s_library->playlist () != Playlist () &&
+     s_model.load_cache (s_library->playlist ()))
+        s_validate_timer.start (VALIDATE_DELAY, validate_cb);
+
     if (aud_get_bool (CFG_ID, "rescan_on_startup"))
         s_library->begin_add (get_uri ());
 
     s_library->check_ready_and_update (true);
+    reset_monitor ();
 }
 
 static void search_cleanup ()
@@ -202,9 +371,13 @@ static void search_cleanup ()
     s_search_timer.stop ();
     s_search_pending = false;
 
+    stop_monitor ();
+    s_validate_timer.stop ();
+
     delete s_library;
     s_library = nullptr;
 
+    s_model.save_cache ();
     s_model.destroy_database ();
     s_selection.clear ();
 }
@@ -426,6 +599,7 @@ static void refresh_cb (GtkButton * button, GtkWidget * file_entry)
 
         s_library->begin_add (uri);
         s_library->check_ready_and_update (true);
+        reset_monitor ();
     }
 }
 
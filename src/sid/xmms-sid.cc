@@ -126,6 +126,48 @@ bool SIDPlugin::is_our_file(const char *filename, VFSFile &file)
 }
 
 
+/*
+ * Seek to the given position by emulating ahead with muted output.
+ * The emulator state cannot be saved and restored, so seeking
+ * backwards restarts the sub-tune and fast-forwards from the start.
+ */
+static bool xs_seek(int subTune, int64_t &bytes_played, int64_t target,
+    char *audioBuffer, int audioBufSize)
+{
+    int frameSize = xs_cfg.audioChannels * 2;
+
+    if (target < bytes_played) {
+        if (!xs_sidplayfp_initsong(subTune))
+            return false;
+
+        bytes_played = 0;
+    }
+
+    while (bytes_played < target) {
+        int64_t remaining = (target - bytes_played) / frameSize;
+        int factor = XS_FASTFORWARD_MAX / 100;
+
+        /* Finish the last few frames at normal speed to land exactly */
+        if (remaining < factor)
+            factor = 1;
+
+        int64_t frames = aud::min<int64_t> (remaining / factor, audioBufSize / frameSize);
+        if (frames < 1)
+            break;
+
+        xs_sidplayfp_fastforward(factor * 100);
+        int got = xs_sidplayfp_fillbuffer(audioBuffer, frames * frameSize);
+        if (got <= 0)
+            break;
+
+        bytes_played += (int64_t) got * factor;
+    }
+
+    xs_sidplayfp_fastforward(100);
+    return true;
+}
+
+
 /*
  * Start playing the given file
  */
@@ -169,6 +211,15 @@ bool SIDPlugin::play(const char *filename, VFSFile &file)
         return false;
     }
 
+    /* Let the seek bar reflect the effective play time */
+    if (tmpLength >= 0) {
+        Tuple tuple = get_playback_tuple();
+        if (tuple.get_int(Tuple::Length) != tmpLength) {
+            tuple.set_int(Tuple::Length, tmpLength);
+            set_playback_tuple(tuple.ref());
+        }
+    }
+
     /* Open the audio output */
     open_audio(FMT_S16_NE, xs_cfg.audioFrequency, xs_cfg.audioChannels);
 
@@ -182,8 +233,17 @@ bool SIDPlugin::play(const char *filename, VFSFile &file)
 
     while (! check_stop ())
     {
-        if (check_seek () >= 0)
-            AUDWARN ("Seeking is not implemented, ignoring.\n");
+        int seek_value = check_seek ();
+        if (seek_value >= 0) {
+            int64_t target = aud::rescale<int64_t> (seek_value, 1000,
+             xs_cfg.audioFrequency) * xs_cfg.audioChannels * 2;
+
+            if (!xs_seek(subTune, bytes_played, target, audioBuffer, audioBufSize)) {
+                AUDERR("Couldn't restart SID-tune '%s' (sub-tune #%i) for seeking!\n",
+                    filename, subTune);
+                break;
+            }
+        }
 
         int bufRemaining = xs_sidplayfp_fillbuffer(audioBuffer, audioBufSize);
 
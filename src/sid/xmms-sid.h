@@ -34,6 +34,10 @@
  */
 #define XS_AUDIO_FREQ (44100)
 
+/* Maximum emulation speed used for seeking, in percent of real time
+ */
+#define XS_FASTFORWARD_MAX (3200)
+
 /* Plugin-wide typedefs
  */
 struct xs_subtuneinfo_t
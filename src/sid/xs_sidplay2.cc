@@ -224,6 +224,14 @@ unsigned xs_sidplayfp_fillbuffer(char * audioBuffer, unsigned audioBufSize)
 }
 
 
+/* Set emulation speed in percent of real time (100 = normal speed)
+ */
+bool xs_sidplayfp_fastforward(unsigned percent)
+{
+    return state.currEng->fastForward(percent);
+}
+
+
 /* Load a given SID-tune file
  */
 bool xs_sidplayfp_load(const void *buf, int64_t bufSize)
@@ -10,6 +10,7 @@ void xs_sidplayfp_close();
 bool xs_sidplayfp_init();
 bool xs_sidplayfp_initsong(int subtune);
 unsigned xs_sidplayfp_fillbuffer(char *, unsigned);
+bool xs_sidplayfp_fastforward(unsigned percent);
 bool xs_sidplayfp_load(const void *buf, int64_t bufSize);
 bool xs_sidplayfp_getinfo(xs_tuneinfo_t &ti, const void *buf, int64_t bufSize);
 
@@ -30,8 +30,11 @@
 
 #include <libaudcore/hook.h>
 #include <libaudcore/mainloop.h>
+#include <libaudcore/multihash.h>
 #include <libaudcore/playlist.h>
 
+#include <QStaticText>
+
 #include "widget.h"
 
 class PlaylistSlider;
@@ -48,6 +51,7 @@ public:
     void resize (int width, int height);
     void set_font (const char * font);
     void refresh ();
+    void playlist_update ();
     bool handle_keypress (QKeyEvent * event);
     void row_info (int * rows, int * first);
     void scroll_to (int row);
@@ -68,6 +72,34 @@ private:
 
     void update_title ();
     void calc_layout ();
+    void calc_columns ();
+    void queue_draw_rows (int from, int to);
+
+    /* laid-out text is kept across redraws, keyed by text, width and style;
+     * the cache is cleared when the font changes */
+    struct LayoutKey {
+        String text;
+        int width, style;
+
+        bool operator== (const LayoutKey & b) const
+            { return text == b.text && width == b.width && style == b.style; }
+        unsigned hash () const
+            { return text.hash () + 31 * width + style; }
+    };
+
+    struct CachedLayout {
+        QStaticText layout;
+        int width;
+        unsigned used;
+    };
+
+    struct VisibleRow {
+        String title;
+        int length, queue_pos;
+    };
+
+    const CachedLayout & get_layout (const char * text, int width, int style);
+    void draw_layout (QPainter & cr, const CachedLayout & layout, int x, int y);
 
     int calc_position (int y) const;
     int adjust_position (bool relative, int position) const;
@@ -94,6 +126,13 @@ private:
     SmartPtr<QFontMetrics> m_metrics;
     String m_title_text;
 
+    SimpleHash<LayoutKey, CachedLayout> m_layouts;
+    unsigned m_layouts_used = 0;
+
+    Index<VisibleRow> m_visible;
+    int m_number_width = -1, m_length_width = 0, m_queue_width = -1;
+    int m_drawn_position = -1, m_drawn_focus = -1;
+
     Playlist m_playlist;
     int m_length = 0;
     int m_width = 0, m_height = 0, m_row_height = 1, m_offset = 0, m_rows = 0, m_first = 0;
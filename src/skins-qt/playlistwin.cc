@@ -498,6 +498,14 @@ static void update_cb (void *, void *)
     update_rollup_text ();
 }
 
+static void playlist_update_cb (void *, void *)
+{
+    playlistwin_list->playlist_update ();
+
+    update_info ();
+    update_rollup_text ();
+}
+
 static void follow_cb (void * data, void *)
 {
     auto list = aud::from_ptr<Playlist> (data);
@@ -522,12 +530,12 @@ void playlistwin_create ()
 
     hook_associate ("playlist position", follow_cb, nullptr);
     hook_associate ("playlist activate", update_cb, nullptr);
-    hook_associate ("playlist update", update_cb, nullptr);
+    hook_associate ("playlist update", playlist_update_cb, nullptr);
 }
 
 void playlistwin_unhook ()
 {
     hook_dissociate ("playlist position", follow_cb);
     hook_dissociate ("playlist activate", update_cb);
-    hook_dissociate ("playlist update", update_cb);
+    hook_dissociate ("playlist update", playlist_update_cb);
 }
@@ -129,9 +129,9 @@ private:
     }
 };
 
-void skin_load_hints (const char * path)
+void skin_load_hints (SkinFiles & files)
 {
-    VFSFile file = open_local_file_nocase (path, "skin.hints");
+    VFSFile file = files.open_file ("skin.hints");
     if (file)
         HintsParser ().parse (file);
 }
@@ -173,14 +173,14 @@ private:
     }
 };
 
-void skin_load_pl_colors (const char * path)
+void skin_load_pl_colors (SkinFiles & files)
 {
     skin.colors[SKIN_PLEDIT_NORMAL] = 0x2499ff;
     skin.colors[SKIN_PLEDIT_CURRENT] = 0xffeeff;
     skin.colors[SKIN_PLEDIT_NORMALBG] = 0x0a120a;
     skin.colors[SKIN_PLEDIT_SELECTEDBG] = 0x0a124a;
 
-    VFSFile file = open_local_file_nocase (path, "pledit.txt");
+    VFSFile file = files.open_file ("pledit.txt");
     if (file)
         PLColorsParser ().parse (file);
 }
@@ -258,7 +258,7 @@ static Index<QRect> skin_create_mask (const Index<int> & num,
     return mask;
 }
 
-void skin_load_masks (const char * path)
+void skin_load_masks (SkinFiles & files)
 {
     int sizes[SKIN_MASK_COUNT][2] = {
         {skin.hints.mainwin_width, skin.hints.mainwin_height},
@@ -268,7 +268,7 @@ void skin_load_masks (const char * path)
     };
 
     MaskParser parser;
-    VFSFile file = open_local_file_nocase (path, "region.txt");
+    VFSFile file = files.open_file ("region.txt");
     if (file)
         parser.parse (file);
 
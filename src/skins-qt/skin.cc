@@ -93,26 +93,27 @@ static const uint32_t default_vis_colors[24] = {
 
 Skin skin;
 
-static bool skin_load_pixmap_id (SkinPixmapId id, const char * path)
+static bool skin_load_pixmap_id (SkinPixmapId id, SkinFiles & files)
 {
-    StringBuf filename = skin_pixmap_locate (path, skin_pixmap_id_map[id].name,
+    VFSFile file = files.open_pixmap (skin_pixmap_id_map[id].name,
      skin_pixmap_id_map[id].alt_name);
 
-    if (! filename)
+    if (! file)
     {
         AUDERR ("Skin does not contain a \"%s\" pixmap.\n", skin_pixmap_id_map[id].name);
         return false;
     }
 
     QImage & image = skin.pixmaps[id];
-    image.load ((const char *) filename);
+    Index<char> data = file.read_all ();
+    image.loadFromData ((const uchar *) data.begin (), data.len ());
 
     if (! image.isNull () && image.format () != QImage::Format_RGB32)
         image = image.convertToFormat (QImage::Format_RGB32);
 
     if (image.isNull ())
     {
-        AUDERR ("Error loading pixmap: %s\n", (const char *) filename);
+        AUDERR ("Error loading pixmap: %s\n", file.filename ());
         return false;
     }
 
@@ -159,11 +160,11 @@ static void skin_get_eq_spline_colors (const QImage & image)
         skin.eq_spline_colors[i] = image.pixel (115, i + 294);
 }
 
-static void skin_load_viscolor (const char * path)
+static void skin_load_viscolor (SkinFiles & files)
 {
     memcpy (skin.vis_colors, default_vis_colors, sizeof skin.vis_colors);
 
-    VFSFile file = open_local_file_nocase (path, "viscolor.txt");
+    VFSFile file = files.open_file ("viscolor.txt");
     if (! file)
         return;
 
@@ -203,13 +204,11 @@ static void skin_numbers_generate_dash (QImage & image)
     image = std::move (temp);
 }
 
-static bool skin_load_pixmaps (const char * path)
+static bool skin_load_pixmaps (SkinFiles & files)
 {
-    AUDDBG ("Loading pixmaps in %s\n", path);
-
     /* eq_ex.bmp was added after Winamp 2.0 so some skins do not include it */
     for (int i = 0; i < SKIN_PIXMAP_COUNT; i ++)
-        if (! skin_load_pixmap_id ((SkinPixmapId) i, path) && i != SKIN_EQ_EX)
+        if (! skin_load_pixmap_id ((SkinPixmapId) i, files) && i != SKIN_EQ_EX)
             return false;
 
     skin_get_textcolors (skin.pixmaps[SKIN_TEXT]);
@@ -226,36 +225,25 @@ static bool skin_load_data (const char * path)
     if (! g_file_test (path, G_FILE_TEST_EXISTS))
         return false;
 
-    StringBuf archive_path;
-    if (file_is_archive (path))
+    SkinFiles files;
+    if (! files.open (path))
     {
-        AUDDBG ("Attempt to load archive\n");
-        archive_path = archive_decompress (path);
-
-        if (! archive_path)
-        {
-            AUDDBG ("Unable to extract skin archive (%s)\n", path);
-            return false;
-        }
-
-        path = archive_path;
+        AUDDBG ("Unable to read skin (%s)\n", path);
+        return false;
     }
 
-    bool success = skin_load_pixmaps (path);
+    bool success = skin_load_pixmaps (files);
 
     if (success)
     {
-        skin_load_hints (path);
-        skin_load_pl_colors (path);
-        skin_load_viscolor (path);
-        skin_load_masks (path);
+        skin_load_hints (files);
+        skin_load_pl_colors (files);
+        skin_load_viscolor (files);
+        skin_load_masks (files);
     }
     else
         AUDDBG ("Skin loading failed\n");
 
-    if (archive_path)
-        del_directory (archive_path);
-
     return success;
 }
 
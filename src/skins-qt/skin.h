@@ -32,6 +32,8 @@
 #include <libaudcore/index.h>
 #include <libaudcore/objects.h>
 
+class SkinFiles;
+
 typedef enum {
     SKIN_MAIN = 0,
     SKIN_CBUTTONS,
@@ -189,8 +191,8 @@ void skin_draw_playlistwin_frame (QPainter & cr, int width, int height, bool foc
 void skin_draw_mainwin_titlebar (QPainter & cr, bool shaded, bool focus);
 
 /* ui_skin_load_ini.c */
-void skin_load_hints (const char * path);
-void skin_load_pl_colors (const char * path);
-void skin_load_masks (const char * path);
+void skin_load_hints (SkinFiles & files);
+void skin_load_pl_colors (SkinFiles & files);
+void skin_load_masks (SkinFiles & files);
 
 #endif
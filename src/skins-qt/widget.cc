@@ -34,11 +34,15 @@ void Widget::add_drawable (int width, int height)
     m_drawable = true;
 }
 
-void Widget::paintEvent (QPaintEvent *)
+void Widget::paintEvent (QPaintEvent * event)
 {
     if (m_drawable)
     {
         QPainter p (this);
+
+        /* lets draw() skip what lies outside the damaged area */
+        p.setClipRegion (event->region ());
+
         if (m_scale != 1)
             p.setTransform (QTransform ().scale (m_scale, m_scale));
 
@@ -33,6 +33,8 @@ class Widget : public QWidget
 {
 public:
     void queue_draw () { update (); }
+    void queue_draw_area (int x, int y, int width, int height)
+        { update (x * m_scale, y * m_scale, width * m_scale, height * m_scale); }
 
 protected:
     void add_input (int width, int height, bool track_motion, bool drawable);
@@ -59,7 +61,7 @@ protected:
     virtual bool close () { return false; }
 
 private:
-    void paintEvent (QPaintEvent *);
+    void paintEvent (QPaintEvent * event);
 
     void keyPressEvent (QKeyEvent * event)
         { event->setAccepted (keypress (event)); }
@@ -50,6 +50,14 @@ enum {
     DRAG_MOVE
 };
 
+enum {
+    LAYOUT_PLAIN,
+    LAYOUT_TITLE,
+    LAYOUT_HEADER
+};
+
+#define LAYOUT_CACHE_SIZE 512
+
 void PlaylistWidget::update_title ()
 {
     if (Playlist::n_playlists () > 1)
@@ -133,12 +141,124 @@ void PlaylistWidget::cancel_all ()
     popup_hide ();
 }
 
+const PlaylistWidget::CachedLayout & PlaylistWidget::get_layout
+ (const char * text, int width, int style)
+{
+    if (! text)
+        text = "";
+
+    LayoutKey key = {String (text), width, style};
+    CachedLayout * cached = m_layouts.lookup (key);
+
+    if (! cached)
+    {
+        /* drop the least recently used half of the cache when it is full */
+        if (m_layouts.n_items () >= LAYOUT_CACHE_SIZE)
+        {
+            unsigned keep = m_layouts_used - LAYOUT_CACHE_SIZE / 2;
+            Index<LayoutKey> old;
+
+            m_layouts.iterate ([&] (const LayoutKey & k, CachedLayout & layout) {
+                if ((int) (layout.used - keep) < 0)
+                    old.append (k);
+            });
+
+            for (auto & key : old)
+                m_layouts.remove (key);
+        }
+
+        PangoLayout * layout = gtk_widget_create_pango_layout (gtk_dr (), text);
+        pango_layout_set_font_description (layout, m_font.get ());
+
+        if (style == LAYOUT_TITLE || style == LAYOUT_HEADER)
+        {
+            pango_layout_set_width (layout, PANGO_SCALE * width);
+            pango_layout_set_ellipsize (layout, (style == LAYOUT_HEADER) ?
+             PANGO_ELLIPSIZE_MIDDLE : PANGO_ELLIPSIZE_END);
+        }
+
+        if (style == LAYOUT_HEADER)
+            pango_layout_set_alignment (layout, PANGO_ALIGN_CENTER);
+
+        PangoRectangle rect;
+        pango_layout_get_pixel_extents (layout, nullptr, & rect);
+
+        cached = m_layouts.add (key, {PangoLayoutPtr (layout), rect.width, 0});
+    }
+
+    cached->used = m_layouts_used ++;
+    return * cached;
+}
+
+/* fetches the visible entries and measures the columns beside the titles */
+void PlaylistWidget::calc_columns ()
+{
+    bool numbers = aud_get_bool ("show_numbers_in_pl");
+    bool queued = m_playlist.n_queued () > 0;
+
+    m_visible.clear ();
+    m_number_width = numbers ? 0 : -1;
+    m_length_width = 0;
+    m_queue_width = queued ? 0 : -1;
+
+    for (int i = m_first; i < m_first + m_rows && i < m_length; i ++)
+    {
+        Tuple tuple = m_playlist.entry_tuple (i, Playlist::NoWait);
+        VisibleRow & row = m_visible.append ();
+
+        row.title = tuple.get_str (Tuple::FormattedTitle);
+        row.length = tuple.get_int (Tuple::Length);
+        row.queue_pos = queued ? m_playlist.queue_find_entry (i) : -1;
+
+        if (numbers)
+        {
+            char buf[16];
+            snprintf (buf, sizeof buf, "%d.", 1 + i);
+            m_number_width = aud::max (m_number_width,
+             get_layout (buf, -1, LAYOUT_PLAIN).width);
+        }
+
+        if (row.length >= 0)
+            m_length_width = aud::max (m_length_width,
+             get_layout (str_format_time (row.length), -1, LAYOUT_PLAIN).width);
+
+        if (row.queue_pos >= 0)
+        {
+            char buf[16];
+            snprintf (buf, sizeof buf, "(#%d)", 1 + row.queue_pos);
+            m_queue_width = aud::max (m_queue_width,
+             get_layout (buf, -1, LAYOUT_PLAIN).width);
+        }
+    }
+}
+
+void PlaylistWidget::queue_draw_rows (int from, int to)
+{
+    from = aud::max (from, m_first);
+    to = aud::min (to, m_first + m_rows);
+
+    if (from < to)
+        queue_draw_area (0, m_offset + m_row_height * (from - m_first),
+         m_width, m_row_height * (to - from));
+}
+
 void PlaylistWidget::draw (cairo_t * cr)
 {
     int active_entry = m_playlist.get_position ();
     int left = 3, right = 3;
-    PangoLayout * layout;
-    int width;
+
+    calc_columns ();
+
+    m_drawn_position = active_entry;
+    m_drawn_focus = m_playlist.get_focus ();
+
+    /* only the rows within the damaged area are drawn */
+    double x1, y1, x2, y2;
+    cairo_clip_extents (cr, & x1, & y1, & x2, & y2);
+
+    int first = m_first + aud::max (((int) y1 - m_offset) / m_row_height, 0);
+    int last = m_first + aud::min (((int) y2 - m_offset + m_row_height - 1) /
+     m_row_height, m_visible.len ());
 
     /* background */
 
@@ -147,23 +267,18 @@ void PlaylistWidget::draw (cairo_t * cr)
 
     /* playlist title */
 
-    if (m_offset)
+    if (m_offset && y1 < m_offset)
     {
-        layout = gtk_widget_create_pango_layout (gtk_dr (), m_title_text);
-        pango_layout_set_font_description (layout, m_font.get ());
-        pango_layout_set_width (layout, PANGO_SCALE * (m_width - left - right));
-        pango_layout_set_alignment (layout, PANGO_ALIGN_CENTER);
-        pango_layout_set_ellipsize (layout, PANGO_ELLIPSIZE_MIDDLE);
+        auto & title = get_layout (m_title_text, m_width - left - right, LAYOUT_HEADER);
 
         cairo_move_to (cr, left, 0);
         set_cairo_color (cr, skin.colors[SKIN_PLEDIT_NORMAL]);
-        pango_cairo_show_layout (cr, layout);
-        g_object_unref (layout);
+        pango_cairo_show_layout (cr, title.layout.get ());
     }
 
     /* selection highlight */
 
-    for (int i = m_first; i < m_first + m_rows && i < m_length; i ++)
+    for (int i = first; i < last; i ++)
     {
         if (! m_playlist.entry_selected (i))
             continue;
@@ -175,114 +290,81 @@ void PlaylistWidget::draw (cairo_t * cr)
 
     /* entry numbers */
 
-    if (aud_get_bool ("show_numbers_in_pl"))
+    if (m_number_width >= 0)
     {
-        width = 0;
-
-        for (int i = m_first; i < m_first + m_rows && i < m_length; i ++)
+        for (int i = first; i < last; i ++)
         {
             char buf[16];
             snprintf (buf, sizeof buf, "%d.", 1 + i);
 
-            layout = gtk_widget_create_pango_layout (gtk_dr (), buf);
-            pango_layout_set_font_description (layout, m_font.get ());
-
-            PangoRectangle rect;
-            pango_layout_get_pixel_extents (layout, nullptr, & rect);
-            width = aud::max (width, rect.width);
-
             cairo_move_to (cr, left, m_offset + m_row_height * (i - m_first));
             set_cairo_color (cr, skin.colors[(i == active_entry) ?
              SKIN_PLEDIT_CURRENT : SKIN_PLEDIT_NORMAL]);
-            pango_cairo_show_layout (cr, layout);
-            g_object_unref (layout);
+            pango_cairo_show_layout (cr, get_layout (buf, -1, LAYOUT_PLAIN).layout.get ());
         }
 
-        left += width + 4;
+        left += m_number_width + 4;
     }
 
     /* entry lengths */
 
-    width = 0;
-
-    for (int i = m_first; i < m_first + m_rows && i < m_length; i ++)
+    for (int i = first; i < last; i ++)
     {
-        Tuple tuple = m_playlist.entry_tuple (i, Playlist::NoWait);
-        int len = tuple.get_int (Tuple::Length);
+        int len = m_visible[i - m_first].length;
         if (len < 0)
             continue;
 
-        layout = gtk_widget_create_pango_layout (gtk_dr (), str_format_time (len));
-        pango_layout_set_font_description (layout, m_font.get ());
-
-        PangoRectangle rect;
-        pango_layout_get_pixel_extents (layout, nullptr, & rect);
-        width = aud::max (width, rect.width);
+        auto & length = get_layout (str_format_time (len), -1, LAYOUT_PLAIN);
 
-        cairo_move_to (cr, m_width - right - rect.width, m_offset + m_row_height * (i - m_first));
+        cairo_move_to (cr, m_width - right - length.width, m_offset + m_row_height * (i - m_first));
         set_cairo_color (cr, skin.colors[(i == active_entry) ?
          SKIN_PLEDIT_CURRENT : SKIN_PLEDIT_NORMAL]);
-        pango_cairo_show_layout (cr, layout);
-        g_object_unref (layout);
+        pango_cairo_show_layout (cr, length.layout.get ());
     }
 
-    right += width + 6;
+    right += m_length_width + 6;
 
     /* queue positions */
 
-    if (m_playlist.n_queued ())
+    if (m_queue_width >= 0)
     {
-        width = 0;
-
-        for (int i = m_first; i < m_first + m_rows && i < m_length; i ++)
+        for (int i = first; i < last; i ++)
         {
-            int pos = m_playlist.queue_find_entry (i);
+            int pos = m_visible[i - m_first].queue_pos;
             if (pos < 0)
                 continue;
 
             char buf[16];
             snprintf (buf, sizeof buf, "(#%d)", 1 + pos);
 
-            layout = gtk_widget_create_pango_layout (gtk_dr (), buf);
-            pango_layout_set_font_description (layout, m_font.get ());
-
-            PangoRectangle rect;
-            pango_layout_get_pixel_extents (layout, nullptr, & rect);
-            width = aud::max (width, rect.width);
+            auto & queue = get_layout (buf, -1, LAYOUT_PLAIN);
 
-            cairo_move_to (cr, m_width - right - rect.width, m_offset +
+            cairo_move_to (cr, m_width - right - queue.width, m_offset +
              m_row_height * (i - m_first));
             set_cairo_color (cr, skin.colors[(i == active_entry) ?
              SKIN_PLEDIT_CURRENT : SKIN_PLEDIT_NORMAL]);
-            pango_cairo_show_layout (cr, layout);
-            g_object_unref (layout);
+            pango_cairo_show_layout (cr, queue.layout.get ());
         }
 
-        right += width + 6;
+        right += m_queue_width + 6;
     }
 
     /* titles */
 
-    for (int i = m_first; i < m_first + m_rows && i < m_length; i ++)
+    for (int i = first; i < last; i ++)
     {
-        Tuple tuple = m_playlist.entry_tuple (i, Playlist::NoWait);
-        String title = tuple.get_str (Tuple::FormattedTitle);
-
-        layout = gtk_widget_create_pango_layout (gtk_dr (), title);
-        pango_layout_set_font_description (layout, m_font.get ());
-        pango_layout_set_width (layout, PANGO_SCALE * (m_width - left - right));
-        pango_layout_set_ellipsize (layout, PANGO_ELLIPSIZE_END);
+        auto & title = get_layout (m_visible[i - m_first].title,
+         m_width - left - right, LAYOUT_TITLE);
 
         cairo_move_to (cr, left, m_offset + m_row_height * (i - m_first));
         set_cairo_color (cr, skin.colors[(i == active_entry) ?
          SKIN_PLEDIT_CURRENT : SKIN_PLEDIT_NORMAL]);
-        pango_cairo_show_layout (cr, layout);
-        g_object_unref (layout);
+        pango_cairo_show_layout (cr, title.layout.get ());
     }
 
     /* focus rectangle */
 
-    int focus = m_playlist.get_focus ();
+    int focus = m_drawn_focus;
 
     /* don't show rectangle if this is the only selected entry */
     if (focus >= m_first && focus <= m_first + m_rows - 1 &&
@@ -329,6 +411,7 @@ void PlaylistWidget::resize (int width, int height)
 void PlaylistWidget::set_font (const char * font)
 {
     m_font.capture (pango_font_description_from_string (font));
+    m_layouts.clear ();
 
     PangoLayout * layout = gtk_widget_create_pango_layout (gtk_dr (), "A");
     pango_layout_set_font_description (layout, m_font.get ());
@@ -365,6 +448,55 @@ void PlaylistWidget::refresh ()
         m_slider->refresh ();
 }
 
+/* Called for playlist updates.  When no rows have moved and the columns have
+ * kept their widths, only the changed rows are redrawn. */
+void PlaylistWidget::playlist_update ()
+{
+    auto update = m_playlist.update_detail ();
+
+    if (m_playlist != Playlist::active_playlist () || update.level ==
+     Playlist::Structure || update.queue_changed || m_playlist.n_entries () != m_length)
+    {
+        refresh ();
+        return;
+    }
+
+    String prev_title = m_title_text;
+    int widths[] = {m_number_width, m_length_width, m_queue_width};
+
+    update_title ();
+    calc_columns ();
+
+    if (m_title_text != prev_title || widths[0] != m_number_width ||
+     widths[1] != m_length_width || widths[2] != m_queue_width)
+    {
+        refresh ();
+        return;
+    }
+
+    int position = m_playlist.get_position ();
+    int focus = m_playlist.get_focus ();
+
+    if (update.level != Playlist::NoUpdate)
+    {
+        queue_draw_rows (update.before, m_length - update.after);
+        /* the focus rectangle depends on the number of selected entries */
+        queue_draw_rows (focus, focus + 1);
+    }
+
+    if (position != m_drawn_position)
+    {
+        queue_draw_rows (m_drawn_position, m_drawn_position + 1);
+        queue_draw_rows (position, position + 1);
+    }
+
+    if (focus != m_drawn_focus)
+    {
+        queue_draw_rows (m_drawn_focus, m_drawn_focus + 1);
+        queue_draw_rows (focus, focus + 1);
+    }
+}
+
 void PlaylistWidget::ensure_visible (int position)
 {
     if (position < m_first || position >= m_first + m_rows)
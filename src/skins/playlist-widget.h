@@ -30,6 +30,7 @@
 
 #include <libaudcore/hook.h>
 #include <libaudcore/mainloop.h>
+#include <libaudcore/multihash.h>
 #include <libaudcore/playlist.h>
 
 #include "widget.h"
@@ -38,6 +39,11 @@ class PlaylistSlider;
 
 typedef SmartPtr<PangoFontDescription, pango_font_description_free> PangoFontDescPtr;
 
+static inline void unref_layout (PangoLayout * layout)
+    { g_object_unref (layout); }
+
+typedef SmartPtr<PangoLayout, unref_layout> PangoLayoutPtr;
+
 class PlaylistWidget : public Widget
 {
 public:
@@ -48,6 +54,7 @@ public:
     void resize (int width, int height);
     void set_font (const char * font);
     void refresh ();
+    void playlist_update ();
     bool handle_keypress (GdkEventKey * event);
     void row_info (int * rows, int * first);
     void scroll_to (int row);
@@ -64,6 +71,33 @@ private:
 
     void update_title ();
     void calc_layout ();
+    void calc_columns ();
+    void queue_draw_rows (int from, int to);
+
+    /* shaped text is kept across redraws, keyed by text, width and style;
+     * the cache is cleared when the font changes */
+    struct LayoutKey {
+        String text;
+        int width, style;
+
+        bool operator== (const LayoutKey & b) const
+            { return text == b.text && width == b.width && style == b.style; }
+        unsigned hash () const
+            { return text.hash () + 31 * width + style; }
+    };
+
+    struct CachedLayout {
+        PangoLayoutPtr layout;
+        int width;  /* in pixels */
+        unsigned used;
+    };
+
+    struct VisibleRow {
+        String title;
+        int length, queue_pos;
+    };
+
+    const CachedLayout & get_layout (const char * text, int width, int style);
 
     int calc_position (int y) const;
     int adjust_position (bool relative, int position) const;
@@ -89,6 +123,13 @@ private:
     PangoFontDescPtr m_font;
     String m_title_text;
 
+    SimpleHash<LayoutKey, CachedLayout> m_layouts;
+    unsigned m_layouts_used = 0;
+
+    Index<VisibleRow> m_visible;
+    int m_number_width = -1, m_length_width = 0, m_queue_width = -1;
+    int m_drawn_position = -1, m_drawn_focus = -1;
+
     Playlist m_playlist;
     int m_length = 0;
     int m_width = 0, m_height = 0, m_row_height = 1, m_offset = 0, m_rows = 0, m_first = 0;
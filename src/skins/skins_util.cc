@@ -30,6 +30,7 @@
 #include <unistd.h>
 
 #include <glib/gstdio.h>
+#include <zlib.h>
 
 #include <libaudcore/audstrings.h>
 #include <libaudcore/i18n.h>
@@ -77,26 +78,6 @@ StringBuf find_file_case_path (const char * folder, const char * basename)
     return StringBuf ();
 }
 
-VFSFile open_local_file_nocase (const char * folder, const char * basename)
-{
-    StringBuf path = find_file_case_path (folder, basename);
-    return path ? VFSFile (path, "r") : VFSFile ();
-}
-
-StringBuf skin_pixmap_locate (const char * folder, const char * basename, const char * altname)
-{
-    static const char * const exts[] = {".bmp", ".png", ".xpm"};
-
-    for (const char * ext : exts)
-    {
-        StringBuf name = find_file_case_path (folder, str_concat ({basename, ext}));
-        if (name)
-            return name.settle ();
-    }
-
-    return altname ? skin_pixmap_locate (folder, altname) : StringBuf ();
-}
-
 char * text_parse_line (char * text)
 {
     char * newline = strchr (text, '\n');
@@ -116,8 +97,6 @@ enum ArchiveType {
     ARCHIVE_TBZ2
 };
 
-typedef StringBuf (* ArchiveExtractFunc) (const char *, const char *);
-
 struct ArchiveExtensionType {
     ArchiveType type;
     const char *ext;
@@ -133,22 +112,6 @@ static ArchiveExtensionType archive_extensions[] = {
     {ARCHIVE_TBZ2, ".bz2"}
 };
 
-static StringBuf archive_extract_tar (const char * archive, const char * dest);
-static StringBuf archive_extract_zip (const char * archive, const char * dest);
-static StringBuf archive_extract_tgz (const char * archive, const char * dest);
-static StringBuf archive_extract_tbz2 (const char * archive, const char * dest);
-
-static ArchiveExtractFunc archive_extract_funcs[] = {
-    nullptr,
-    archive_extract_tar,
-    archive_extract_tgz,
-    archive_extract_zip,
-    archive_extract_tbz2
-};
-
-/* FIXME: these functions can be generalised into a function using a
- * command lookup table */
-
 static const char * get_tar_command ()
 {
     static const char * command = nullptr;
@@ -162,40 +125,6 @@ static const char * get_tar_command ()
     return command;
 }
 
-static const char * get_unzip_command ()
-{
-    static const char * command = nullptr;
-
-    if (! command)
-    {
-        if (! (command = getenv("UNZIPCMD")))
-            command = "unzip";
-    }
-
-    return command;
-}
-
-static StringBuf archive_extract_tar (const char * archive, const char * dest)
-{
-    return str_printf ("%s >/dev/null xf \"%s\" -C %s", get_tar_command (), archive, dest);
-}
-
-static StringBuf archive_extract_zip (const char * archive, const char * dest)
-{
-    return str_printf ("%s >/dev/null -o -j \"%s\" -d %s", get_unzip_command (), archive, dest);
-}
-
-static StringBuf archive_extract_tgz (const char * archive, const char * dest)
-{
-    return str_printf ("%s >/dev/null xzf \"%s\" -C %s", get_tar_command (), archive, dest);
-}
-
-static StringBuf archive_extract_tbz2 (const char * archive, const char * dest)
-{
-    return str_printf ("bzip2 -dc \"%s\" | %s >/dev/null xf - -C %s", archive,
-     get_tar_command (), dest);
-}
-
 static ArchiveType archive_get_type (const char * filename)
 {
     for (auto & ext : archive_extensions)
@@ -254,15 +183,12 @@ static StringBuf escape_shell_chars (const char * string)
 }
 
 /**
- * Decompresses the archive "filename" to a temporary directory,
- * returns the path to the temp dir, or nullptr if failed
+ * Decompresses the bzip2-compressed archive "filename" to a temporary
+ * directory, returns the path to the temp dir, or nullptr if failed.
+ * The other archive types are read in memory by SkinFiles.
  */
-StringBuf archive_decompress (const char * filename)
+static StringBuf archive_decompress_tbz2 (const char * filename)
 {
-    ArchiveType type = archive_get_type (filename);
-    if (type == ARCHIVE_UNKNOWN)
-        return StringBuf ();
-
     StringBuf tmpdir = filename_build ({g_get_tmp_dir (), "audacious.XXXXXX"});
     if (! g_mkdtemp (tmpdir))
     {
@@ -271,19 +197,326 @@ StringBuf archive_decompress (const char * filename)
     }
 
     StringBuf escaped_filename = escape_shell_chars (filename);
-    StringBuf cmd = archive_extract_funcs[type] (escaped_filename, tmpdir);
+    StringBuf cmd = str_printf ("bzip2 -dc \"%s\" | %s >/dev/null xf - -C %s",
+     (const char *) escaped_filename, get_tar_command (), (const char *) tmpdir);
 
     AUDDBG ("Executing \"%s\"\n", (const char *) cmd);
     int ret = system (cmd);
     if (ret != 0)
     {
         AUDDBG ("Command \"%s\" returned error %d\n", (const char *) cmd, ret);
+        del_directory (tmpdir);
         return StringBuf ();
     }
 
     return tmpdir;
 }
 
+/* read-only file backed by a memory buffer */
+class MemoryFile : public VFSImpl
+{
+public:
+    MemoryFile (Index<char> && data) :
+        m_data (std::move (data)) {}
+
+    int64_t fread (void * ptr, int64_t size, int64_t nmemb)
+    {
+        if (size < 1)
+            return 0;
+
+        nmemb = aud::min (nmemb, (m_data.len () - m_pos) / size);
+        memcpy (ptr, m_data.begin () + m_pos, size * nmemb);
+        m_pos += size * nmemb;
+        return nmemb;
+    }
+
+    int64_t fwrite (const void * ptr, int64_t size, int64_t nmemb)
+        { return 0; }
+
+    int fseek (int64_t offset, VFSSeekType whence)
+    {
+        if (whence == VFS_SEEK_CUR)
+            offset += m_pos;
+        else if (whence == VFS_SEEK_END)
+            offset += m_data.len ();
+
+        if (offset < 0 || offset > m_data.len ())
+            return -1;
+
+        m_pos = offset;
+        return 0;
+    }
+
+    int64_t ftell ()
+        { return m_pos; }
+    int64_t fsize ()
+        { return m_data.len (); }
+    bool feof ()
+        { return m_pos >= m_data.len (); }
+    int ftruncate (int64_t size)
+        { return -1; }
+    int fflush ()
+        { return 0; }
+
+private:
+    Index<char> m_data;
+    int64_t m_pos = 0;
+};
+
+static unsigned get_le16 (const char * p)
+{
+    auto u = (const unsigned char *) p;
+    return u[0] | (u[1] << 8);
+}
+
+static uint32_t get_le32 (const char * p)
+{
+    auto u = (const unsigned char *) p;
+    return u[0] | (u[1] << 8) | (u[2] << 16) | ((uint32_t) u[3] << 24);
+}
+
+/* inflates raw deflate data (as in zip files) or a gzip stream */
+static Index<char> inflate_data (const char * data, int64_t size, int64_t out_size, bool gzip)
+{
+    Index<char> out;
+
+    z_stream stream {};
+    if (inflateInit2 (& stream, gzip ? 16 + MAX_WBITS : -MAX_WBITS) != Z_OK)
+        return out;
+
+    stream.next_in = (Bytef *) data;
+    stream.avail_in = size;
+
+    /* the expected size comes from the archive and is only a hint;
+     * deflate never expands data by more than a factor of 1032 */
+    if (out_size > size * 1032 + 1024)
+        out_size = size * 1032 + 1024;
+
+    int ret = Z_OK;
+    while (ret == Z_OK)
+    {
+        int64_t done = out.len ();
+        int64_t chunk = (out_size > done) ? out_size - done : aud::max (size, (int64_t) 65536);
+
+        out.resize (done + chunk);
+        stream.next_out = (Bytef *) out.begin () + done;
+        stream.avail_out = chunk;
+
+        ret = inflate (& stream, Z_NO_FLUSH);
+        out.resize (done + chunk - stream.avail_out);
+    }
+
+    inflateEnd (& stream);
+
+    if (ret != Z_STREAM_END)
+        out.clear ();
+
+    return out;
+}
+
+SkinFiles::~SkinFiles ()
+{
+    if (m_tmpdir)
+        del_directory (m_tmpdir);
+}
+
+/* Files in archives are looked up by name only; like "unzip -j", this
+ * ignores any folders inside the archive. */
+void SkinFiles::add_member (const char * name, int len, const Member & member)
+{
+    for (int i = len; i > 0; i --)
+    {
+        if (name[i - 1] == '/')
+        {
+            name += i;
+            len -= i;
+            break;
+        }
+    }
+
+    /* stored members are copied as they are, so their size must match */
+    if (member.method == 0 && member.size != member.csize)
+        return;
+
+    if (len > 0 && member.offset + member.csize <= m_data.len ())
+        m_members.add (String (str_tolower_utf8 (str_copy (name, len))), Member (member));
+}
+
+bool SkinFiles::read_zip ()
+{
+    const char * data = m_data.begin ();
+    int64_t len = m_data.len ();
+
+    /* the end of central directory record may be followed by a comment */
+    int64_t end = len - 22;
+    while (end >= 0 && end >= len - 22 - 65535 && memcmp (data + end, "PK\5\6", 4))
+        end --;
+
+    if (end < 0 || end < len - 22 - 65535)
+        return false;
+
+    int entries = get_le16 (data + end + 10);
+    int64_t pos = get_le32 (data + end + 16);
+
+    for (int i = 0; i < entries; i ++)
+    {
+        if (pos + 46 > len || memcmp (data + pos, "PK\1\2", 4))
+            return false;
+
+        int name_len = get_le16 (data + pos + 28);
+        int64_t local = get_le32 (data + pos + 42);
+
+        Member member;
+        member.method = get_le16 (data + pos + 10);
+        member.csize = get_le32 (data + pos + 20);
+        member.size = get_le32 (data + pos + 24);
+
+        if (pos + 46 + name_len > len || local + 30 > len ||
+         memcmp (data + local, "PK\3\4", 4))
+            return false;
+
+        member.offset = local + 30 + get_le16 (data + local + 26) +
+         get_le16 (data + local + 28);
+
+        add_member (data + pos + 46, name_len, member);
+
+        pos += 46 + name_len + get_le16 (data + pos + 30) + get_le16 (data + pos + 32);
+    }
+
+    return true;
+}
+
+bool SkinFiles::read_tar ()
+{
+    const char * data = m_data.begin ();
+    int64_t len = m_data.len ();
+    String long_name;
+
+    for (int64_t pos = 0; pos + 512 <= len && data[pos]; )
+    {
+        const char * header = data + pos;
+
+        char size_str[13];
+        memcpy (size_str, header + 124, 12);
+        size_str[12] = 0;
+
+        Member member;
+        member.offset = pos + 512;
+        member.size = member.csize = strtoll (size_str, nullptr, 8);
+        member.method = 0;
+
+        if (member.size < 0 || member.offset + member.size > len)
+            return false;
+
+        switch (header[156])
+        {
+        case 0:
+        case '0':
+            if (long_name)
+                add_member (long_name, strlen (long_name), member);
+            else
+                add_member (header, strnlen (header, 100), member);
+
+            long_name = String ();
+            break;
+
+        /* GNU extension: the name of the next member */
+        case 'L':
+            long_name = String (str_copy (data + member.offset,
+             strnlen (data + member.offset, member.size)));
+            break;
+        }
+
+        pos = member.offset + (member.size + 511) / 512 * 512;
+    }
+
+    return true;
+}
+
+bool SkinFiles::open (const char * path)
+{
+    ArchiveType type = archive_get_type (path);
+
+    if (type == ARCHIVE_UNKNOWN)
+    {
+        m_folder = String (path);
+        return true;
+    }
+
+    /* there is no bzip2 decoder at hand, so these are still extracted */
+    if (type == ARCHIVE_TBZ2)
+    {
+        m_tmpdir = String (archive_decompress_tbz2 (path));
+        m_folder = m_tmpdir;
+        return (bool) m_folder;
+    }
+
+    VFSFile file (path, "r");
+    if (! file)
+        return false;
+
+    m_data = file.read_all ();
+
+    if (type == ARCHIVE_TGZ)
+        m_data = inflate_data (m_data.begin (), m_data.len (), -1, true);
+
+    if (type == ARCHIVE_ZIP ? read_zip () : read_tar ())
+        return true;
+
+    AUDWARN ("Error reading skin archive %s\n", path);
+    return false;
+}
+
+bool SkinFiles::has_file (const char * basename)
+{
+    if (m_folder)
+        return (bool) find_file_case_path (m_folder, basename);
+
+    return (bool) m_members.lookup (String (str_tolower_utf8 (basename)));
+}
+
+VFSFile SkinFiles::open_file (const char * basename)
+{
+    if (m_folder)
+    {
+        StringBuf path = find_file_case_path (m_folder, basename);
+        return path ? VFSFile (path, "r") : VFSFile ();
+    }
+
+    Member * member = m_members.lookup (String (str_tolower_utf8 (basename)));
+    if (! member)
+        return VFSFile ();
+
+    Index<char> data;
+
+    if (member->method == 0)
+        data.insert (m_data.begin () + member->offset, 0, member->size);
+    else if (member->method == Z_DEFLATED)
+        data = inflate_data (m_data.begin () + member->offset, member->csize,
+         member->size, false);
+    else
+    {
+        AUDWARN ("Unsupported compression method for %s\n", basename);
+        return VFSFile ();
+    }
+
+    return VFSFile (basename, new MemoryFile (std::move (data)));
+}
+
+VFSFile SkinFiles::open_pixmap (const char * basename, const char * altname)
+{
+    static const char * const exts[] = {".bmp", ".png", ".xpm"};
+
+    for (const char * ext : exts)
+    {
+        StringBuf name = str_concat ({basename, ext});
+        if (has_file (name))
+            return open_file (name);
+    }
+
+    return altname ? open_pixmap (altname) : VFSFile ();
+}
+
 static void del_directory_func (const char * path, const char *)
 {
     if (g_file_test (path, G_FILE_TEST_IS_DIR))
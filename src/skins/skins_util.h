@@ -26,16 +26,13 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <libaudcore/multihash.h>
 #include <libaudcore/vfs.h>
 
 typedef void (* DirForeachFunc) (const char * path, const char * basename);
 
 StringBuf find_file_case_path (const char * folder, const char * basename);
 
-VFSFile open_local_file_nocase (const char * folder, const char * basename);
-StringBuf skin_pixmap_locate (const char * folder, const char * basename,
- const char * altname = nullptr);
-
 char * text_parse_line (char * text);
 
 void make_directory (const char * path);
@@ -47,6 +44,35 @@ Index<int> string_to_int_array (const char *str);
 
 bool file_is_archive (const char * filename);
 StringBuf archive_basename (const char * str);
-StringBuf archive_decompress (const char * path);
+
+/* The files of a skin, which is either a folder or an archive.  Archives
+ * are read into memory and decompressed one file at a time, as needed.
+ * Names are matched regardless of case. */
+class SkinFiles
+{
+public:
+    SkinFiles () {}
+    ~SkinFiles ();
+
+    bool open (const char * path);
+
+    bool has_file (const char * basename);
+    VFSFile open_file (const char * basename);
+    VFSFile open_pixmap (const char * basename, const char * altname = nullptr);
+
+private:
+    struct Member {
+        int64_t offset, size, csize;
+        int method;
+    };
+
+    String m_folder, m_tmpdir;
+    Index<char> m_data;
+    SimpleHash<String, Member> m_members;
+
+    void add_member (const char * name, int len, const Member & member);
+    bool read_zip ();
+    bool read_tar ();
+};
 
 #endif
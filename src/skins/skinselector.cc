@@ -29,6 +29,8 @@
 #include <libaudcore/runtime.h>
 #include <libaudgui/libaudgui-gtk.h>
 
+#include <glib/gstdio.h>
+
 #include "plugin.h"
 #include "skin.h"
 #include "skinselector.h"
@@ -54,26 +56,22 @@ static AudguiPixbuf skin_get_preview (const char * path)
 {
     AudguiPixbuf preview;
 
-    StringBuf archive_path;
-    if (file_is_archive (path))
-    {
-        archive_path = archive_decompress (path);
-        if (! archive_path)
-            return preview;
+    SkinFiles files;
+    if (! files.open (path))
+        return preview;
 
-        path = archive_path;
+    VFSFile file = files.open_pixmap ("main");
+    if (file)
+    {
+        Index<char> data = file.read_all ();
+        preview.capture (audgui_pixbuf_from_data (data.begin (), data.len ()));
     }
 
-    StringBuf preview_path = skin_pixmap_locate (path, "main");
-    if (preview_path)
-        preview.capture (gdk_pixbuf_new_from_file (preview_path, nullptr));
-
-    if (archive_path)
-        del_directory (archive_path);
-
     return preview;
 }
 
+/* Thumbnails are stored along with the modification time of the skin (as
+ * in the freedesktop.org thumbnail spec) and regenerated if it changes. */
 static AudguiPixbuf skin_get_thumbnail (const char * path)
 {
     StringBuf base = filename_get_base (path);
@@ -82,17 +80,28 @@ static AudguiPixbuf skin_get_thumbnail (const char * path)
     StringBuf thumbname = filename_build ({skins_get_skin_thumb_dir (), base});
     AudguiPixbuf thumb;
 
-    if (g_file_test (thumbname, G_FILE_TEST_EXISTS))
+    GStatBuf info;
+    StringBuf mtime = (g_stat (path, & info) < 0) ? StringBuf () :
+     str_printf ("%lld", (long long) info.st_mtime);
+
+    if (mtime && g_file_test (thumbname, G_FILE_TEST_EXISTS))
+    {
         thumb.capture (gdk_pixbuf_new_from_file (thumbname, nullptr));
 
+        if (thumb && g_strcmp0 (gdk_pixbuf_get_option (thumb.get (),
+         "tEXt::Thumb::MTime"), mtime))
+            thumb.clear ();
+    }
+
     if (! thumb)
     {
         thumb = skin_get_preview (path);
 
-        if (thumb)
+        if (thumb && mtime)
         {
             make_directory (skins_get_skin_thumb_dir ());
-            gdk_pixbuf_save (thumb.get (), thumbname, "png", nullptr, nullptr);
+            gdk_pixbuf_save (thumb.get (), thumbname, "png", nullptr,
+             "tEXt::Thumb::MTime", (const char *) mtime, nullptr);
         }
     }
 
@@ -31,19 +31,16 @@ cairo_surface_t * surface_new (int w, int h)
     return cairo_image_surface_create (CAIRO_FORMAT_RGB24, w, h);
 }
 
-cairo_surface_t * surface_new_from_file (const char * name)
+cairo_surface_t * surface_new_from_file (VFSFile & file)
 {
-    GError * error = nullptr;
-    AudguiPixbuf p (gdk_pixbuf_new_from_file (name, & error));
-
-    if (error)
-    {
-        AUDERR ("Error loading %s: %s.\n", name, error->message);
-        g_error_free (error);
-    }
+    Index<char> data = file.read_all ();
+    AudguiPixbuf p (audgui_pixbuf_from_data (data.begin (), data.len ()));
 
     if (! p)
+    {
+        AUDERR ("Error loading %s.\n", file.filename ());
         return nullptr;
+    }
 
     cairo_surface_t * surface = surface_new (p.width (), p.height ());
     cairo_t * cr = cairo_create (surface);
@@ -37,6 +37,7 @@
 #include "textbox.h"
 #include "vis.h"
 #include "skins_util.h"
+#include "../vis-common/spectrum.h"
 
 class VisCallbacks : public Visualizer
 {
@@ -117,24 +118,15 @@ void VisCallbacks::render_multi_pcm (const float * pcm, int channels)
 static void make_log_graph (const float * freq, int bands, int db_range,
  int int_range, unsigned char * graph)
 {
-    static int last_bands = 0;
-    static Index<float> xscale;
+    static LogBands log_bands;
+    float levels[256];
 
-    /* conversion table for the x-axis */
-    if (bands != last_bands)
-    {
-        xscale.resize (bands + 1);
-        Visualizer::compute_log_xscale (& xscale[0], bands);
-        last_bands = bands;
-    }
+    log_bands.set_bands (bands);
+    log_bands.compute_scaled (freq, db_range, levels);
 
+    /* scale (0.0, 1.0) to (0, int_range) */
     for (int i = 0; i < bands; i ++)
-    {
-        float val = Visualizer::compute_freq_band (freq, & xscale[0], i, bands);
-        /* scale (-db_range, 0.0) to (0.0, int_range) */
-        val = (1 + val / db_range) * int_range;
-        graph[i] = aud::clamp ((int) val, 0, int_range);
-    }
+        graph[i] = levels[i] * int_range;
 }
 
 void VisCallbacks::render_freq (const float * freq)
@@ -39,6 +39,7 @@ public:
         { gtk_widget_set_visible (m_widget, visible); }
     void queue_draw ()
         { gtk_widget_queue_draw (m_drawable); }
+    void queue_draw_area (int x, int y, int width, int height);
 
 protected:
     void set_input (GtkWidget * widget);
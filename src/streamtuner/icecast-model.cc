@@ -8,96 +8,292 @@
 // implied.  In no event shall the authors be liable for any damages arising
 // from the use of this software.
 
-#include <QXmlStreamReader>
+#include <QFile>
 
 #include "icecast-model.h"
 
-static const char *ICECAST_YP = "http://dir.xiph.org/yp.xml";
+static const char *ICECAST_YP = "https://dir.xiph.org/yp.xml";
+
+// the last downloaded yp.xml, shown until a new one has arrived
+static StringBuf cache_path ()
+{
+    return filename_build ({aud_get_path (AudPath::UserDir), "icecast-yp.xml"});
+}
+
+void IcecastParser::read_entries (Index<IcecastEntry> & entries)
+{
+    // lets prefab some atoms for fast comparisons
+    static const QString entry_atom = QString ("entry");
+    static const QString server_name_atom = QString ("server_name");
+    static const QString listen_url_atom = QString ("listen_url");
+    static const QString server_type_atom = QString ("server_type");
+    static const QString bitrate_atom = QString ("bitrate");
+    static const QString genre_atom = QString ("genre");
+    static const QString current_song_atom = QString ("current_song");
+    static const QString mp3_atom = QString ("audio/mpeg");
+    static const QString aac_atom = QString ("audio/aacp");
+    static const QString vorbis_atom = QString ("application/ogg");
+
+    // element text is collected token by token, since it may be split
+    // between chunks; at the end of the data, readNext () returns Invalid
+    // with PrematureEndOfDocumentError and resumes once more data is added
+    while (! m_reader.atEnd ()) {
+        auto token_type = m_reader.readNext ();
+
+        switch (token_type) {
+        case QXmlStreamReader::StartElement:
+            m_text.clear ();
+            break;
+
+        case QXmlStreamReader::Characters:
+            m_text += m_reader.text ();
+            break;
+
+        case QXmlStreamReader::EndElement:
+            if (! m_reader.name ().compare (server_name_atom))
+                m_entry.title = m_text;
+            else if (! m_reader.name ().compare (listen_url_atom))
+                m_entry.stream_uri = m_text;
+            else if (! m_reader.name ().compare (current_song_atom))
+                m_entry.current_song = m_text;
+            else if (! m_reader.name ().compare (genre_atom))
+                m_entry.genre = m_text;
+            else if (! m_reader.name ().compare (server_type_atom))
+            {
+                if (! m_text.compare (mp3_atom))
+                    m_entry.type = IcecastEntry::MP3;
+                else if (! m_text.compare (aac_atom))
+                    m_entry.type = IcecastEntry::AAC;
+                else if (! m_text.compare (vorbis_atom))
+                    m_entry.type = IcecastEntry::Vorbis;
+                else
+                    m_entry.type = IcecastEntry::Other;
+            }
+            else if (! m_reader.name ().compare (bitrate_atom))
+                m_entry.bitrate = m_text.toInt ();
+            else if (! m_reader.name ().compare (entry_atom))
+            {
+                m_entry.search_text = (m_entry.title + '\n' + m_entry.genre).toLower ();
+                entries.append (std::move (m_entry));
+                m_entry = IcecastEntry ();
+            }
+
+            m_text.clear ();
+            break;
+
+        default:
+            break;
+        }
+    }
+}
 
 IcecastTunerModel::IcecastTunerModel (QObject * parent) :
     QAbstractListModel (parent)
 {
+    m_qnam = new QNetworkAccessManager (this);
+
+    load_cache ();
     fetch_stations ();
 }
 
 IcecastTunerModel::~IcecastTunerModel ()
 {
+    if (m_reply)
+    {
+        m_reply->disconnect ();
+        m_reply->abort ();
+    }
+
+    delete m_cache_file;
     m_results.clear ();
 }
 
+void IcecastTunerModel::load_cache ()
+{
+    QFile file ((const char *) cache_path ());
+    if (! file.open (QIODevice::ReadOnly))
+        return;
+
+    IcecastParser parser;
+    parser.add_data (file.readAll ());
+
+    Index<IcecastEntry> entries;
+    parser.read_entries (entries);
+
+    AUDINFO ("icecast: %d stations in cache\n", entries.len ());
+
+    m_cached = (entries.len () > 0);
+    add_entries (std::move (entries));
+}
+
+// downloads yp.xml again, unless it has not changed since it was cached
 void IcecastTunerModel::fetch_stations ()
 {
-    vfs_async_file_get_contents(ICECAST_YP, [&] (const char *, const Index<char> & buf) {
-        if (! buf.len ())
-            return;
-
-        beginResetModel ();
-
-        AUDINFO("icecast: got results from YP server\n");
-
-        // oh, this is going to be fun... parse the XML as fast as possible
-        QXmlStreamReader reader (QByteArray (buf.begin (), buf.len ()));
-        IcecastEntry entry;
-
-        // lets prefab some atoms for fast comparisons
-        QString entry_atom = QString ("entry");
-        QString server_name_atom = QString ("server_name");
-        QString listen_url_atom = QString ("listen_url");
-        QString server_type_atom = QString ("server_type");
-        QString bitrate_atom = QString ("bitrate");
-        QString genre_atom = QString ("genre");
-        QString current_song_atom = QString ("current_song");
-        QString mp3_atom = QString ("audio/mpeg");
-        QString aac_atom = QString ("audio/aacp");
-        QString vorbis_atom = QString ("application/ogg");
-
-        while (! reader.atEnd ()) {
-            auto token_type = reader.readNext ();
-
-            switch (token_type) {
-            case QXmlStreamReader::StartElement:
-                if (! reader.name ().compare (server_name_atom))
-                    entry.title = reader.readElementText ();
-                else if (! reader.name ().compare (listen_url_atom))
-                    entry.stream_uri = reader.readElementText ();
-                else if (! reader.name ().compare (current_song_atom))
-                    entry.current_song = reader.readElementText ();
-                else if (! reader.name ().compare (genre_atom))
-                    entry.genre = reader.readElementText ();
-                else if (! reader.name ().compare (server_type_atom))
-                {
-                    auto server_type = reader.readElementText ();
-
-                    if (! server_type.compare (mp3_atom))
-                        entry.type = IcecastEntry::MP3;
-                    else if (! server_type.compare (aac_atom))
-                        entry.type = IcecastEntry::AAC;
-                    else if (! server_type.compare (vorbis_atom))
-                        entry.type = IcecastEntry::Vorbis;
-                    else
-                        entry.type = IcecastEntry::Other;
-                }
-                else if (! reader.name ().compare (bitrate_atom))
-                    entry.bitrate = reader.readElementText ().toInt ();
-
-                break;
-            case QXmlStreamReader::EndElement:
-                if (! reader.name ().compare (entry_atom))
-                    m_results.append (entry);
-
-                break;
-            default:
-                break;
-            }
+    if (m_reply)
+        return;
+
+    QNetworkRequest request = QNetworkRequest (QUrl (ICECAST_YP));
+
+    // Qt 6 follows redirects by default, Qt 5 does not
+#if QT_VERSION >= QT_VERSION_CHECK(5, 9, 0)
+    request.setAttribute (QNetworkRequest::RedirectPolicyAttribute,
+     QNetworkRequest::NoLessSafeRedirectPolicy);
+#elif QT_VERSION >= QT_VERSION_CHECK(5, 6, 0)
+    request.setAttribute (QNetworkRequest::FollowRedirectsAttribute, true);
+#endif
+
+    if (m_cached)
+    {
+        String etag = aud_get_str ("streamtuner", "icecast_etag");
+        String modified = aud_get_str ("streamtuner", "icecast_last_modified");
+
+        if (etag[0])
+            request.setRawHeader ("If-None-Match", (const char *) etag);
+        if (modified[0])
+            request.setRawHeader ("If-Modified-Since", (const char *) modified);
+    }
+
+    m_parser.capture (new IcecastParser);
+    m_pending.clear ();
+
+    m_reply = m_qnam->get (request);
+    QObject::connect (m_reply, &QNetworkReply::readyRead, [this] () { data_received (); });
+    QObject::connect (m_reply, &QNetworkReply::finished, [this] () { download_finished (); });
+}
+
+void IcecastTunerModel::data_received ()
+{
+    if (m_reply->attribute (QNetworkRequest::HttpStatusCodeAttribute).toInt () != 200)
+        return;
+
+    QByteArray data = m_reply->readAll ();
+
+    if (! m_cache_file)
+    {
+        m_cache_file = new QSaveFile ((const char *) cache_path ());
+        if (! m_cache_file->open (QIODevice::WriteOnly))
+            AUDWARN ("icecast: cannot write %s\n", (const char *) cache_path ());
+    }
+
+    if (m_cache_file->isOpen ())
+        m_cache_file->write (data);
+
+    m_parser->add_data (data);
+
+    // without a cached list, stations are shown as they arrive
+    if (m_cached)
+        m_parser->read_entries (m_pending);
+    else
+    {
+        Index<IcecastEntry> entries;
+        m_parser->read_entries (entries);
+        add_entries (std::move (entries));
+    }
+}
+
+void IcecastTunerModel::download_finished ()
+{
+    int status = m_reply->attribute (QNetworkRequest::HttpStatusCodeAttribute).toInt ();
+
+    if (status == 304)
+        AUDINFO ("icecast: cached station list is up to date\n");
+    else if (status == 200 && m_reply->error () == QNetworkReply::NoError)
+    {
+        data_received ();
+
+        AUDINFO ("icecast: got results from YP server\n");
+
+        if (m_cached)
+        {
+            beginResetModel ();
+            m_results = std::move (m_pending);
+            update_visible ();
+            endResetModel ();
+        }
+
+        if (m_cache_file && m_cache_file->commit ())
+        {
+            aud_set_str ("streamtuner", "icecast_etag",
+             m_reply->rawHeader ("ETag").constData ());
+            aud_set_str ("streamtuner", "icecast_last_modified",
+             m_reply->rawHeader ("Last-Modified").constData ());
+            m_cached = true;
         }
+    }
+    else
+        AUDWARN ("icecast: could not get station list: %s\n",
+         (const char *) m_reply->errorString ().toUtf8 ());
+
+    delete m_cache_file;
+    m_cache_file = nullptr;
+
+    m_reply->deleteLater ();
+    m_reply = nullptr;
+}
+
+void IcecastTunerModel::add_entries (Index<IcecastEntry> && entries)
+{
+    if (! entries.len ())
+        return;
+
+    int first = m_results.len ();
+    m_results.move_from (entries, 0, -1, -1, true, true);
+
+    Index<int> rows;
+    for (int i = first; i < m_results.len (); i ++)
+    {
+        if (matches (m_results[i]))
+            rows.append (i);
+    }
+
+    if (! rows.len ())
+        return;
+
+    beginInsertRows (QModelIndex (), m_visible.len (), m_visible.len () + rows.len () - 1);
+    m_visible.move_from (rows, 0, -1, -1, true, true);
+    endInsertRows ();
+}
+
+bool IcecastTunerModel::matches (const IcecastEntry & entry) const
+{
+    for (const QString & word : m_filter_words)
+    {
+        if (! entry.search_text.contains (word))
+            return false;
+    }
+
+    return true;
+}
+
+void IcecastTunerModel::update_visible ()
+{
+    m_visible.clear ();
+
+    for (int i = 0; i < m_results.len (); i ++)
+    {
+        if (matches (m_results[i]))
+            m_visible.append (i);
+    }
+}
+
+void IcecastTunerModel::set_filter (const QString & text)
+{
+    m_filter_words.clear ();
+
+    for (const QString & word : text.toLower ().split (' '))
+    {
+        if (! word.isEmpty ())
+            m_filter_words.append (word);
+    }
 
-        endResetModel ();
-    });
+    beginResetModel ();
+    update_visible ();
+    endResetModel ();
 }
 
 const IcecastEntry & IcecastTunerModel::entry (int idx) const
 {
-    return m_results[idx];
+    return m_results[m_visible[idx]];
 }
 
 int IcecastTunerModel::columnCount (const QModelIndex &) const
@@ -107,7 +303,7 @@ int IcecastTunerModel::columnCount (const QModelIndex &) const
 
 int IcecastTunerModel::rowCount (const QModelIndex &) const
 {
-    return m_results.len ();
+    return m_visible.len ();
 }
 
 QVariant IcecastTunerModel::headerData (int section, Qt::Orientation orientation, int role) const
@@ -20,6 +20,7 @@
 #include <libaudcore/hook.h>
 #include <libaudcore/runtime.h>
 #include <libaudcore/index.h>
+#include <libaudcore/objects.h>
 #include <libaudcore/playlist.h>
 #include <libaudcore/vfs_async.h>
 
@@ -30,6 +31,11 @@
 #include <QVBoxLayout>
 #include <QSplitter>
 #include <QAbstractListModel>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QSaveFile>
+#include <QStringList>
+#include <QXmlStreamReader>
 
 struct IcecastEntry {
     QString title;
@@ -42,9 +48,27 @@ struct IcecastEntry {
         AAC,
         Vorbis,
         Other
-    } type;
+    } type = Other;
 
-    int bitrate;
+    int bitrate = 0;
+
+    // lower-case title and genre, for filtering
+    QString search_text;
+};
+
+// Reads yp.xml as it is downloaded, a chunk at a time.
+class IcecastParser {
+public:
+    void add_data (const QByteArray & data)
+        { m_reader.addData (data); }
+
+    // appends the entries which are complete so far
+    void read_entries (Index<IcecastEntry> & entries);
+
+private:
+    QXmlStreamReader m_reader;
+    IcecastEntry m_entry;
+    QString m_text;    // text of the current element
 };
 
 class IcecastTunerModel : public QAbstractListModel {
@@ -67,11 +91,29 @@ public:
     QVariant data (const QModelIndex &index, int role = Qt::DisplayRole) const;
 
     void fetch_stations ();
+    void set_filter (const QString & text);
 
     const IcecastEntry & entry (int idx) const;
 
 private:
     Index<IcecastEntry> m_results;
+    Index<int> m_visible;    // rows of m_results matching the filter
+    QStringList m_filter_words;
+
+    QNetworkAccessManager * m_qnam;
+    QNetworkReply * m_reply = nullptr;
+    SmartPtr<IcecastParser> m_parser;
+    Index<IcecastEntry> m_pending;    // new list, while the cached one is shown
+    QSaveFile * m_cache_file = nullptr;
+    bool m_cached = false;
+
+    void load_cache ();
+    void add_entries (Index<IcecastEntry> && entries);
+    void update_visible ();
+    bool matches (const IcecastEntry & entry) const;
+
+    void data_received ();
+    void download_finished ();
 };
 
 #endif
@@ -31,3 +31,22 @@ void IcecastListingWidget::activate (const QModelIndex & index)
 
     Playlist::temporary_playlist ().insert_entry (-1, entry.stream_uri.toUtf8 (), Tuple (), true);
 }
+
+IcecastTunerWidget::IcecastTunerWidget (QWidget * parent) :
+    QWidget (parent)
+{
+    m_layout = new QVBoxLayout (this);
+
+    m_filter = new QLineEdit ();
+    m_filter->setClearButtonEnabled (true);
+    m_filter->setPlaceholderText (_("Filter by name or genre"));
+    m_layout->addWidget (m_filter);
+
+    m_tuner = new IcecastListingWidget ();
+    m_layout->addWidget (m_tuner);
+
+    connect (m_filter, &QLineEdit::textChanged, [&] (const QString & text) {
+        IcecastTunerModel *model = (IcecastTunerModel *) m_tuner->model ();
+        model->set_filter (text);
+    });
+}
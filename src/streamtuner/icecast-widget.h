@@ -24,6 +24,7 @@
 #include <QJsonDocument>
 #include <QJsonArray>
 #include <QJsonObject>
+#include <QLineEdit>
 
 #include "icecast-model.h"
 
@@ -37,4 +38,14 @@ private:
      IcecastTunerModel *m_model;
 };
 
+class IcecastTunerWidget : public QWidget {
+public:
+    IcecastTunerWidget(QWidget * parent = nullptr);
+
+private:
+    QLineEdit *m_filter;
+    IcecastListingWidget *m_tuner;
+    QVBoxLayout *m_layout;
+};
+
 #endif
@@ -42,7 +42,7 @@ public:
 
 private:
      ShoutcastTunerWidget *m_shoutcast_tuner;
-     IcecastListingWidget *m_icecast_tuner;
+     IcecastTunerWidget *m_icecast_tuner;
      IHRTunerWidget *m_ihr_tuner;
 };
 
@@ -53,7 +53,7 @@ StreamTunerWidget::StreamTunerWidget(QWidget *parent) :
     setTabPosition (QTabWidget::TabPosition::South);
 
     m_shoutcast_tuner = new ShoutcastTunerWidget (this);
-    m_icecast_tuner = new IcecastListingWidget (this);
+    m_icecast_tuner = new IcecastTunerWidget (this);
     m_ihr_tuner = new IHRTunerWidget (this);
 
     addTab (m_shoutcast_tuner, _("Shoutcast"));
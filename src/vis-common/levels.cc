@@ -0,0 +1,151 @@
+/*
+ * Level metering shared by the visualization plugins
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "levels.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <libaudcore/objects.h>
+
+#define PHASES 4
+#define TAPS 12
+
+/* Hann-windowed sinc; phase p interpolates the point p / PHASES of a sample
+ * after the one TAPS / 2 samples back */
+static float filter[PHASES][TAPS];
+static bool filter_ready;
+
+static void init_filter ()
+{
+    for (int p = 0; p < PHASES; p ++)
+    {
+        float sum = 0;
+
+        for (int j = 0; j < TAPS; j ++)
+        {
+            float x = j - TAPS / 2 + (float) p / PHASES;
+            float sinc = (x == 0) ? 1 : sinf (M_PI * x) / (M_PI * x);
+            float window = 0.5f * (1 + cosf (M_PI * x / (TAPS / 2)));
+
+            filter[p][j] = sinc * window;
+            sum += filter[p][j];
+        }
+
+        /* unity gain for DC */
+        for (int j = 0; j < TAPS; j ++)
+            filter[p][j] /= sum;
+    }
+
+    filter_ready = true;
+}
+
+void LevelMeter::reset ()
+{
+    static_assert (taps == TAPS, "filter length mismatch");
+
+    if (! filter_ready)
+        init_filter ();
+
+    m_channels = 0;
+    m_frames = 0;
+    m_newest = 0;
+
+    memset (m_peak, 0, sizeof m_peak);
+    memset (m_true_peak, 0, sizeof m_true_peak);
+    memset (m_square_sum, 0, sizeof m_square_sum);
+    memset (m_history, 0, sizeof m_history);
+}
+
+void LevelMeter::analyze (const float * pcm, int channels, int frames)
+{
+    int stride = channels;
+    channels = aud::clamp (channels, 1, LEVELS_MAX_CHANNELS);
+
+    if (channels != m_channels)
+    {
+        reset ();
+        m_channels = channels;
+    }
+
+    for (int n = 0; n < frames; n ++)
+    {
+        const float * x = pcm + n * stride;
+
+        for (int c = 0; c < channels; c ++)
+        {
+            m_peak[c] = aud::max (m_peak[c], fabsf (x[c]));
+            m_square_sum[c] += x[c] * x[c];
+        }
+
+        /* phase 0 gives back the samples themselves, which are covered by
+         * the sample peak */
+        for (int p = 1; p < PHASES; p ++)
+        {
+            float acc[LEVELS_MAX_CHANNELS];
+
+            for (int c = 0; c < channels; c ++)
+                acc[c] = filter[p][0] * x[c];
+
+            for (int j = 1; j < TAPS; j ++)
+            {
+                const float * h = m_history[(m_newest + TAPS - j) % (TAPS - 1)];
+                float coef = filter[p][j];
+
+                for (int c = 0; c < channels; c ++)
+                    acc[c] += coef * h[c];
+            }
+
+            for (int c = 0; c < channels; c ++)
+                m_true_peak[c] = aud::max (m_true_peak[c], fabsf (acc[c]));
+        }
+
+        m_newest = (m_newest + 1) % (TAPS - 1);
+        memcpy (m_history[m_newest], x, sizeof (float) * channels);
+    }
+
+    m_frames += frames;
+}
+
+static float to_db (float level, float db_range)
+{
+    return aud::max (20 * log10f (level), -db_range);
+}
+
+bool LevelMeter::take (ChannelLevels & levels, float db_range)
+{
+    if (! m_frames)
+        return false;
+
+    levels.channels = m_channels;
+
+    for (int c = 0; c < m_channels; c ++)
+    {
+        levels.peak[c] = aud::min (to_db (m_peak[c], db_range), 0.0f);
+        levels.rms[c] = aud::min (to_db (sqrtf (m_square_sum[c] / m_frames), db_range), 0.0f);
+        levels.true_peak[c] = to_db (aud::max (m_true_peak[c], m_peak[c]), db_range);
+    }
+
+    m_frames = 0;
+    memset (m_peak, 0, sizeof m_peak);
+    memset (m_true_peak, 0, sizeof m_true_peak);
+    memset (m_square_sum, 0, sizeof m_square_sum);
+
+    return true;
+}
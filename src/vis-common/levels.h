@@ -0,0 +1,67 @@
+/*
+ * Level metering shared by the visualization plugins
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef VIS_COMMON_LEVELS_H
+#define VIS_COMMON_LEVELS_H
+
+#define LEVELS_MAX_CHANNELS 20
+
+// Levels of each channel in dB, no lower than -db_range.  Only the true
+// peak, which includes peaks between the samples, can be above 0 dB.
+struct ChannelLevels
+{
+    int channels = 0;
+    float peak[LEVELS_MAX_CHANNELS];
+    float rms[LEVELS_MAX_CHANNELS];
+    float true_peak[LEVELS_MAX_CHANNELS];
+};
+
+// Measures the interleaved PCM passed to Visualizer::render_multi_pcm().
+// Blocks are accumulated until the levels are taken, so that a display
+// which is redrawn less often than blocks arrive does not miss any peaks.
+//
+// The true peak is found by 4x oversampling (as in ITU-R BS.1770), with
+// the last few samples of each block kept for the next one.  All loops
+// run across the channels of a frame, which lets the compiler vectorize
+// them for any number of channels.
+class LevelMeter
+{
+public:
+    LevelMeter ()
+        { reset (); }
+
+    void reset ();
+    void analyze (const float * pcm, int channels, int frames);
+
+    // returns false if nothing has been analyzed since the last call
+    bool take (ChannelLevels & levels, float db_range);
+
+private:
+    static constexpr int taps = 12; // per phase of the oversampling filter
+
+    int m_channels = 0;
+    int m_frames = 0;
+    int m_newest = 0; // position of the last frame in m_history
+    float m_peak[LEVELS_MAX_CHANNELS];
+    float m_true_peak[LEVELS_MAX_CHANNELS];
+    float m_square_sum[LEVELS_MAX_CHANNELS];
+    float m_history[taps - 1][LEVELS_MAX_CHANNELS];
+};
+
+#endif // VIS_COMMON_LEVELS_H
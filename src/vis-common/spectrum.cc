@@ -0,0 +1,142 @@
+/*
+ * Spectrum analysis shared by the visualization plugins
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "spectrum.h"
+
+#include <math.h>
+
+#include <libaudcore/objects.h>
+
+#define N_BINS 256
+
+void LogBands::set_bands (int bands)
+{
+    if (bands == m_bands)
+        return;
+
+    m_bands = bands;
+    m_first.clear ();
+    m_offset.clear ();
+    m_weights.clear ();
+
+    /* fudge factor to make the graph have the same overall height as a
+     * 12-band one no matter how many bands there are */
+    float scale = (float) bands / 12;
+
+    /* xscale[i] = pow (256, i / bands) - 0.5, as in compute_log_xscale() */
+    float x0 = powf (N_BINS, 0) - 0.5f;
+
+    for (int i = 0; i < bands; i ++)
+    {
+        float x1 = powf (N_BINS, (float) (i + 1) / bands) - 0.5f;
+        int a = ceilf (x0);
+        int b = floorf (x1);
+
+        m_offset.append (m_weights.len ());
+
+        if (b < a)
+        {
+            m_first.append (b);
+            m_weights.append ((x1 - x0) * scale);
+        }
+        else
+        {
+            m_first.append ((a > 0) ? a - 1 : a);
+
+            if (a > 0)
+                m_weights.append ((a - x0) * scale);
+            for (int bin = a; bin < b; bin ++)
+                m_weights.append (scale);
+            if (b < N_BINS)
+                m_weights.append ((x1 - b) * scale);
+        }
+
+        x0 = x1;
+    }
+
+    m_offset.append (m_weights.len ());
+}
+
+void LogBands::compute (const float * freq, float * db) const
+{
+    for (int i = 0; i < m_bands; i ++)
+    {
+        const float * f = freq + m_first[i];
+        const float * w = & m_weights[m_offset[i]];
+        int n = m_offset[i + 1] - m_offset[i];
+
+        /* four independent sums, so that the compiler can use vector
+         * instructions without reordering a single sum */
+        float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        int j = 0;
+
+        for (; j + 4 <= n; j += 4)
+        {
+            s0 += f[j] * w[j];
+            s1 += f[j + 1] * w[j + 1];
+            s2 += f[j + 2] * w[j + 2];
+            s3 += f[j + 3] * w[j + 3];
+        }
+
+        for (; j < n; j ++)
+            s0 += f[j] * w[j];
+
+        db[i] = 20 * log10f ((s0 + s1) + (s2 + s3));
+    }
+}
+
+void LogBands::compute_scaled (const float * freq, float db_range, float * out) const
+{
+    compute (freq, out);
+
+    for (int i = 0; i < m_bands; i ++)
+        out[i] = aud::clamp (1 + out[i] / db_range, 0.0f, 1.0f);
+}
+
+void FalloffBars::resize (int bands)
+{
+    m_bars.resize (bands);
+    m_delays.resize (bands);
+    clear ();
+}
+
+void FalloffBars::clear ()
+{
+    for (float & bar : m_bars)
+        bar = 0;
+    for (int & delay : m_delays)
+        delay = 0;
+}
+
+void FalloffBars::update (const float * values)
+{
+    for (int i = 0; i < m_bars.len (); i ++)
+    {
+        m_bars[i] -= aud::max (0.0f, m_falloff - m_delays[i]);
+
+        if (m_delays[i])
+            m_delays[i] --;
+
+        if (values[i] > m_bars[i])
+        {
+            m_bars[i] = values[i];
+            m_delays[i] = m_delay;
+        }
+    }
+}
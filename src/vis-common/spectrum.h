@@ -0,0 +1,75 @@
+/*
+ * Spectrum analysis shared by the visualization plugins
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef VIS_COMMON_SPECTRUM_H
+#define VIS_COMMON_SPECTRUM_H
+
+#include <libaudcore/index.h>
+
+// Sums the 256-bin linear spectrum passed to Visualizer::render_freq() into
+// logarithmically spaced bands.  The results match compute_log_xscale() and
+// compute_freq_band(), but the weight of each bin is worked out only when the
+// number of bands changes.
+class LogBands
+{
+public:
+    void set_bands (int bands);
+    int bands () const
+        { return m_bands; }
+
+    // writes the level of each band in dB
+    void compute (const float * freq, float * db) const;
+
+    // writes the level of each band, scaled from (-db_range, 0) dB to (0, 1)
+    // and clamped to that range
+    void compute_scaled (const float * freq, float db_range, float * out) const;
+
+private:
+    int m_bands = 0;
+    Index<int> m_first;      // first bin of each band
+    Index<int> m_offset;     // start of each band in m_weights (bands + 1)
+    Index<float> m_weights;
+};
+
+// Bars which jump up to a new peak at once, hold it for a few frames and then
+// fall off at a fixed rate.
+class FalloffBars
+{
+public:
+    FalloffBars (float falloff, int delay) :
+        m_falloff (falloff),
+        m_delay (delay) {}
+
+    void resize (int bands);
+    void clear ();
+    void update (const float * values);
+
+    int len () const
+        { return m_bars.len (); }
+    float operator[] (int i) const
+        { return m_bars[i]; }
+
+private:
+    float m_falloff;
+    int m_delay;
+    Index<float> m_bars;
+    Index<int> m_delays;
+};
+
+#endif // VIS_COMMON_SPECTRUM_H
@@ -21,13 +21,15 @@
 #include "vumeter_qt_widget.h"
 
 #include <math.h>
+#include <QGuiApplication>
+#include <QPaintEvent>
+#include <QScreen>
 #include <libaudcore/runtime.h>
 
 const QColor VUMeterQtWidget::backgroundColor = QColor(16, 16, 16, 255);
 const QColor VUMeterQtWidget::text_color = QColor(255, 255, 255);
 const QColor VUMeterQtWidget::db_line_color = QColor(120, 120, 120);
 const float VUMeterQtWidget::legend_line_width = 1.0f;
-const int VUMeterQtWidget::redraw_interval = 25; // ms
 
 float VUMeterQtWidget::get_db_on_range(float db)
 {
@@ -68,42 +70,36 @@ float VUMeterQtWidget::get_y_from_db(float db)
     return vumeter_top_padding + vumeter_height - get_height_from_db(db);
 }
 
-void VUMeterQtWidget::render_multi_pcm (const float * pcm, int channels)
+// The display is redrawn once per frame of the screen
+int VUMeterQtWidget::get_redraw_interval()
 {
-    nchannels = aud::clamp(channels, 1, max_channels);
+    QScreen * screen = QGuiApplication::primaryScreen();
+    qreal rate = screen ? screen->refreshRate() : 0;
 
-    float * peaks = new float[nchannels];
-    for (int channel = 0; channel < nchannels; channel++)
-    {
-        peaks[channel] = fabsf(pcm[channel]);
-    }
+    if (rate < 1)
+        rate = 60;
 
-    for (int i = 0; i < 512 * nchannels;)
-    {
-        for (int channel = 0; channel < nchannels; channel++)
-        {
-            peaks[channel] = fmaxf(peaks[channel], fabsf(pcm[i++]));
-        }
-    }
+    return aud::clamp((int)(1000 / rate), 4, 40); // ms
+}
 
-    for (int i = 0; i < nchannels; i++)
+void VUMeterQtWidget::render_multi_pcm (const float * pcm, int channels)
+{
+    channels = aud::clamp(channels, 1, max_channels);
+    if (channels != nchannels)
     {
-        float n = peaks[i];
-        float db = get_db_on_range(20 * log10f(n));
+        nchannels = channels;
+        forget_drawn_bars();
+        update();
+    }
 
-        if (db > channels_db_level[i])
-        {
-            channels_db_level[i] = db;
-        }
+    meter.analyze(pcm, channels, 512);
 
-        if (db > channels_peaks[i])
-        {
-            channels_peaks[i] = db;
-            last_peak_times[i].start();
-        }
+    // the timer is stopped while there is nothing to show
+    if (!redraw_timer->isActive())
+    {
+        redraw_elapsed_timer.restart();
+        redraw_timer->start(get_redraw_interval());
     }
-
-    delete[] peaks;
 }
 
 void VUMeterQtWidget::redraw_timer_expired()
@@ -112,20 +108,67 @@ void VUMeterQtWidget::redraw_timer_expired()
     float falloff = aud_get_double ("vumeter", "falloff") / 1000.0;
     qint64 peak_hold_time = aud_get_double ("vumeter", "peak_hold_time") * 1000;
 
+    ChannelLevels levels;
+    bool measured = meter.take(levels, db_range);
+    bool active = measured;
+
     for (int i = 0; i < nchannels; i++)
     {
         float decay_amount = elapsed_render_time * falloff;
         channels_db_level[i] = get_db_on_range(channels_db_level[i] - decay_amount);
+        channels_rms[i] = get_db_on_range(channels_rms[i] - decay_amount);
+
+        if (measured)
+        {
+            channels_db_level[i] = fmaxf(channels_db_level[i], levels.peak[i]);
+            channels_rms[i] = fmaxf(channels_rms[i], levels.rms[i]);
+        }
+
+        // the peak marker shows the true peak, which may be above the bar
+        float peak = measured ? levels.true_peak[i] : -db_range;
 
         qint64 elapsed_peak_time = last_peak_times[i].elapsed();
-        if (channels_db_level[i] > channels_peaks[i] || elapsed_peak_time > peak_hold_time)
+        if (peak > channels_peaks[i] || elapsed_peak_time > peak_hold_time)
         {
-            channels_peaks[i] = channels_db_level[i];
+            channels_peaks[i] = fmaxf(peak, channels_db_level[i]);
             last_peak_times[i].start();
         }
+
+        if (channels_peaks[i] > -db_range)
+            active = true;
     }
 
-    update();
+    update_changed_bars();
+
+    if (!active)
+        redraw_timer->stop();
+}
+
+QRect VUMeterQtWidget::get_bar_rect(int channel)
+{
+    float bar_width = get_bar_width(nchannels);
+    return QRectF(legend_width + bar_width * channel, 0, bar_width, height()).toAlignedRect();
+}
+
+void VUMeterQtWidget::update_changed_bars()
+{
+    for (int i = 0; i < nchannels; i++)
+    {
+        DrawnBar bar = {
+            (int)get_y_from_db(channels_db_level[i]),
+            (int)get_y_from_db(channels_rms[i]),
+            (int)get_y_from_db(channels_peaks[i]),
+            must_draw_vu_legend ? format_db(channels_peaks[i]) : QString()
+        };
+
+        DrawnBar & drawn = drawn_bars[i];
+        if (bar.level_y == drawn.level_y && bar.rms_y == drawn.rms_y &&
+            bar.peak_y == drawn.peak_y && bar.peak_text == drawn.peak_text)
+            continue;
+
+        drawn = bar;
+        update(get_bar_rect(i));
+    }
 }
 
 void VUMeterQtWidget::reset()
@@ -134,8 +177,12 @@ void VUMeterQtWidget::reset()
     {
         last_peak_times[i].start();
         channels_db_level[i] = -db_range;
+        channels_rms[i] = -db_range;
         channels_peaks[i] = -db_range;
     }
+
+    meter.reset();
+    forget_drawn_bars();
 }
 
 void VUMeterQtWidget::draw_background(QPainter & p)
@@ -219,7 +266,7 @@ void VUMeterQtWidget::draw_vu_legend_db(QPainter &p, float db, const char *text)
     p.drawText(QPointF(width() - legend_width + padding, y + (text_size.height()/4.0f)), text);
 }
 
-void VUMeterQtWidget::draw_visualizer_peaks(QPainter &p)
+void VUMeterQtWidget::draw_visualizer_peaks(QPainter &p, const QRect &clip)
 {
     float bar_width = get_bar_width(nchannels);
     float font_size_width = bar_width / 3.0f;
@@ -236,6 +283,9 @@ void VUMeterQtWidget::draw_visualizer_peaks(QPainter &p)
     QFontMetricsF fm(p.font());
     for (int i = 0; i < nchannels; i++)
     {
+        if (!clip.intersects(get_bar_rect(i)))
+            continue;
+
         QString text = format_db(channels_peaks[i]);
         QSizeF text_size = fm.size(0, text);
         p.drawText(
@@ -248,10 +298,13 @@ void VUMeterQtWidget::draw_visualizer_peaks(QPainter &p)
     }
 }
 
-void VUMeterQtWidget::draw_visualizer(QPainter & p)
+void VUMeterQtWidget::draw_visualizer(QPainter & p, const QRect &clip)
 {
     for (int i = 0; i < nchannels; i++)
     {
+        if (!clip.intersects(get_bar_rect(i)))
+            continue;
+
         float bar_width = get_bar_width(nchannels);
         float x = legend_width + (bar_width * i);
         if (i > 0)
@@ -278,6 +331,15 @@ void VUMeterQtWidget::draw_visualizer(QPainter & p)
                 vumeter_pattern
             );
         }
+
+        // the RMS level is marked by a line across the bar
+        if (channels_rms[i] > -db_range)
+        {
+            p.fillRect (
+                QRectF(x, get_y_from_db(channels_rms[i]), bar_width, 1),
+                QColor(255, 255, 255, 150)
+            );
+        }
     }
 }
 
@@ -296,8 +358,17 @@ float VUMeterQtWidget::get_bar_width(int channels)
     return vumeter_width / channels;
 }
 
+// to be called whenever the whole widget is repainted
+void VUMeterQtWidget::forget_drawn_bars()
+{
+    for (DrawnBar & bar : drawn_bars)
+        bar.level_y = -1;
+}
+
 void VUMeterQtWidget::update_sizes()
 {
+    forget_drawn_bars();
+
     if (height() > 200 && width() > 60 && aud_get_bool("vumeter", "display_legend"))
     {
         must_draw_vu_legend = true;
@@ -326,7 +397,6 @@ VUMeterQtWidget::VUMeterQtWidget (QWidget * parent)
 {
     reset();
     connect(redraw_timer, &QTimer::timeout, this, &VUMeterQtWidget::redraw_timer_expired);
-    redraw_timer->start(redraw_interval);
     redraw_elapsed_timer.start();
     update_sizes();
 }
@@ -348,17 +418,22 @@ void VUMeterQtWidget::resizeEvent (QResizeEvent *)
     update_sizes();
 }
 
-void VUMeterQtWidget::paintEvent (QPaintEvent *)
+// Usually only the bars that changed need to be repainted (see
+// update_changed_bars), so everything outside the paint area is skipped.
+void VUMeterQtWidget::paintEvent (QPaintEvent * event)
 {
     QPainter p(this);
+    QRect clip = event->rect();
 
     draw_background(p);
     if (must_draw_vu_legend)
     {
-        draw_vu_legend(p);
-        draw_visualizer_peaks(p);
+        if (clip.left() < legend_width || clip.right() >= width() - legend_width)
+            draw_vu_legend(p);
+
+        draw_visualizer_peaks(p, clip);
     }
-    draw_visualizer(p);
+    draw_visualizer(p, clip);
 }
 
 void VUMeterQtWidget::toggle_display_legend()
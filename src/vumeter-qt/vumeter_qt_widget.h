@@ -29,22 +29,32 @@
 #include <QTimer>
 #include <QElapsedTimer>
 
+#include "../vis-common/levels.h"
+
 class VUMeterQtWidget : public QWidget
 {
 private:
-    static constexpr int max_channels = 20;
+    static constexpr int max_channels = LEVELS_MAX_CHANNELS;
     static constexpr int db_range = 96;
 
     static const QColor backgroundColor;
     static const QColor text_color;
     static const QColor db_line_color;
     static const float legend_line_width;
-    static const int redraw_interval;
+
+    // what was last drawn of each bar, to repaint only the bars that change
+    struct DrawnBar {
+        int level_y, rms_y, peak_y;
+        QString peak_text;
+    };
 
     int nchannels = 2;
+    LevelMeter meter;
     float channels_db_level[max_channels];
+    float channels_rms[max_channels];
     float channels_peaks[max_channels];
     QElapsedTimer last_peak_times[max_channels]; // Time elapsed since peak was set
+    DrawnBar drawn_bars[max_channels] {};
     QLinearGradient vumeter_pattern;
     QLinearGradient background_vumeter_pattern;
     float legend_width;
@@ -57,7 +67,7 @@ private:
     QElapsedTimer redraw_elapsed_timer;
 
     void draw_background (QPainter &p);
-    void draw_visualizer (QPainter &p);
+    void draw_visualizer (QPainter &p, const QRect &clip);
     void draw_vu_legend(QPainter &p);
     float get_height_from_db(float db);
     float get_y_from_db(float db);
@@ -65,12 +75,16 @@ private:
     float get_bar_width(int channels);
     void draw_vu_legend_db(QPainter &p, float db, const char *text);
     void draw_vu_legend_line(QPainter &p, float db, float line_width_factor = 1.0f);
-    void draw_visualizer_peaks(QPainter &p);
+    void draw_visualizer_peaks(QPainter &p, const QRect &clip);
+    QRect get_bar_rect(int channel);
+    void update_changed_bars();
+    void forget_drawn_bars();
     void update_sizes();
 
     static QString format_db(const float val);
     static float get_db_on_range(float db);
     static float get_db_factor(float db);
+    static int get_redraw_interval();
 
 public slots:
     void redraw_timer_expired();
@@ -84,7 +98,7 @@ public:
 
 protected:
     void resizeEvent (QResizeEvent *);
-    void paintEvent (QPaintEvent *);
+    void paintEvent (QPaintEvent * event);
 };
 
 #endif
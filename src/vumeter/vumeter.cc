@@ -26,13 +26,16 @@
 
 #include <libaudcore/audstrings.h>
 #include <libaudcore/i18n.h>
+#include <libaudcore/mainloop.h>
 #include <libaudcore/plugin.h>
 #include <libaudcore/preferences.h>
 #include <libaudcore/runtime.h>
 #include <libaudgui/gtk-compat.h>
 
+#include "../vis-common/levels.h"
+
 #define CFG_ID "vumeter"
-#define MAX_CHANNELS 20
+#define MAX_CHANNELS LEVELS_MAX_CHANNELS
 #define DB_RANGE 96
 
 class VUMeter : public VisPlugin
@@ -103,13 +106,33 @@ static float vumeter_top_padding = 0;
 static float vumeter_bottom_padding = 0;
 static float legend_width;
 static int nchannels = 2;
+static LevelMeter meter;
 static float channels_db_level[MAX_CHANNELS];
+static float channels_rms[MAX_CHANNELS];
 static float channels_peaks[MAX_CHANNELS];
 static gint64 last_peak_times[MAX_CHANNELS]; // Time elapsed since peak was set
 static gint64 last_render_time = 0;
+static bool refreshing = false;
+
+/* what was last drawn of each bar, to redraw only the bars that change */
+struct DrawnBar {
+    int level_y, rms_y, peak_y;
+    String peak_text;
+};
+
+static DrawnBar drawn_bars[MAX_CHANNELS];
+
+/* to be called whenever the whole widget is redrawn */
+static void forget_drawn_bars ()
+{
+    for (DrawnBar & bar : drawn_bars)
+        bar.level_y = -1;
+}
 
 static void update_sizes ()
 {
+    forget_drawn_bars ();
+
     if (aud_get_bool (CFG_ID, "display_legend"))
     {
         legend_width = width * 0.3f;
@@ -167,7 +190,46 @@ static float get_y_from_db (float db)
     return vumeter_top_padding + vumeter_height - get_height_from_db (db);
 }
 
-void VUMeter::render_multi_pcm (const float * pcm, int channels)
+static StringBuf format_db (const float val)
+{
+    if (val > -10)
+        return str_printf ("%.1f", val);
+    else if (val > -DB_RANGE)
+        return str_printf ("%.0f", val);
+    else
+        return str_printf ("-inf");
+}
+
+/* queues a redraw of the bars whose drawing has changed */
+static void queue_changed_bars ()
+{
+    bool legend = aud_get_bool (CFG_ID, "display_legend");
+
+    for (int i = 0; i < nchannels; i ++)
+    {
+        DrawnBar bar = {
+            (int) get_y_from_db (channels_db_level[i]),
+            (int) get_y_from_db (channels_rms[i]),
+            (int) get_y_from_db (channels_peaks[i]),
+            legend ? String (format_db (channels_peaks[i])) : String ()
+        };
+
+        DrawnBar & drawn = drawn_bars[i];
+
+        if (bar.level_y == drawn.level_y && bar.rms_y == drawn.rms_y &&
+         bar.peak_y == drawn.peak_y && bar.peak_text == drawn.peak_text)
+            continue;
+
+        drawn = std::move (bar);
+
+        int x = legend_width + vumeter_width * i;
+        gtk_widget_queue_draw_area (spect_widget, x, 0, ceilf (vumeter_width) + 1, height);
+    }
+}
+
+/* applies fall-off and peak hold to the levels measured since the last
+ * refresh; returns false once all bars have fallen to the bottom */
+static bool refresh ()
 {
     gint64 current_time = g_get_monotonic_time ();
     gint64 elapsed_render_time = current_time - last_render_time;
@@ -175,44 +237,111 @@ void VUMeter::render_multi_pcm (const float * pcm, int channels)
     float falloff = aud_get_double (CFG_ID, "falloff") / 1000000.0;
     gint64 peak_hold_time = aud_get_double (CFG_ID, "peak_hold_time") * 1000000;
 
-    channels = aud::clamp (channels, 1, MAX_CHANNELS);
-    if (nchannels != channels)
-    {
-        nchannels = channels;
-        update_sizes ();
-    }
-
-    float * peaks = new float[nchannels];
-    for (int channel = 0; channel < nchannels; channel ++)
-        peaks[channel] = aud::abs (pcm[channel]);
-
-    for (int i = 0; i < 512 * nchannels;)
-    {
-        for (int channel = 0; channel < nchannels; channel ++)
-            peaks[channel] = aud::max (peaks[channel], aud::abs (pcm[i ++]));
-    }
+    ChannelLevels levels;
+    bool measured = meter.take (levels, DB_RANGE);
+    bool active = measured;
 
     for (int i = 0; i < nchannels; i ++)
     {
-        float n = peaks[i];
-        float db = get_db_on_range (20 * log10f (n));
+        float decay = elapsed_render_time * falloff;
+        channels_db_level[i] = get_db_on_range (channels_db_level[i] - decay);
+        channels_rms[i] = get_db_on_range (channels_rms[i] - decay);
+
+        if (measured)
+        {
+            channels_db_level[i] = aud::max (channels_db_level[i], levels.peak[i]);
+            channels_rms[i] = aud::max (channels_rms[i], levels.rms[i]);
+        }
 
-        channels_db_level[i] = get_db_on_range (channels_db_level[i] - elapsed_render_time * falloff);
-        if (db > channels_db_level[i])
-            channels_db_level[i] = db;
+        /* the peak marker shows the true peak, which may be above the bar */
+        float peak = measured ? levels.true_peak[i] : -DB_RANGE;
 
         gint64 elapsed_peak_time = current_time - last_peak_times[i];
-        if (channels_db_level[i] > channels_peaks[i] || elapsed_peak_time > peak_hold_time)
+        if (peak > channels_peaks[i] || elapsed_peak_time > peak_hold_time)
         {
-            channels_peaks[i] = channels_db_level[i];
-            last_peak_times[i] = g_get_monotonic_time ();
+            channels_peaks[i] = aud::max (peak, channels_db_level[i]);
+            last_peak_times[i] = current_time;
         }
-    }
 
-    delete[] peaks;
+        if (channels_peaks[i] > -DB_RANGE)
+            active = true;
+    }
 
     if (spect_widget)
-        gtk_widget_queue_draw (spect_widget);
+        queue_changed_bars ();
+
+    return active;
+}
+
+#ifdef USE_GTK3
+static guint tick_id;
+
+static gboolean tick_cb (GtkWidget *, GdkFrameClock *, void *)
+{
+    if (refresh ())
+        return G_SOURCE_CONTINUE;
+
+    refreshing = false;
+    tick_id = 0;
+    return G_SOURCE_REMOVE;
+}
+#else
+static void timer_cb (void *)
+{
+    if (! refresh ())
+    {
+        timer_remove (TimerRate::Hz30, timer_cb);
+        refreshing = false;
+    }
+}
+#endif
+
+/* the display is refreshed once per frame of the screen (with GTK 2,
+ * at a fixed rate) as long as there is something to show */
+static void start_refresh ()
+{
+    if (refreshing || ! spect_widget)
+        return;
+
+    refreshing = true;
+    last_render_time = g_get_monotonic_time ();
+
+#ifdef USE_GTK3
+    tick_id = gtk_widget_add_tick_callback (spect_widget, tick_cb, nullptr, nullptr);
+#else
+    timer_add (TimerRate::Hz30, timer_cb);
+#endif
+}
+
+static void stop_refresh ()
+{
+    if (! refreshing)
+        return;
+
+#ifdef USE_GTK3
+    if (spect_widget && tick_id)
+        gtk_widget_remove_tick_callback (spect_widget, tick_id);
+    tick_id = 0;
+#else
+    timer_remove (TimerRate::Hz30, timer_cb);
+#endif
+
+    refreshing = false;
+}
+
+void VUMeter::render_multi_pcm (const float * pcm, int channels)
+{
+    if (aud::clamp (channels, 1, MAX_CHANNELS) != nchannels)
+    {
+        nchannels = aud::clamp (channels, 1, MAX_CHANNELS);
+        update_sizes ();
+
+        if (spect_widget)
+            gtk_widget_queue_draw (spect_widget);
+    }
+
+    meter.analyze (pcm, channels, 512);
+    start_refresh ();
 }
 
 static void reset_variables ()
@@ -220,10 +349,13 @@ static void reset_variables ()
     for (int i = 0; i < MAX_CHANNELS; i ++)
     {
         channels_db_level[i] = -DB_RANGE;
+        channels_rms[i] = -DB_RANGE;
         channels_peaks[i] = -DB_RANGE;
     }
 
     memset (last_peak_times, 0, sizeof last_peak_times);
+    meter.reset ();
+    forget_drawn_bars ();
 }
 
 bool VUMeter::init ()
@@ -327,13 +459,23 @@ static cairo_pattern_t * get_meter_pattern (float alpha)
     return pattern;
 }
 
-static void draw_visualizer (cairo_t * cr)
+/* whether any part of bar <i> is inside <clip> */
+static bool bar_in_clip (int i, const GdkRectangle & clip)
+{
+    float x = legend_width + vumeter_width * i;
+    return x < clip.x + clip.width && x + vumeter_width > clip.x;
+}
+
+static void draw_visualizer (cairo_t * cr, const GdkRectangle & clip)
 {
     cairo_pattern_t * meter_pattern = get_meter_pattern (1.0);
     cairo_pattern_t * meter_pattern_background = get_meter_pattern (0.1);
 
     for (int i = 0; i < nchannels; i ++)
     {
+        if (! bar_in_clip (i, clip))
+            continue;
+
         float x = legend_width + (vumeter_width * i);
         float vumeter_padding = aud::clamp<float> (vumeter_width * 0.02f, 0, 2);
 
@@ -358,23 +500,22 @@ static void draw_visualizer (cairo_t * cr)
                 vumeter_width - vumeter_padding, (0.1f * vumeter_height / DB_RANGE));
             cairo_fill (cr);
         }
+
+        /* the RMS level is marked by a line across the bar */
+        if (channels_rms[i] > -DB_RANGE)
+        {
+            cairo_set_source_rgba (cr, 1, 1, 1, 0.6);
+            cairo_rectangle (cr, x, get_y_from_db (channels_rms[i]),
+                vumeter_width - vumeter_padding, 1);
+            cairo_fill (cr);
+        }
     }
 
     cairo_pattern_destroy (meter_pattern_background);
     cairo_pattern_destroy (meter_pattern);
 }
 
-static StringBuf format_db (const float val)
-{
-    if (val > -10)
-        return str_printf ("%.1f", val);
-    else if (val > -DB_RANGE)
-        return str_printf ("%.0f", val);
-    else
-        return str_printf ("-inf");
-}
-
-static void draw_visualizer_peak_legend (cairo_t * cr)
+static void draw_visualizer_peak_legend (cairo_t * cr, const GdkRectangle & clip)
 {
     float font_size_width = vumeter_width / 3.0f;
     float font_size_height = vumeter_top_padding * 0.8f;
@@ -384,6 +525,9 @@ static void draw_visualizer_peak_legend (cairo_t * cr)
 
     for (int i = 0; i < nchannels; i ++)
     {
+        if (! bar_in_clip (i, clip))
+            continue;
+
         StringBuf text = format_db (channels_peaks[i]);
 
         cairo_text_extents_t extents;
@@ -404,21 +548,31 @@ static gboolean configure_event (GtkWidget * widget, GdkEventConfigure * event)
     return true;
 }
 
+/* usually only the bars that changed need to be redrawn (see
+ * queue_changed_bars), so everything outside the clip area is skipped */
 #ifdef USE_GTK3
 static gboolean draw_event (GtkWidget * widget, cairo_t * cr)
 {
+    GdkRectangle clip;
+    if (! gdk_cairo_get_clip_rectangle (cr, & clip))
+        return true;
 #else
-static gboolean draw_event (GtkWidget * widget)
+static gboolean draw_event (GtkWidget * widget, GdkEventExpose * event)
 {
     cairo_t * cr = gdk_cairo_create (gtk_widget_get_window (widget));
+    gdk_cairo_region (cr, event->region);
+    cairo_clip (cr);
+    GdkRectangle clip = event->area;
 #endif
     draw_background (widget, cr);
     if (aud_get_bool (CFG_ID, "display_legend"))
     {
-        draw_legend (cr);
-        draw_visualizer_peak_legend (cr);
+        if (clip.x < legend_width || clip.x + clip.width > width - legend_width)
+            draw_legend (cr);
+
+        draw_visualizer_peak_legend (cr, clip);
     }
-    draw_visualizer (cr);
+    draw_visualizer (cr, clip);
 #ifndef USE_GTK3
     cairo_destroy (cr);
 #endif
@@ -431,6 +585,12 @@ void VUMeter::toggle_display_legend ()
     gtk_widget_queue_draw (spect_widget);
 }
 
+static void destroy_event ()
+{
+    stop_refresh ();
+    spect_widget = nullptr;
+}
+
 void * VUMeter::get_gtk_widget ()
 {
     GtkWidget * area = gtk_drawing_area_new ();
@@ -438,7 +598,7 @@ void * VUMeter::get_gtk_widget ()
 
     g_signal_connect (area, AUDGUI_DRAW_SIGNAL, (GCallback) draw_event, nullptr);
     g_signal_connect (area, "configure-event", (GCallback) configure_event, nullptr);
-    g_signal_connect (area, "destroy", (GCallback) gtk_widget_destroyed, & spect_widget);
+    g_signal_connect (area, "destroy", (GCallback) destroy_event, nullptr);
 
     GtkWidget * frame = gtk_frame_new (nullptr);
     gtk_frame_set_shadow_type ((GtkFrame *) frame, GTK_SHADOW_IN);
@@ -23,13 +23,9 @@
 #include <glib.h>
 #include <string.h>
 
-#include <libxml/tree.h>
 #include <libxml/parser.h>
 #include <libxml/xmlreader.h>
-#include <libxml/xmlsave.h>
-#include <libxml/xpath.h>
-#include <libxml/xpathInternals.h>
-#include <libxml/uri.h>
+#include <libxml/xmlwriter.h>
 
 #define AUD_GLIB_INTEGRATION
 #include <libaudcore/i18n.h>
@@ -104,98 +100,52 @@ public:
 
 EXPORT XSPFLoader aud_plugin_instance;
 
-static void xspf_add_file (xmlNode * track, const char * filename,
- const char * base, Index<PlaylistAddItem> & items)
+static void xspf_set_location (const char * str, const char * base, String & location)
 {
-    xmlNode *nptr;
-    String location;
-    Tuple tuple;
-
-    for (nptr = track->children; nptr != nullptr; nptr = nptr->next) {
-        if (nptr->type == XML_ELEMENT_NODE) {
-            if (!xmlStrcmp(nptr->name, (xmlChar *)"location")) {
-                /* Location is a special case */
-                char *str = (char *)xmlNodeGetContent(nptr);
-
-                if (strstr (str, "://") != nullptr)
-                    location = String (str);
-                else if (str[0] == '/' && base != nullptr)
-                {
-                    const char * colon = strstr (base, "://");
-
-                    if (colon != nullptr)
-                        location = String (str_printf ("%.*s%s",
-                         (int) (colon + 3 - base), base, str));
-                }
-                else if (base != nullptr)
-                {
-                    const char * slash = strrchr (base, '/');
-
-                    if (slash != nullptr)
-                        location = String (str_printf ("%.*s%s",
-                         (int) (slash + 1 - base), base, str));
-                }
-
-                xmlFree(str);
-            } else {
-                /* Rest of the nodes are handled here */
-                bool isMeta;
-                xmlChar *findName;
-
-                if (!xmlStrcmp(nptr->name, (xmlChar *)"meta")) {
-                    isMeta = true;
-                    findName = xmlGetProp(nptr, (xmlChar *)"rel");
-                } else {
-                    isMeta = false;
-                    findName = xmlStrdup(nptr->name);
-                }
-
-                for (const xspf_entry_t & entry : xspf_entries)
-                if ((entry.isMeta == isMeta) &&
-                    !xmlStrcmp(findName, (xmlChar *)entry.xspfName)) {
-                    xmlChar *str = xmlNodeGetContent(nptr);
-                    switch (Tuple::field_get_type (entry.tupleField)) {
-                        case Tuple::String:
-                            tuple.set_str (entry.tupleField, (char *)str);
-                            tuple.set_state (Tuple::Valid);
-                            break;
-
-                        case Tuple::Int:
-                            tuple.set_int (entry.tupleField, atol((char *)str));
-                            tuple.set_state (Tuple::Valid);
-                            break;
-
-                        default:
-                            break;
-                    }
-                    xmlFree(str);
-                    break;
-                }
+    if (strstr (str, "://") != nullptr)
+        location = String (str);
+    else if (str[0] == '/' && base != nullptr)
+    {
+        const char * colon = strstr (base, "://");
 
-                xmlFree(findName);
-            }
-        }
+        if (colon != nullptr)
+            location = String (str_printf ("%.*s%s",
+             (int) (colon + 3 - base), base, str));
     }
-
-    if (location)
+    else if (base != nullptr)
     {
-        if (tuple.valid ())
-            tuple.set_filename (location);
+        const char * slash = strrchr (base, '/');
 
-        items.append (location, std::move (tuple));
+        if (slash != nullptr)
+            location = String (str_printf ("%.*s%s",
+             (int) (slash + 1 - base), base, str));
     }
 }
 
-
-static void xspf_find_track (xmlNode * tracklist, const char * filename,
- const char * base, Index<PlaylistAddItem> & items)
+static void xspf_set_field (bool isMeta, const xmlChar * findName,
+ const char * str, Tuple & tuple)
 {
-    xmlNode *nptr;
+    for (const xspf_entry_t & entry : xspf_entries)
+    {
+        if (entry.isMeta != isMeta || xmlStrcmp (findName, (xmlChar *) entry.xspfName))
+            continue;
+
+        switch (Tuple::field_get_type (entry.tupleField)) {
+            case Tuple::String:
+                tuple.set_str (entry.tupleField, str);
+                tuple.set_state (Tuple::Valid);
+                break;
 
-    for (nptr = tracklist->children; nptr != nullptr; nptr = nptr->next) {
-        if (nptr->type == XML_ELEMENT_NODE &&
-         ! xmlStrcmp (nptr->name, (xmlChar *) "track"))
-            xspf_add_file (nptr, filename, base, items);
+            case Tuple::Int:
+                tuple.set_int (entry.tupleField, atol (str));
+                tuple.set_state (Tuple::Valid);
+                break;
+
+            default:
+                break;
+        }
+
+        break;
     }
 }
 
@@ -214,45 +164,103 @@ static int close_cb (void * file)
     return 0;
 }
 
+/* The playlist is read with a streaming parser, so that only the current
+ * track (and not the whole document) is held in memory.  Element depths:
+ * 0 = playlist, 1 = title or trackList, 2 = track, 3 = track fields. */
 bool XSPFLoader::load (const char * filename, VFSFile & file, String & title,
  Index<PlaylistAddItem> & items)
 {
-    xmlDoc * doc = xmlReadIO (read_cb, close_cb, & file, filename, nullptr, XML_PARSE_RECOVER);
-    if (! doc)
+    xmlTextReader * reader = xmlReaderForIO (read_cb, close_cb, & file,
+     filename, nullptr, XML_PARSE_RECOVER);
+    if (! reader)
         return false;
 
-    xmlNode *nptr, *nptr2;
-
-    // find trackList
-    for (nptr = doc->children; nptr != nullptr; nptr = nptr->next) {
-        if (nptr->type == XML_ELEMENT_NODE &&
-            !xmlStrcmp(nptr->name, (xmlChar *)"playlist")) {
-            char * base;
+    bool in_playlist = false, in_tracklist = false, in_track = false;
+    String location;
+    Tuple tuple;
+    int ret;
 
-            base = (char *)xmlNodeGetBase(doc, nptr);
+    while ((ret = xmlTextReaderRead (reader)) == 1)
+    {
+        int type = xmlTextReaderNodeType (reader);
+        int depth = xmlTextReaderDepth (reader);
+        const xmlChar * name = xmlTextReaderConstLocalName (reader);
 
-            for (nptr2 = nptr->children; nptr2; nptr2 = nptr2->next)
+        if (type == XML_READER_TYPE_END_ELEMENT)
+        {
+            if (in_track && depth == 2)
             {
-                if (nptr2->type != XML_ELEMENT_NODE)
-                    continue;
-
-                if (! xmlStrcmp (nptr2->name, (xmlChar *) "title"))
+                if (location)
                 {
-                    xmlChar * xml_title = xmlNodeGetContent (nptr2);
-                    if (xml_title && xml_title[0])
-                        title = String ((char *) xml_title);
-                    xmlFree (xml_title);
+                    if (tuple.valid ())
+                        tuple.set_filename (location);
+
+                    items.append (std::move (location), std::move (tuple));
                 }
-                else if (! xmlStrcmp (nptr2->name, (xmlChar *) "trackList"))
-                    xspf_find_track (nptr2, filename, base, items);
+
+                location = String ();
+                tuple = Tuple ();
+                in_track = false;
             }
 
-            xmlFree (base);
+            continue;
+        }
+
+        if (type != XML_READER_TYPE_ELEMENT)
+            continue;
+
+        if (depth == 0)
+            in_playlist = ! xmlStrcmp (name, (xmlChar *) "playlist");
+        else if (! in_playlist)
+            continue;
+        else if (depth == 1)
+        {
+            in_tracklist = ! xmlStrcmp (name, (xmlChar *) "trackList");
+
+            if (! xmlStrcmp (name, (xmlChar *) "title"))
+            {
+                xmlChar * xml_title = xmlTextReaderReadString (reader);
+                if (xml_title && xml_title[0])
+                    title = String ((char *) xml_title);
+                xmlFree (xml_title);
+            }
+        }
+        else if (depth == 2)
+        {
+            in_track = in_tracklist && ! xmlStrcmp (name, (xmlChar *) "track") &&
+             ! xmlTextReaderIsEmptyElement (reader);
+        }
+        else if (depth == 3 && in_track)
+        {
+            xmlChar * str = xmlTextReaderReadString (reader);
+            if (! str)
+                continue;
+
+            if (! xmlStrcmp (name, (xmlChar *) "location"))
+            {
+                /* Location is a special case */
+                xspf_set_location ((char *) str,
+                 (const char *) xmlTextReaderConstBaseUri (reader), location);
+            }
+            else if (! xmlStrcmp (name, (xmlChar *) "meta"))
+            {
+                xmlChar * rel = xmlTextReaderGetAttribute (reader, (xmlChar *) "rel");
+                if (rel)
+                    xspf_set_field (true, rel, (char *) str, tuple);
+                xmlFree (rel);
+            }
+            else
+                xspf_set_field (false, name, (char *) str, tuple);
+
+            xmlFree (str);
         }
     }
 
-    xmlFreeDoc(doc);
-    return true;
+    xmlFreeTextReader (reader);
+
+    /* with XML_PARSE_RECOVER, a document broken halfway still yields
+     * the tracks before the error */
+    return ret == 0 || items.len ();
 }
 
 
@@ -321,91 +329,102 @@ static bool is_valid_string (const char * s, CharPtr & subst)
 }
 
 
-static void xspf_add_node (xmlNodePtr node, bool isMeta, const char * xspfName, const char * strVal)
+static bool xspf_write_node (xmlTextWriter * writer, bool isMeta,
+ const char * xspfName, const char * strVal)
 {
-    xmlNodePtr tmp;
     CharPtr subst;
 
-    if (isMeta) {
-        tmp = xmlNewNode(nullptr, (xmlChar *) "meta");
-        xmlSetProp(tmp, (xmlChar *) "rel", (xmlChar *) xspfName);
-    } else
-        tmp = xmlNewNode(nullptr, (xmlChar *) xspfName);
+    if (! is_valid_string (strVal, subst))
+        strVal = subst.get ();
 
-    if (is_valid_string (strVal, subst))
-        xmlAddChild (tmp, xmlNewText ((xmlChar *) strVal));
-    else
-        xmlAddChild (tmp, xmlNewText ((xmlChar *) subst.get ()));
+    if (isMeta)
+    {
+        return xmlTextWriterStartElement (writer, (xmlChar *) "meta") >= 0 &&
+         xmlTextWriterWriteAttribute (writer, (xmlChar *) "rel", (xmlChar *) xspfName) >= 0 &&
+         xmlTextWriterWriteString (writer, (xmlChar *) strVal) >= 0 &&
+         xmlTextWriterEndElement (writer) >= 0;
+    }
 
-    xmlAddChild(node, tmp);
+    return xmlTextWriterWriteElement (writer, (xmlChar *) xspfName, (xmlChar *) strVal) >= 0;
 }
 
+static bool xspf_write_track (xmlTextWriter * writer, const PlaylistAddItem & item)
+{
+    const Tuple & tuple = item.tuple;
+
+    if (xmlTextWriterStartElement (writer, (xmlChar *) "track") < 0 ||
+     xmlTextWriterWriteElement (writer, (xmlChar *) "location",
+     (xmlChar *) (const char *) item.filename) < 0)
+        return false;
+
+    for (auto & entry : xspf_entries)
+    {
+        switch (tuple.get_value_type (entry.tupleField))
+        {
+        case Tuple::String:
+            if (! xspf_write_node (writer, entry.isMeta, entry.xspfName,
+             tuple.get_str (entry.tupleField)))
+                return false;
+            break;
+        case Tuple::Int:
+            if (! xspf_write_node (writer, entry.isMeta, entry.xspfName,
+             int_to_str (tuple.get_int (entry.tupleField))))
+                return false;
+            break;
+        default:
+            break;
+        }
+    }
+
+    return xmlTextWriterEndElement (writer) >= 0;
+}
 
+/* The playlist is written out element by element as it is generated,
+ * rather than building the whole document in memory first. */
 bool XSPFLoader::save (const char * filename, VFSFile & file,
  const char * title, const Index<PlaylistAddItem> & items)
 {
-    xmlDocPtr doc;
-    xmlNodePtr rootnode, tracklist;
+    xmlOutputBuffer * out = xmlOutputBufferCreateIO (write_cb, close_cb, & file, nullptr);
+    if (! out)
+        return false;
 
-    doc = xmlNewDoc((xmlChar *)"1.0");
-    doc->charset = XML_CHAR_ENCODING_UTF8;
-    doc->encoding = xmlStrdup((xmlChar *)"UTF-8");
+    /* the writer takes ownership of the output buffer */
+    xmlTextWriter * writer = xmlNewTextWriter (out);
+    if (! writer)
+    {
+        xmlOutputBufferClose (out);
+        return false;
+    }
 
-    rootnode = xmlNewNode(nullptr, (xmlChar *)XSPF_ROOT_NODE_NAME);
-    xmlSetProp(rootnode, (xmlChar *)"version", (xmlChar *)"1");
-    xmlSetProp(rootnode, (xmlChar *)"xmlns", (xmlChar *)XSPF_XMLNS);
+    xmlTextWriterSetIndent (writer, 1);
+    xmlTextWriterSetIndentString (writer, (xmlChar *) "  ");
 
-    /* common */
-    xmlDocSetRootElement(doc, rootnode);
+    if (xmlTextWriterStartDocument (writer, "1.0", "UTF-8", nullptr) < 0 ||
+     xmlTextWriterStartElement (writer, (xmlChar *) XSPF_ROOT_NODE_NAME) < 0 ||
+     xmlTextWriterWriteAttribute (writer, (xmlChar *) "version", (xmlChar *) "1") < 0 ||
+     xmlTextWriterWriteAttribute (writer, (xmlChar *) "xmlns", (xmlChar *) XSPF_XMLNS) < 0)
+        goto ERR;
 
-    if (title)
-        xspf_add_node (rootnode, false, "title", title);
+    if (title && ! xspf_write_node (writer, false, "title", title))
+        goto ERR;
 
-    tracklist = xmlNewNode(nullptr, (xmlChar *)"trackList");
-    xmlAddChild(rootnode, tracklist);
+    if (xmlTextWriterStartElement (writer, (xmlChar *) "trackList") < 0)
+        goto ERR;
 
     for (auto & item : items)
     {
-        const char * filename = item.filename;
-        const Tuple & tuple = item.tuple;
-        xmlNodePtr track, location;
-
-        track = xmlNewNode(nullptr, (xmlChar *)"track");
-        location = xmlNewNode(nullptr, (xmlChar *)"location");
-
-        xmlAddChild(location, xmlNewText((xmlChar *)filename));
-        xmlAddChild(track, location);
-        xmlAddChild(tracklist, track);
-
-        for (auto & entry : xspf_entries)
-        {
-            switch (tuple.get_value_type (entry.tupleField))
-            {
-            case Tuple::String:
-                xspf_add_node (track, entry.isMeta, entry.xspfName,
-                 tuple.get_str (entry.tupleField));
-                break;
-            case Tuple::Int:
-                xspf_add_node (track, entry.isMeta, entry.xspfName,
-                 int_to_str (tuple.get_int (entry.tupleField)));
-                break;
-            default:
-                break;
-            }
-        }
+        if (! xspf_write_track (writer, item))
+            goto ERR;
     }
 
-    xmlSaveCtxt * save = xmlSaveToIO (write_cb, close_cb, & file, nullptr, XML_SAVE_FORMAT);
-    if (! save)
-        goto ERR;
-
-    if (xmlSaveDoc (save, doc) < 0 || xmlSaveClose (save) < 0)
+    /* closes trackList and playlist as well */
+    if (xmlTextWriterEndDocument (writer) < 0 || xmlTextWriterFlush (writer) < 0)
         goto ERR;
 
-    xmlFreeDoc(doc);
+    xmlFreeTextWriter (writer);
     return true;
 
 ERR:
-    xmlFreeDoc (doc);
+    xmlFreeTextWriter (writer);
     return false;
 }